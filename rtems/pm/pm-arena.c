@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Image staging arena.
+ *
+ * Blocks are cut from the top of the arena with a bump pointer. A freed
+ * block goes on an address ordered free list and is merged with its free
+ * neighbours. A free block at the top of the arena lowers the bump pointer.
+ * The free list is searched first fit before the bump pointer is used. There
+ * are only a few images in the arena so the list is short.
+ *
+ * Each block has a header the size of a cache line so the data is line
+ * aligned and the header does not share a line with image data.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <bsp.h>
+#include <bsp/aarch64-mmu.h>
+
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+/*
+ * The MMU maps in pages. An uncached arena has to start and end on a page
+ * so no other data shares its pages.
+ */
+#define PM_ARENA_PAGE_SIZE 4096
+
+typedef struct pm_arena_block {
+  size_t size;
+  struct pm_arena_block* next;
+} pm_arena_block;
+
+typedef struct {
+  uint8_t* base;
+  size_t size;
+  size_t line;
+  size_t top;
+  pm_arena_block* free;
+  rtems_pm_arena_stats stats;
+} pm_arena;
+
+static rtems_mutex arena_lock = RTEMS_MUTEX_INITIALIZER("PM Arena");
+static pm_arena arena;
+
+static size_t pm_arena_align(size_t size, size_t align) {
+  return (size + align - 1) & ~(align - 1);
+}
+
+static uint8_t* pm_arena_data(pm_arena_block* block) {
+  return ((uint8_t*) block) + arena.line;
+}
+
+static pm_arena_block* pm_arena_header(const void* ptr) {
+  return (pm_arena_block*) (((uint8_t*) ptr) - arena.line);
+}
+
+static size_t pm_arena_offset(const pm_arena_block* block) {
+  return ((const uint8_t*) block) - arena.base;
+}
+
+/*
+ * Call with the lock held.
+ */
+static void pm_arena_largest_free(void) {
+  pm_arena_block* block;
+  size_t largest = arena.size - arena.top;
+  for (block = arena.free; block != NULL; block = block->next) {
+    if (block->size > largest) {
+      largest = block->size;
+    }
+  }
+  arena.stats.largest_free = largest > arena.line ? largest - arena.line : 0;
+}
+
+static int pm_arena_map_uncached(void* base, size_t size) {
+  rtems_status_code sc;
+  /*
+   * Write back and drop any lines before the attributes change.
+   */
+  rtems_cache_flush_multiple_data_lines(base, size);
+  rtems_cache_invalidate_multiple_data_lines(base, size);
+  sc = aarch64_mmu_map((uintptr_t) base, size, AARCH64_MMU_DATA_RW);
+  if (sc != RTEMS_SUCCESSFUL) {
+    pm_info("arena: mmu map: %s\n", rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+int rtems_pm_arena_init(void* base, size_t size, uint32_t flags) {
+  const size_t line = rtems_cache_get_data_line_size();
+  const bool uncached = (flags & RTEMS_PM_ARENA_UNCACHED) != 0;
+  const size_t align = uncached ? PM_ARENA_PAGE_SIZE : line;
+  if (base == NULL || size < 2 * line ||
+      ((uintptr_t) base & (align - 1)) != 0 || (size & (align - 1)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  rtems_mutex_lock(&arena_lock);
+  if (arena.base != NULL) {
+    rtems_mutex_unlock(&arena_lock);
+    errno = EEXIST;
+    return -1;
+  }
+  if (uncached && pm_arena_map_uncached(base, size) < 0) {
+    rtems_mutex_unlock(&arena_lock);
+    return -1;
+  }
+  memset(&arena, 0, sizeof(arena));
+  arena.base = base;
+  arena.size = size;
+  arena.line = line;
+  arena.stats.size = size;
+  arena.stats.uncached = uncached;
+  pm_arena_largest_free();
+  rtems_mutex_unlock(&arena_lock);
+  pm_debug(
+    "arena: %p size=%zu%s\n", base, size, uncached ? " uncached" : "");
+  return 0;
+}
+
+int rtems_pm_arena_create(size_t size, uint32_t flags) {
+  const bool uncached = (flags & RTEMS_PM_ARENA_UNCACHED) != 0;
+  const size_t align =
+    uncached ? PM_ARENA_PAGE_SIZE : rtems_cache_get_data_line_size();
+  void* base = NULL;
+  int r;
+  size = pm_arena_align(size, align);
+  r = posix_memalign(&base, align, size);
+  if (r != 0) {
+    errno = r;
+    return -1;
+  }
+  r = rtems_pm_arena_init(base, size, flags);
+  if (r < 0) {
+    int eno = errno;
+    free(base);
+    errno = eno;
+    return -1;
+  }
+  return 0;
+}
+
+bool rtems_pm_arena_active(void) {
+  return arena.base != NULL;
+}
+
+void* rtems_pm_arena_alloc(size_t size) {
+  pm_arena_block** link;
+  pm_arena_block* block = NULL;
+  size_t need;
+  if (arena.base == NULL || size == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  rtems_mutex_lock(&arena_lock);
+  need = pm_arena_align(size, arena.line) + arena.line;
+  for (link = &arena.free; *link != NULL; link = &(*link)->next) {
+    if ((*link)->size >= need) {
+      block = *link;
+      /*
+       * Split if the remainder can hold a header and a line of data.
+       */
+      if (block->size - need >= 2 * arena.line) {
+        pm_arena_block* rest = (pm_arena_block*) (((uint8_t*) block) + need);
+        rest->size = block->size - need;
+        rest->next = block->next;
+        block->size = need;
+        *link = rest;
+      } else {
+        *link = block->next;
+      }
+      break;
+    }
+  }
+  if (block == NULL && arena.size - arena.top >= need) {
+    block = (pm_arena_block*) (arena.base + arena.top);
+    block->size = need;
+    arena.top += need;
+  }
+  if (block == NULL) {
+    ++arena.stats.failures;
+    rtems_mutex_unlock(&arena_lock);
+    errno = ENOMEM;
+    return NULL;
+  }
+  block->next = NULL;
+  ++arena.stats.allocs;
+  ++arena.stats.blocks;
+  arena.stats.used += block->size;
+  if (arena.stats.used > arena.stats.peak) {
+    arena.stats.peak = arena.stats.used;
+  }
+  pm_arena_largest_free();
+  rtems_mutex_unlock(&arena_lock);
+  return pm_arena_data(block);
+}
+
+bool rtems_pm_arena_contains(const void* ptr) {
+  const uint8_t* p = ptr;
+  return arena.base != NULL && p >= arena.base && p < arena.base + arena.size;
+}
+
+void rtems_pm_arena_free(void* ptr) {
+  pm_arena_block* block;
+  pm_arena_block** link;
+  pm_arena_block* prev = NULL;
+  if (!rtems_pm_arena_contains(ptr)) {
+    return;
+  }
+  block = pm_arena_header(ptr);
+  rtems_mutex_lock(&arena_lock);
+  --arena.stats.blocks;
+  arena.stats.used -= block->size;
+  for (link = &arena.free; *link != NULL && *link < block; link = &(*link)->next) {
+    prev = *link;
+  }
+  block->next = *link;
+  *link = block;
+  if (block->next != NULL &&
+      pm_arena_offset(block) + block->size == pm_arena_offset(block->next)) {
+    block->size += block->next->size;
+    block->next = block->next->next;
+  }
+  if (prev != NULL && pm_arena_offset(prev) + prev->size == pm_arena_offset(block)) {
+    prev->size += block->size;
+    prev->next = block->next;
+    block = prev;
+  }
+  /*
+   * A free block at the top goes back to the bump pointer. It is the last
+   * block on the address ordered list.
+   */
+  if (block->next == NULL && pm_arena_offset(block) + block->size == arena.top) {
+    arena.top = pm_arena_offset(block);
+    for (link = &arena.free; *link != block; link = &(*link)->next) {
+    }
+    *link = NULL;
+  }
+  pm_arena_largest_free();
+  rtems_mutex_unlock(&arena_lock);
+}
+
+void rtems_pm_arena_get_stats(rtems_pm_arena_stats* stats) {
+  rtems_mutex_lock(&arena_lock);
+  *stats = arena.stats;
+  rtems_mutex_unlock(&arena_lock);
+}
+
+void* pm_image_buffer_alloc(size_t size, bool* uncached) {
+  const size_t line = rtems_cache_get_data_line_size();
+  void* buffer;
+  *uncached = false;
+  if (rtems_pm_arena_active()) {
+    buffer = rtems_pm_arena_alloc(size);
+    if (buffer != NULL) {
+      *uncached = arena.stats.uncached;
+      return buffer;
+    }
+    pm_debug("arena: full, using the heap: size=%zu\n", size);
+  }
+  return rtems_cache_aligned_malloc(pm_arena_align(size, line));
+}
+
+void pm_image_buffer_free(void* buffer) {
+  if (rtems_pm_arena_contains(buffer)) {
+    rtems_pm_arena_free(buffer);
+  } else {
+    free(buffer);
+  }
+}
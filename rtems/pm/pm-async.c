@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous ACAP loads.
+ *
+ * A loader task takes requests off a priority ordered queue and loads them.
+ * A load holds the loader task in the firmware for the time the PLM takes
+ * and the callers are free to do other work.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#ifndef PM_ACAP_LOADER_PRIORITY
+#define PM_ACAP_LOADER_PRIORITY 120
+#endif
+
+#define PM_ACAP_LOADER_STACK_SIZE (RTEMS_MINIMUM_STACK_SIZE * 2)
+
+static rtems_mutex loader_lock = RTEMS_MUTEX_INITIALIZER("PM ACAP Loader");
+static rtems_counting_semaphore loader_work;
+static rtems_pm_acap_request* loader_queue;
+static uint32_t loader_queued;
+static bool loader_running;
+
+/*
+ * Call with the lock held.
+ */
+static void pm_acap_queue_insert(rtems_pm_acap_request* req) {
+  rtems_pm_acap_request** link = &loader_queue;
+  while (*link != NULL && (*link)->priority <= req->priority) {
+    link = &(*link)->next;
+  }
+  req->next = *link;
+  *link = req;
+  ++loader_queued;
+}
+
+static void pm_acap_request_complete(
+  rtems_pm_acap_request* req, rtems_pm_acap_req_state state) {
+  rtems_pm_acap_done done = req->done;
+  void* arg = req->arg;
+  rtems_id task = req->task;
+  rtems_event_set events = req->events;
+  req->finished = rtems_clock_get_uptime_nanoseconds();
+  req->state = state;
+  if (done != NULL) {
+    done(req, arg);
+  }
+  if (task != 0) {
+    rtems_event_send(task, events);
+  }
+}
+
+static void pm_acap_loader(rtems_task_argument arg) {
+  while (true) {
+    rtems_pm_acap_request* req;
+    rtems_counting_semaphore_wait(&loader_work);
+    rtems_mutex_lock(&loader_lock);
+    req = loader_queue;
+    if (req != NULL) {
+      loader_queue = req->next;
+      req->next = NULL;
+      req->state = RTEMS_PM_ACAP_REQ_LOADING;
+      --loader_queued;
+    }
+    rtems_mutex_unlock(&loader_lock);
+    /*
+     * A cancelled request leaves a count with nothing queued.
+     */
+    if (req == NULL) {
+      continue;
+    }
+    req->started = rtems_clock_get_uptime_nanoseconds();
+    if (req->digest != NULL) {
+      req->result =
+        rtems_pm_acap_load_verified(req->image, req->digest, &req->status);
+    } else {
+      req->result = rtems_pm_acap_load_image(req->image, &req->status);
+    }
+    req->error = req->result < 0 ? errno : 0;
+    pm_debug(
+      "acap: async: load: result=%d status=%" PRIu32 " time=%" PRIu64 "ns\n",
+      req->result, req->status, rtems_clock_get_uptime_nanoseconds() - req->started);
+    pm_acap_request_complete(req, RTEMS_PM_ACAP_REQ_DONE);
+  }
+}
+
+int rtems_pm_acap_loader_start(uint32_t priority) {
+  rtems_status_code sc;
+  rtems_id id;
+  rtems_mutex_lock(&loader_lock);
+  if (loader_running) {
+    rtems_mutex_unlock(&loader_lock);
+    errno = EALREADY;
+    return -1;
+  }
+  sc = rtems_task_create(
+    rtems_build_name('P', 'M', 'L', 'D'), priority, PM_ACAP_LOADER_STACK_SIZE,
+    RTEMS_DEFAULT_MODES, RTEMS_DEFAULT_ATTRIBUTES, &id);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_mutex_unlock(&loader_lock);
+    pm_info("acap: loader: task create: %s\n", rtems_status_text(sc));
+    errno = ENOMEM;
+    return -1;
+  }
+  rtems_counting_semaphore_init(&loader_work, "PM ACAP Work", 0);
+  sc = rtems_task_start(id, pm_acap_loader, 0);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_task_delete(id);
+    rtems_counting_semaphore_destroy(&loader_work);
+    rtems_mutex_unlock(&loader_lock);
+    pm_info("acap: loader: task start: %s\n", rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  loader_running = true;
+  rtems_mutex_unlock(&loader_lock);
+  return 0;
+}
+
+int rtems_pm_acap_load_async(rtems_pm_acap_request* req) {
+  if (req == NULL || req->image == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (req->state == RTEMS_PM_ACAP_REQ_QUEUED ||
+      req->state == RTEMS_PM_ACAP_REQ_LOADING) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (!loader_running) {
+    if (rtems_pm_acap_loader_start(PM_ACAP_LOADER_PRIORITY) < 0 &&
+        errno != EALREADY) {
+      return -1;
+    }
+  }
+  req->result = 0;
+  req->error = 0;
+  req->status = 0;
+  req->started = 0;
+  req->finished = 0;
+  req->queued = rtems_clock_get_uptime_nanoseconds();
+  rtems_mutex_lock(&loader_lock);
+  req->state = RTEMS_PM_ACAP_REQ_QUEUED;
+  pm_acap_queue_insert(req);
+  rtems_mutex_unlock(&loader_lock);
+  rtems_counting_semaphore_post(&loader_work);
+  return 0;
+}
+
+int rtems_pm_acap_load_cancel(rtems_pm_acap_request* req) {
+  rtems_pm_acap_request** link;
+  rtems_mutex_lock(&loader_lock);
+  link = &loader_queue;
+  while (*link != NULL && *link != req) {
+    link = &(*link)->next;
+  }
+  if (*link == NULL) {
+    rtems_mutex_unlock(&loader_lock);
+    errno = req->state == RTEMS_PM_ACAP_REQ_LOADING ? EBUSY : ENOENT;
+    return -1;
+  }
+  *link = req->next;
+  req->next = NULL;
+  --loader_queued;
+  rtems_mutex_unlock(&loader_lock);
+  req->result = -1;
+  req->error = ECANCELED;
+  pm_acap_request_complete(req, RTEMS_PM_ACAP_REQ_CANCELLED);
+  return 0;
+}
+
+uint32_t rtems_pm_acap_load_queued(void) {
+  uint32_t queued;
+  rtems_mutex_lock(&loader_lock);
+  queued = loader_queued;
+  rtems_mutex_unlock(&loader_lock);
+  return queued;
+}
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <rtems.h>
+
+#include <bsp.h>
+
+#include <smc/smccc.h>
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+static int pm_smc_call(
+  uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2,
+  struct arm_smccc_res* res) {
+  return arm_smccc_smc(func_id, a64_0, a64_1, a64_2, 0, 0, 0, 0, res);
+}
+
+static int pm_hvc_call(
+  uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2,
+  struct arm_smccc_res* res) {
+  return arm_smccc_hvc(func_id, a64_0, a64_1, a64_2, 0, 0, 0, 0, res);
+}
+
+/*
+ * The extended calls are not made to a firmware older than SMCCC 1.2 as it
+ * does not preserve or return x4 to x17.
+ */
+static int pm_smc_call_ext(
+  const struct arm_smccc_1_2_regs* args, struct arm_smccc_1_2_regs* res) {
+  if (smccc_version < SMCCC_VERSION_1_2) {
+    return SMCCC_RET_NOT_SUPPORTED;
+  }
+  arm_smccc_1_2_smc(args, res);
+  return (int) res->a[0];
+}
+
+static int pm_hvc_call_ext(
+  const struct arm_smccc_1_2_regs* args, struct arm_smccc_1_2_regs* res) {
+  if (smccc_version < SMCCC_VERSION_1_2) {
+    return SMCCC_RET_NOT_SUPPORTED;
+  }
+  arm_smccc_1_2_hvc(args, res);
+  return (int) res->a[0];
+}
+
+const pm_backend_ops pm_backend_smc = {
+  .name = "smc",
+  .init = NULL,
+  .call = pm_smc_call,
+  .call_ext = pm_smc_call_ext
+};
+
+const pm_backend_ops pm_backend_hvc = {
+  .name = "hvc",
+  .init = NULL,
+  .call = pm_hvc_call,
+  .call_ext = pm_hvc_call_ext
+};
+
+static const pm_backend_ops* backends[RTEMS_PM_BACKEND_MAX] = {
+  &pm_backend_smc,
+  &pm_backend_hvc,
+  &pm_backend_sim,
+};
+
+/*
+ * The default follows how the BSP resets the board, a BSP that uses an SMC
+ * to reset has EL3 firmware to talk to.
+ */
+#ifndef PM_BACKEND_DEFAULT
+#ifdef BSP_RESET_SMC
+#define PM_BACKEND_DEFAULT RTEMS_PM_BACKEND_SMC
+#else
+#define PM_BACKEND_DEFAULT RTEMS_PM_BACKEND_HVC
+#endif /* BSP_RESET_SMC */
+#endif /* PM_BACKEND_DEFAULT */
+
+static rtems_pm_backend_id backend_id = PM_BACKEND_DEFAULT;
+
+const pm_backend_ops* pm_backend_get(void) {
+  return backends[backend_id];
+}
+
+int rtems_pm_backend_select(rtems_pm_backend_id id) {
+  const pm_backend_ops* ops;
+  if (id >= RTEMS_PM_BACKEND_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  ops = backends[id];
+  if (ops->init != NULL) {
+    int r = ops->init();
+    if (r != 0) {
+      return r;
+    }
+  }
+  backend_id = id;
+  rtems_pm_caps_probe();
+  pm_clock_tree_reset();
+  pm_query_ext_reset();
+  pm_debug("pm: backend: %s\n", ops->name);
+  return 0;
+}
+
+rtems_pm_backend_id rtems_pm_backend_current(void) {
+  return backend_id;
+}
+
+const char* rtems_pm_backend_name(rtems_pm_backend_id id) {
+  if (id < RTEMS_PM_BACKEND_MAX) {
+    return backends[id]->name;
+  }
+  return "invalid";
+}
+
+int rtems_pm_backend_find(const char* name, rtems_pm_backend_id* id) {
+  rtems_pm_backend_id b;
+  for (b = 0; b < RTEMS_PM_BACKEND_MAX; ++b) {
+    if (strcmp(backends[b]->name, name) == 0) {
+      *id = b;
+      return 0;
+    }
+  }
+  errno = ENOENT;
+  return -1;
+}
@@ -0,0 +1,392 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Image cache.
+ *
+ * The entries are on a list in most recently used order. An entry is found
+ * by its file path or by its PDI Id and content hash. A compressed image
+ * in memory is found by the hash of the compressed data so a hit does not
+ * decompress it again. A file entry is only
+ * used if the file's size and modification time are the same as when it
+ * was loaded. The lock is not held while a file is read so a load does not
+ * block other users of the cache.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+typedef struct pm_cache_entry {
+  rtems_pm_image image;
+  TAILQ_ENTRY(pm_cache_entry) node;
+  char* path;
+  off_t file_size;
+  struct timespec mtime;
+  uint32_t pdi_id;
+  uint64_t hash;
+  size_t hash_size;
+  uint32_t refs;
+  uint32_t hits;
+  bool pinned;
+  bool cached;
+} pm_cache_entry;
+
+static TAILQ_HEAD(pm_cache_entry_head, pm_cache_entry) cache_lru =
+  TAILQ_HEAD_INITIALIZER(cache_lru);
+static rtems_mutex cache_lock = RTEMS_MUTEX_INITIALIZER("PM Image Cache");
+static rtems_pm_cache_stats cache_stats;
+
+/*
+ * A 64bit multiply and rotate hash. It is not cryptographic, it only has to
+ * tell images apart.
+ */
+#define PM_CACHE_HASH_P1 UINT64_C(0x9e3779b185ebca87)
+#define PM_CACHE_HASH_P2 UINT64_C(0xc2b2ae3d27d4eb4f)
+
+static uint64_t pm_cache_rotl(uint64_t v, int bits) {
+  return (v << bits) | (v >> (64 - bits));
+}
+
+uint64_t rtems_pm_cache_hash(const void* data, size_t size) {
+  const uint8_t* bytes = data;
+  uint64_t hash = PM_CACHE_HASH_P2 ^ size;
+  size_t offset = 0;
+  for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + offset, sizeof(word));
+    hash ^= pm_cache_rotl(word * PM_CACHE_HASH_P2, 31) * PM_CACHE_HASH_P1;
+    hash = pm_cache_rotl(hash, 27) * PM_CACHE_HASH_P1;
+  }
+  for (; offset < size; ++offset) {
+    hash ^= bytes[offset] * PM_CACHE_HASH_P1;
+    hash = pm_cache_rotl(hash, 11) * PM_CACHE_HASH_P2;
+  }
+  hash ^= hash >> 33;
+  hash *= PM_CACHE_HASH_P2;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+static uint32_t pm_cache_pdi_id(const void* data, size_t size) {
+  rtems_pm_pdi_index index;
+  rtems_pm_pdi_index_build(&index, data, size);
+  return rtems_pm_pdi_index_valid(&index) ? index.report.pdi_id : 0;
+}
+
+static void pm_cache_entry_free(pm_cache_entry* entry) {
+  rtems_pm_image_free(&entry->image);
+  free(entry->path);
+  free(entry);
+}
+
+/*
+ * Evict the least recently used entries until the cache is in its limit.
+ * Call with the lock held.
+ */
+static void pm_cache_evict(void) {
+  pm_cache_entry* entry = TAILQ_LAST(&cache_lru, pm_cache_entry_head);
+  while (entry != NULL && cache_stats.size > cache_stats.limit) {
+    pm_cache_entry* prev = TAILQ_PREV(entry, pm_cache_entry_head, node);
+    if (entry->refs == 0 && !entry->pinned) {
+      pm_debug("cache: evict: %s\n", entry->path == NULL ? "-" : entry->path);
+      TAILQ_REMOVE(&cache_lru, entry, node);
+      cache_stats.size -= entry->image.size;
+      --cache_stats.entries;
+      ++cache_stats.evictions;
+      pm_cache_entry_free(entry);
+    }
+    entry = prev;
+  }
+}
+
+/*
+ * Take a reference to an entry and make it the most recently used. Call
+ * with the lock held.
+ */
+static rtems_pm_image* pm_cache_hit(pm_cache_entry* entry) {
+  ++entry->refs;
+  ++entry->hits;
+  ++cache_stats.hits;
+  TAILQ_REMOVE(&cache_lru, entry, node);
+  TAILQ_INSERT_HEAD(&cache_lru, entry, node);
+  return &entry->image;
+}
+
+/*
+ * Add a new entry if it fits. An entry that does not fit is returned to the
+ * caller uncached and freed when released. Call with the lock held.
+ */
+static rtems_pm_image* pm_cache_add(pm_cache_entry* entry) {
+  entry->refs = 1;
+  ++cache_stats.misses;
+  if (entry->image.size <= cache_stats.limit) {
+    entry->cached = true;
+    TAILQ_INSERT_HEAD(&cache_lru, entry, node);
+    cache_stats.size += entry->image.size;
+    ++cache_stats.entries;
+    pm_cache_evict();
+  }
+  return &entry->image;
+}
+
+static pm_cache_entry* pm_cache_find_file(const char* path, const struct stat* sb) {
+  pm_cache_entry* entry;
+  TAILQ_FOREACH(entry, &cache_lru, node) {
+    if (entry->path != NULL && strcmp(entry->path, path) == 0) {
+      if (entry->file_size == sb->st_size &&
+          entry->mtime.tv_sec == sb->st_mtim.tv_sec &&
+          entry->mtime.tv_nsec == sb->st_mtim.tv_nsec) {
+        return entry;
+      }
+      /*
+       * The file has changed. The entry's contents can still be found by
+       * its hash.
+       */
+      free(entry->path);
+      entry->path = NULL;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+static pm_cache_entry* pm_cache_find_content(
+  uint32_t pdi_id, uint64_t hash, size_t size) {
+  pm_cache_entry* entry;
+  TAILQ_FOREACH(entry, &cache_lru, node) {
+    if (entry->pdi_id == pdi_id && entry->hash == hash &&
+        entry->hash_size == size) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+void rtems_pm_cache_set_limit(size_t limit) {
+  rtems_mutex_lock(&cache_lock);
+  cache_stats.limit = limit;
+  pm_cache_evict();
+  rtems_mutex_unlock(&cache_lock);
+}
+
+int rtems_pm_cache_load_file(
+  const char* path, uint32_t flags, rtems_pm_image** image) {
+  pm_cache_entry* entry;
+  pm_cache_entry* found;
+  struct stat sb;
+  int r;
+  r = stat(path, &sb);
+  if (r < 0) {
+    return -1;
+  }
+  rtems_mutex_lock(&cache_lock);
+  entry = pm_cache_find_file(path, &sb);
+  if (entry != NULL) {
+    *image = pm_cache_hit(entry);
+    rtems_mutex_unlock(&cache_lock);
+    return 0;
+  }
+  rtems_mutex_unlock(&cache_lock);
+  entry = calloc(1, sizeof(*entry));
+  if (entry == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  r = rtems_pm_image_load(path, flags | RTEMS_PM_IMAGE_LOAD_CLEAN, &entry->image);
+  if (r < 0) {
+    free(entry);
+    return -1;
+  }
+  entry->path = strdup(path);
+  entry->file_size = sb.st_size;
+  entry->mtime = sb.st_mtim;
+  entry->pdi_id = pm_cache_pdi_id(entry->image.image, entry->image.size);
+  entry->hash = rtems_pm_cache_hash(entry->image.image, entry->image.size);
+  entry->hash_size = entry->image.size;
+  rtems_mutex_lock(&cache_lock);
+  /*
+   * Another task may have loaded the same contents while the lock was not
+   * held.
+   */
+  found = pm_cache_find_content(entry->pdi_id, entry->hash, entry->image.size);
+  if (found != NULL) {
+    if (found->path == NULL) {
+      found->path = entry->path;
+      entry->path = NULL;
+      found->file_size = entry->file_size;
+      found->mtime = entry->mtime;
+    }
+    *image = pm_cache_hit(found);
+    rtems_mutex_unlock(&cache_lock);
+    pm_cache_entry_free(entry);
+    return 0;
+  }
+  *image = pm_cache_add(entry);
+  rtems_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+int rtems_pm_cache_load_memory(
+  const void* data, size_t size, rtems_pm_image** image) {
+  pm_cache_entry* entry;
+  uint32_t pdi_id;
+  uint64_t hash;
+  bool uncached;
+  if (data == NULL || size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  pdi_id = pm_cache_pdi_id(data, size);
+  hash = rtems_pm_cache_hash(data, size);
+  rtems_mutex_lock(&cache_lock);
+  entry = pm_cache_find_content(pdi_id, hash, size);
+  if (entry != NULL) {
+    *image = pm_cache_hit(entry);
+    rtems_mutex_unlock(&cache_lock);
+    return 0;
+  }
+  rtems_mutex_unlock(&cache_lock);
+  entry = calloc(1, sizeof(*entry));
+  if (entry == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (rtems_pm_image_format_detect(data, size) != RTEMS_PM_IMAGE_FORMAT_RAW) {
+    if (rtems_pm_image_decompress(
+          data, size, RTEMS_PM_IMAGE_LOAD_VERIFY | RTEMS_PM_IMAGE_LOAD_CLEAN,
+          &entry->image) < 0) {
+      int eno = errno;
+      free(entry);
+      errno = eno;
+      return -1;
+    }
+  } else {
+    entry->image.image = pm_image_buffer_alloc(size, &uncached);
+    if (entry->image.image == NULL) {
+      free(entry);
+      errno = ENOMEM;
+      return -1;
+    }
+    memcpy(entry->image.image, data, size);
+    if (!uncached) {
+      const uint64_t start = pm_phase_start();
+      rtems_cache_flush_multiple_data_lines(entry->image.image, size);
+      pm_phase_record(RTEMS_PM_PHASE_CLEAN, start);
+    }
+    entry->image.size = size;
+    entry->image.flags = RTEMS_PM_IMAGE_LOAD_CLEAN;
+    entry->image.clean = true;
+  }
+  entry->pdi_id = pdi_id;
+  entry->hash = hash;
+  entry->hash_size = size;
+  rtems_mutex_lock(&cache_lock);
+  *image = pm_cache_add(entry);
+  rtems_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+void rtems_pm_cache_release(rtems_pm_image* image) {
+  pm_cache_entry* entry = (pm_cache_entry*) image;
+  bool free_entry = false;
+  rtems_mutex_lock(&cache_lock);
+  if (entry->refs > 0) {
+    --entry->refs;
+  }
+  if (entry->refs == 0) {
+    if (entry->cached) {
+      pm_cache_evict();
+    } else {
+      free_entry = true;
+    }
+  }
+  rtems_mutex_unlock(&cache_lock);
+  if (free_entry) {
+    pm_cache_entry_free(entry);
+  }
+}
+
+void rtems_pm_cache_pin(rtems_pm_image* image, bool pin) {
+  pm_cache_entry* entry = (pm_cache_entry*) image;
+  rtems_mutex_lock(&cache_lock);
+  entry->pinned = pin;
+  rtems_mutex_unlock(&cache_lock);
+}
+
+void rtems_pm_cache_flush(void) {
+  size_t limit;
+  rtems_mutex_lock(&cache_lock);
+  limit = cache_stats.limit;
+  cache_stats.limit = 0;
+  pm_cache_evict();
+  cache_stats.limit = limit;
+  rtems_mutex_unlock(&cache_lock);
+}
+
+void rtems_pm_cache_get_stats(rtems_pm_cache_stats* stats) {
+  rtems_mutex_lock(&cache_lock);
+  *stats = cache_stats;
+  rtems_mutex_unlock(&cache_lock);
+}
+
+void rtems_pm_cache_reset_stats(void) {
+  rtems_mutex_lock(&cache_lock);
+  cache_stats.hits = 0;
+  cache_stats.misses = 0;
+  cache_stats.evictions = 0;
+  rtems_mutex_unlock(&cache_lock);
+}
+
+void rtems_pm_cache_iterate(rtems_pm_cache_visitor visitor, void* arg) {
+  pm_cache_entry* entry;
+  rtems_mutex_lock(&cache_lock);
+  TAILQ_FOREACH(entry, &cache_lru, node) {
+    rtems_pm_cache_info info = {
+      .path = entry->path,
+      .pdi_id = entry->pdi_id,
+      .hash = entry->hash,
+      .size = entry->image.size,
+      .refs = entry->refs,
+      .hits = entry->hits,
+      .pinned = entry->pinned
+    };
+    visitor(&info, arg);
+  }
+  rtems_mutex_unlock(&cache_lock);
+}
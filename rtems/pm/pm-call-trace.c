@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Firmware call trace.
+ *
+ * A ring per CPU holds the most recent calls. A writer claims a slot with an
+ * atomic add on the ring's head, clears the slot's sequence number, fills the
+ * record and then publishes the sequence number. A reader copies a record and
+ * only accepts it if the sequence number is the same before and after the
+ * copy. Writers never wait and a task that migrates between the claim and the
+ * publish is safe because the slot is owned by the claim, not the CPU.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/counter.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+
+#ifndef PM_CALL_TRACE_CPUS
+#define PM_CALL_TRACE_CPUS 4
+#endif
+
+/*
+ * Must be a power of 2.
+ */
+#ifndef PM_CALL_TRACE_SIZE
+#define PM_CALL_TRACE_SIZE 256
+#endif
+
+#define PM_CALL_TRACE_MASK (PM_CALL_TRACE_SIZE - 1)
+
+typedef struct {
+  atomic_uint seq;
+  rtems_pm_call_record record;
+} pm_call_slot;
+
+typedef struct {
+  atomic_uint head;
+  atomic_uint first;
+  pm_call_slot slots[PM_CALL_TRACE_SIZE];
+} RTEMS_ALIGNED(64) pm_call_ring;
+
+static pm_call_ring rings[PM_CALL_TRACE_CPUS];
+
+bool pm_call_trace_on = false;
+
+void pm_call_trace_record(
+  uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2, int ret,
+  const struct arm_smccc_res* res, uint32_t entry, uint32_t exit) {
+  uint32_t cpu = rtems_scheduler_get_processor();
+  pm_call_ring* ring = &rings[cpu % PM_CALL_TRACE_CPUS];
+  unsigned int seq =
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed) + 1;
+  pm_call_slot* slot = &ring->slots[(seq - 1) & PM_CALL_TRACE_MASK];
+  rtems_pm_call_record* rec = &slot->record;
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  rec->seq = seq;
+  rec->cpu = cpu;
+  rec->func_id = func_id;
+  rec->ret = ret;
+  rec->args[0] = pm_lower_32(a64_0);
+  rec->args[1] = pm_upper_32(a64_0);
+  rec->args[2] = pm_lower_32(a64_1);
+  rec->args[3] = pm_upper_32(a64_1);
+  rec->args[4] = pm_lower_32(a64_2);
+  rec->res[0] = pm_lower_32(res->a0);
+  rec->res[1] = pm_upper_32(res->a0);
+  rec->res[2] = pm_lower_32(res->a1);
+  rec->res[3] = pm_upper_32(res->a1);
+  rec->entry = entry;
+  rec->exit = exit;
+  atomic_store_explicit(&slot->seq, seq, memory_order_release);
+}
+
+void rtems_pm_call_trace_enable(bool enable) {
+  pm_call_trace_on = enable;
+}
+
+bool rtems_pm_call_trace_enabled(void) {
+  return pm_call_trace_on;
+}
+
+void rtems_pm_call_trace_reset(void) {
+  uint32_t cpu;
+  for (cpu = 0; cpu < PM_CALL_TRACE_CPUS; ++cpu) {
+    pm_call_ring* ring = &rings[cpu];
+    atomic_store_explicit(
+      &ring->first, atomic_load_explicit(&ring->head, memory_order_acquire),
+      memory_order_release);
+  }
+}
+
+size_t rtems_pm_call_trace_iterate(rtems_pm_call_visitor visitor, void* arg) {
+  size_t count = 0;
+  uint32_t cpu;
+  for (cpu = 0; cpu < PM_CALL_TRACE_CPUS; ++cpu) {
+    pm_call_ring* ring = &rings[cpu];
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned int first = atomic_load_explicit(&ring->first, memory_order_acquire);
+    unsigned int seq;
+    if (head - first > PM_CALL_TRACE_SIZE) {
+      first = head - PM_CALL_TRACE_SIZE;
+    }
+    for (seq = first + 1; seq != head + 1; ++seq) {
+      pm_call_slot* slot = &ring->slots[(seq - 1) & PM_CALL_TRACE_MASK];
+      rtems_pm_call_record rec;
+      if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq) {
+        continue;
+      }
+      memcpy(&rec, &slot->record, sizeof(rec));
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+        continue;
+      }
+      visitor(&rec, arg);
+      ++count;
+    }
+  }
+  return count;
+}
+
+uint32_t rtems_pm_call_trace_cpus(void) {
+  return PM_CALL_TRACE_CPUS;
+}
+
+uint32_t rtems_pm_call_trace_size(void) {
+  return PM_CALL_TRACE_SIZE;
+}
@@ -0,0 +1,836 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Clock tree cache.
+ *
+ * The clocks are read from the firmware once with PM_QUERY_DATA and held in
+ * a table indexed by the clock id. A second table of the ids sorted by name
+ * is used to find a clock by name. The topology, parents and attributes
+ * queries are answered from the table. The state, divider, parent and rate
+ * of a clock are cached when first read. A set call invalidates the values
+ * of the clock it changes and all cached rates because the rates of the
+ * clocks it feeds change. The lock is held over the firmware calls so a
+ * read cannot cache a value a set has changed.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+/*
+ * The firmware returns 3 topology nodes or parents for each query and an
+ * extended query, on a backend that has it, returns 15. The topology ends
+ * with a node of type 0 and the parents with a parent of PM_CLOCK_NA_PARENT.
+ */
+#define PM_CLOCK_QUERY_WORDS  3
+#define PM_CLOCK_TOPOLOGY_MAX 6
+#define PM_CLOCK_PARENTS_MAX  16
+#define PM_CLOCK_NA_PARENT    0xffffffff
+#define PM_CLOCK_NODE_TYPE(_n) ((_n) & 0xf)
+#define PM_CLOCK_PARENT_ID(_p) ((_p) & 0xffff)
+#define PM_CLOCK_ATTR_VALID   (1 << 0)
+
+/*
+ * The queries take the clock's index and the clock and PLL calls take the
+ * clock's node id. The attributes hold the node class, subclass and type
+ * of the node id in bits 14 to 31 and the index is bits 0 to 13.
+ */
+#define PM_CLOCK_ATTR_NODE  0xffffc000
+#define PM_CLOCK_NODE_INDEX 0x00003fff
+#define PM_CLOCK_NODE_ID(_attr, _index) \
+  (((_attr) & PM_CLOCK_ATTR_NODE) | ((_index) & PM_CLOCK_NODE_INDEX))
+
+#define PM_CLOCK_NODE_MUX  1
+#define PM_CLOCK_NODE_PLL  2
+#define PM_CLOCK_NODE_DIV1 4
+#define PM_CLOCK_NODE_DIV2 5
+
+/*
+ * The divider limit if the firmware does not report it.
+ */
+#define PM_CLOCK_DIV_MAX 1023
+
+/*
+ * PLL parameters and modes. The output is the reference times the feedback
+ * divider and the fraction over 2^16 in fractional mode. The VCO has to be
+ * in range.
+ */
+#define PM_PLL_PARAM_FBDIV     1
+#define PM_PLL_PARAM_DATA      2
+#define PM_PLL_MODE_INTEGER    0
+#define PM_PLL_MODE_FRACTIONAL 1
+#define PM_PLL_FRAC_BITS       16
+#define PM_PLL_FBDIV_MIN       8
+#define PM_PLL_FBDIV_MAX       255
+#define PM_PLL_VCO_MIN         UINT64_C(2160000000)
+#define PM_PLL_VCO_MAX         UINT64_C(4320000000)
+
+typedef enum {
+  PM_CLOCK_STATE,
+  PM_CLOCK_DIVIDER,
+  PM_CLOCK_PARENT,
+  PM_CLOCK_RATE,
+  PM_CLOCK_VALUES
+} pm_clock_value;
+
+#define PM_CLOCK_SET_VALUES \
+  ((1 << PM_CLOCK_DIVIDER) | (1 << PM_CLOCK_PARENT) | (1 << PM_CLOCK_RATE))
+
+typedef struct {
+  char name[RTEMS_PM_CLOCK_NAME_SIZE];
+  uint32_t attributes;
+  uint32_t node_id;
+  uint32_t topology[PM_CLOCK_TOPOLOGY_MAX];
+  uint32_t parents[PM_CLOCK_PARENTS_MAX];
+  uint8_t num_nodes;
+  uint8_t num_parents;
+  bool partial;
+  uint32_t valid;
+  uint32_t rate_gen;
+  uint64_t values[PM_CLOCK_VALUES];
+} pm_clock;
+
+static rtems_mutex clock_lock = RTEMS_MUTEX_INITIALIZER("PM Clock");
+static pm_clock* clocks;
+static uint32_t* clock_by_name;
+static uint32_t clock_count;
+static uint32_t clock_rate_gen;
+static int clock_tree_error;
+static rtems_pm_clock_stats clock_stats;
+
+/*
+ * Read the words of a paged query from the index. The extended query is
+ * used if the backend has it.
+ */
+static int pm_clock_query_words(
+  uint32_t qid, uint32_t id, uint32_t index, uint32_t* words,
+  uint32_t* count) {
+  pm_ret_ext_payload ext;
+  pm_ret_payload res;
+  int r;
+  r = pm_query_ext(qid, id, index, 0, &ext);
+  if (r == 0) {
+    memcpy(words, ext.words, sizeof(ext.words));
+    *count = PM_QUERY_EXT_WORDS;
+    return 0;
+  }
+  if (errno != ENOTSUP) {
+    return r;
+  }
+  r = pm_query(qid, id, index, 0, &res);
+  if (r < 0) {
+    return r;
+  }
+  words[0] = res.r1;
+  words[1] = res.r2;
+  words[2] = res.r3;
+  *count = PM_CLOCK_QUERY_WORDS;
+  return 0;
+}
+
+static int pm_clock_query_node(uint32_t id, pm_clock* clk) {
+  pm_ret_payload res;
+  uint32_t words[PM_QUERY_EXT_WORDS];
+  uint32_t count;
+  uint32_t index;
+  uint32_t n;
+  int r;
+  r = pm_query(PM_QID_CLOCK_GET_ATTRIBUTES, id, 0, 0, &res);
+  if (r < 0) {
+    return r;
+  }
+  clk->attributes = res.r1;
+  clk->node_id = PM_CLOCK_NODE_ID(clk->attributes, id);
+  if ((clk->attributes & PM_CLOCK_ATTR_VALID) == 0) {
+    return 0;
+  }
+  r = pm_query(PM_QID_CLOCK_GET_NAME, id, 0, 0, &res);
+  if (r < 0) {
+    return r;
+  }
+  memcpy(clk->name, &res, sizeof(clk->name));
+  clk->name[sizeof(clk->name) - 1] = '\0';
+  for (index = 0; index < PM_CLOCK_TOPOLOGY_MAX; index += count) {
+    r = pm_clock_query_words(
+      PM_QID_CLOCK_GET_TOPOLOGY, id, index, words, &count);
+    if (r < 0) {
+      return r;
+    }
+    for (n = 0; n < count && clk->num_nodes < PM_CLOCK_TOPOLOGY_MAX; ++n) {
+      const uint32_t node = words[n];
+      if (PM_CLOCK_NODE_TYPE(node) == 0) {
+        break;
+      }
+      clk->topology[clk->num_nodes++] = node;
+    }
+    if (n < count) {
+      break;
+    }
+  }
+  for (index = 0; ; index += count) {
+    r = pm_clock_query_words(
+      PM_QID_CLOCK_GET_PARENTS, id, index, words, &count);
+    if (r < 0) {
+      return r;
+    }
+    for (n = 0; n < count; ++n) {
+      const uint32_t parent = words[n];
+      if (parent == PM_CLOCK_NA_PARENT) {
+        return 0;
+      }
+      if (clk->num_parents == PM_CLOCK_PARENTS_MAX) {
+        pm_debug("pm: clock: %s: too many parents\n", clk->name);
+        clk->partial = true;
+        return 0;
+      }
+      clk->parents[clk->num_parents++] = parent;
+    }
+  }
+}
+
+/*
+ * Read the tree from the firmware. A failure is kept so a firmware without
+ * the queries is not asked on each call, an invalidate clears it.
+ */
+static int pm_clock_tree_load(void) {
+  pm_ret_payload res;
+  pm_clock* tree;
+  uint32_t* by_name;
+  uint32_t count;
+  uint32_t c;
+  int r;
+  if (clocks != NULL) {
+    return 0;
+  }
+  if (clock_tree_error != 0) {
+    errno = clock_tree_error;
+    return -1;
+  }
+  r = pm_query(PM_QID_CLOCK_GET_NUM_CLOCKS, 0, 0, 0, &res);
+  if (r < 0) {
+    clock_tree_error = errno;
+    return -1;
+  }
+  count = res.r1;
+  if (count == 0) {
+    clock_tree_error = ENODEV;
+    errno = ENODEV;
+    return -1;
+  }
+  tree = calloc(count, sizeof(*tree));
+  by_name = calloc(count, sizeof(*by_name));
+  if (tree == NULL || by_name == NULL) {
+    free(tree);
+    free(by_name);
+    errno = ENOMEM;
+    return -1;
+  }
+  for (c = 0; c < count; ++c) {
+    uint32_t i;
+    r = pm_clock_query_node(c, &tree[c]);
+    if (r < 0) {
+      clock_tree_error = errno;
+      free(tree);
+      free(by_name);
+      errno = clock_tree_error;
+      return -1;
+    }
+    /*
+     * Insertion sort, the tree is read once.
+     */
+    for (i = c; i > 0 && strcmp(tree[by_name[i - 1]].name, tree[c].name) > 0; --i) {
+      by_name[i] = by_name[i - 1];
+    }
+    by_name[i] = c;
+  }
+  clocks = tree;
+  clock_by_name = by_name;
+  clock_count = count;
+  clock_stats.clocks = count;
+  pm_debug("pm: clock: tree: %" PRIu32 " clocks\n", count);
+  return 0;
+}
+
+void pm_clock_tree_reset(void) {
+  rtems_mutex_lock(&clock_lock);
+  free(clocks);
+  free(clock_by_name);
+  clocks = NULL;
+  clock_by_name = NULL;
+  clock_count = 0;
+  clock_tree_error = 0;
+  clock_stats.clocks = 0;
+  rtems_mutex_unlock(&clock_lock);
+}
+
+static pm_clock* pm_clock_find(uint32_t id, bool load) {
+  if (load) {
+    pm_clock_tree_load();
+  }
+  if (clocks == NULL || id >= clock_count) {
+    return NULL;
+  }
+  return &clocks[id];
+}
+
+/*
+ * The node id for a clock call. The index is all there is without a tree.
+ */
+static uint32_t pm_clock_node_id(const pm_clock* clk, uint32_t id) {
+  return clk != NULL ? clk->node_id : id;
+}
+
+static bool pm_clock_cached(const pm_clock* clk, pm_clock_value value) {
+  if ((clk->valid & (1 << value)) == 0) {
+    return false;
+  }
+  return value != PM_CLOCK_RATE || clk->rate_gen == clock_rate_gen;
+}
+
+static void pm_clock_invalidate_values(pm_clock* clk, uint32_t values) {
+  if (clk != NULL) {
+    clk->valid &= ~values;
+  }
+  if ((values & (1 << PM_CLOCK_RATE)) != 0) {
+    ++clock_rate_gen;
+  }
+  ++clock_stats.invalidations;
+}
+
+/*
+ * Get a value from the cache or the firmware with the lock held. The
+ * firmware returns a rate's upper 32 bits in r2.
+ */
+static int pm_clock_get(
+  uint32_t id, pm_api_id api_id, pm_clock_value value, uint64_t* v) {
+  pm_clock* clk = pm_clock_find(id, true);
+  pm_ret_payload res;
+  int r;
+  if (clk != NULL && pm_clock_cached(clk, value)) {
+    ++clock_stats.hits;
+    *v = clk->values[value];
+    return 0;
+  }
+  ++clock_stats.misses;
+  r = pm_clock_call(api_id, pm_clock_node_id(clk, id), 0, 0, &res);
+  if (r == 0) {
+    *v = res.r1;
+    if (value == PM_CLOCK_RATE) {
+      *v |= (uint64_t) res.r2 << 32;
+    }
+    if (clk != NULL) {
+      clk->values[value] = *v;
+      clk->valid |= 1 << value;
+      if (value == PM_CLOCK_RATE) {
+        clk->rate_gen = clock_rate_gen;
+      }
+    }
+  }
+  return r;
+}
+
+static int pm_clock_read(
+  pm_data_control* ctrl, pm_api_id api_id, pm_clock_value value) {
+  uint64_t v;
+  int r;
+  rtems_mutex_lock(&clock_lock);
+  r = pm_clock_get(ctrl->id, api_id, value, &v);
+  rtems_mutex_unlock(&clock_lock);
+  if (r == 0) {
+    ctrl->arg1 = pm_lower_32(v);
+    ctrl->arg2 = pm_upper_32(v);
+  }
+  return r;
+}
+
+static int pm_clock_write(
+  pm_data_control* ctrl, pm_api_id api_id, uint32_t values) {
+  pm_clock* clk;
+  pm_ret_payload res;
+  int r;
+  rtems_mutex_lock(&clock_lock);
+  clk = pm_clock_find(ctrl->id, true);
+  r = pm_clock_call(
+    api_id, pm_clock_node_id(clk, ctrl->id), ctrl->arg1, ctrl->arg2, &res);
+  /*
+   * The firmware may have changed the clock even if the call failed.
+   */
+  pm_clock_invalidate_values(clk, values);
+  rtems_mutex_unlock(&clock_lock);
+  return r;
+}
+
+/*
+ * Answer a clock query from the tree. Returns false if the query is not
+ * for the tree or the clock's parents are not all held.
+ */
+static bool pm_clock_query_cached(pm_data_query* query) {
+  const pm_clock* clk = NULL;
+  uint32_t n;
+  if (query->qid != PM_QID_CLOCK_GET_NUM_CLOCKS) {
+    clk = pm_clock_find(query->arg1, false);
+    if (clk == NULL) {
+      return false;
+    }
+  }
+  memset(query->data, 0, sizeof(query->data));
+  query->data[0] = PM_STATUS_SUCCESS;
+  switch (query->qid) {
+    case PM_QID_CLOCK_GET_NUM_CLOCKS:
+      query->data[1] = clock_count;
+      break;
+    case PM_QID_CLOCK_GET_NAME:
+      memcpy(query->data, clk->name, sizeof(clk->name));
+      break;
+    case PM_QID_CLOCK_GET_ATTRIBUTES:
+      query->data[1] = clk->attributes;
+      break;
+    case PM_QID_CLOCK_GET_TOPOLOGY:
+      for (n = 0; n < PM_CLOCK_QUERY_WORDS; ++n) {
+        const uint32_t node = query->arg2 + n;
+        query->data[n + 1] = node < clk->num_nodes ? clk->topology[node] : 0;
+      }
+      break;
+    case PM_QID_CLOCK_GET_PARENTS:
+      if (clk->partial) {
+        return false;
+      }
+      for (n = 0; n < PM_CLOCK_QUERY_WORDS; ++n) {
+        const uint32_t parent = query->arg2 + n;
+        query->data[n + 1] = parent < clk->num_parents ?
+          clk->parents[parent] : PM_CLOCK_NA_PARENT;
+      }
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+int rtems_pm_query_data(pm_data_query* query) {
+  pm_ret_payload res;
+  int r;
+  switch (query->qid) {
+    case PM_QID_CLOCK_GET_NUM_CLOCKS:
+    case PM_QID_CLOCK_GET_NAME:
+    case PM_QID_CLOCK_GET_ATTRIBUTES:
+    case PM_QID_CLOCK_GET_TOPOLOGY:
+    case PM_QID_CLOCK_GET_PARENTS:
+      rtems_mutex_lock(&clock_lock);
+      if (pm_clock_tree_load() == 0 && pm_clock_query_cached(query)) {
+        ++clock_stats.hits;
+        rtems_mutex_unlock(&clock_lock);
+        return 0;
+      }
+      ++clock_stats.misses;
+      rtems_mutex_unlock(&clock_lock);
+      break;
+    default:
+      break;
+  }
+  r = pm_query(query->qid, query->arg1, query->arg2, query->arg3, &res);
+  query->data[0] = res.r0;
+  query->data[1] = res.r1;
+  query->data[2] = res.r2;
+  query->data[3] = res.r3;
+  return r;
+}
+
+int rtems_pm_clock_control(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_write(
+      ctrl, ctrl->arg1 != 0 ? PM_CLOCK_ENABLE : PM_CLOCK_DISABLE,
+      1 << PM_CLOCK_STATE);
+  }
+  return pm_clock_read(ctrl, PM_CLOCK_GETSTATE, PM_CLOCK_STATE);
+}
+
+int rtems_pm_clock_div_control(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_write(ctrl, PM_CLOCK_SETDIVIDER, PM_CLOCK_SET_VALUES);
+  }
+  return pm_clock_read(ctrl, PM_CLOCK_GETDIVIDER, PM_CLOCK_DIVIDER);
+}
+
+int rtems_pm_clock_rate_control(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_write(ctrl, PM_CLOCK_SETRATE, PM_CLOCK_SET_VALUES);
+  }
+  return pm_clock_read(ctrl, PM_CLOCK_GETRATE, PM_CLOCK_RATE);
+}
+
+int rtems_pm_clock_parent_control(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_write(ctrl, PM_CLOCK_SETPARENT, PM_CLOCK_SET_VALUES);
+  }
+  return pm_clock_read(ctrl, PM_CLOCK_GETPARENT, PM_CLOCK_PARENT);
+}
+
+/*
+ * The PLL controls use the PLL calls the clock scaling uses and are not
+ * cached. A set changes the rates of the clocks the PLL feeds.
+ */
+static int pm_clock_pll(
+  pm_data_control* ctrl, pm_api_id api_id, uint32_t arg1, uint32_t arg2) {
+  pm_clock* clk;
+  pm_ret_payload res;
+  int r;
+  rtems_mutex_lock(&clock_lock);
+  clk = pm_clock_find(ctrl->id, true);
+  r = pm_clock_call(
+    api_id, pm_clock_node_id(clk, ctrl->id), arg1, arg2, &res);
+  if (ctrl->write_not_read) {
+    pm_clock_invalidate_values(clk, 1 << PM_CLOCK_RATE);
+  }
+  rtems_mutex_unlock(&clock_lock);
+  if (r == 0 && !ctrl->write_not_read) {
+    ctrl->arg1 = res.r1;
+    ctrl->arg2 = 0;
+  }
+  return r;
+}
+
+int rtems_pm_pll_mode(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_pll(ctrl, PM_PLL_SET_MODE, ctrl->arg1, 0);
+  }
+  return pm_clock_pll(ctrl, PM_PLL_GET_MODE, 0, 0);
+}
+
+int rtems_pm_pll_fraction_data(pm_data_control* ctrl) {
+  if (ctrl->write_not_read) {
+    return pm_clock_pll(
+      ctrl, PM_PLL_SET_PARAMETER, PM_PLL_PARAM_DATA, ctrl->arg1);
+  }
+  return pm_clock_pll(ctrl, PM_PLL_GET_PARAMETER, PM_PLL_PARAM_DATA, 0);
+}
+
+static bool pm_clock_has_node(const pm_clock* clk, uint32_t type) {
+  uint32_t n;
+  for (n = 0; n < clk->num_nodes; ++n) {
+    if (PM_CLOCK_NODE_TYPE(clk->topology[n]) == type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t pm_clock_rate_error(uint64_t rate, uint64_t achieved) {
+  return achieved > rate ? achieved - rate : rate - achieved;
+}
+
+/*
+ * A configuration is better if it is closer to the rate, then if it leaves
+ * the PLL alone, then if the PLL is in integer mode and last if it keeps
+ * the current parent.
+ */
+static bool pm_clock_scale_better(
+  const rtems_pm_clock_config* config, const rtems_pm_clock_config* best,
+  uint32_t current) {
+  const uint64_t error = pm_clock_rate_error(config->requested, config->rate);
+  const uint64_t best_error = pm_clock_rate_error(best->requested, best->rate);
+  if (best->divider == 0 || error != best_error) {
+    return best->divider == 0 || error < best_error;
+  }
+  if ((config->pll == RTEMS_PM_CLOCK_NONE) != (best->pll == RTEMS_PM_CLOCK_NONE)) {
+    return config->pll == RTEMS_PM_CLOCK_NONE;
+  }
+  if (config->pll_frac != best->pll_frac) {
+    return config->pll_frac == 0;
+  }
+  return config->parent == current && best->parent != current;
+}
+
+/*
+ * Search the PLL settings for a parent PLL. The smallest divider with the
+ * VCO in range is the lowest VCO and power for an exact rate.
+ */
+static void pm_clock_scale_pll(
+  uint32_t pll_id, const pm_clock* pll, uint32_t max_div, uint32_t current,
+  rtems_pm_clock_config* config, rtems_pm_clock_config* best) {
+  uint64_t ref;
+  uint32_t d;
+  if (pll->num_parents == 0 ||
+      pm_clock_get(
+        PM_CLOCK_PARENT_ID(pll->parents[0]), PM_CLOCK_GETRATE, PM_CLOCK_RATE,
+        &ref) < 0 || ref == 0) {
+    return;
+  }
+  for (d = 1; d <= max_div; ++d) {
+    const uint64_t vco = config->requested * d;
+    uint64_t fbdiv;
+    uint64_t frac;
+    if (vco < PM_PLL_VCO_MIN) {
+      continue;
+    }
+    if (vco > PM_PLL_VCO_MAX) {
+      break;
+    }
+    fbdiv = vco / ref;
+    frac = (((vco % ref) << PM_PLL_FRAC_BITS) + ref / 2) / ref;
+    if (frac == (1 << PM_PLL_FRAC_BITS)) {
+      ++fbdiv;
+      frac = 0;
+    }
+    if (fbdiv < PM_PLL_FBDIV_MIN || fbdiv > PM_PLL_FBDIV_MAX) {
+      continue;
+    }
+    config->divider = d;
+    config->pll = pll_id;
+    config->pll_mode =
+      frac == 0 ? PM_PLL_MODE_INTEGER : PM_PLL_MODE_FRACTIONAL;
+    config->pll_fbdiv = fbdiv;
+    config->pll_frac = frac;
+    config->rate =
+      ((ref * fbdiv) + ((ref * frac) >> PM_PLL_FRAC_BITS)) / d;
+    if (pm_clock_scale_better(config, best, current)) {
+      *best = *config;
+    }
+    if (config->rate == config->requested && frac == 0) {
+      break;
+    }
+  }
+}
+
+static int pm_clock_scale_plan(
+  const pm_clock* clk, uint32_t flags, uint32_t current,
+  rtems_pm_clock_config* best) {
+  pm_ret_payload res;
+  uint32_t max_div = PM_CLOCK_DIV_MAX;
+  uint32_t p;
+  if (pm_query(
+        PM_QID_CLOCK_GET_MAX_DIVISOR, clk->node_id, PM_CLOCK_NODE_DIV1, 0,
+        &res) == 0 && res.r1 != 0) {
+    max_div = res.r1;
+  }
+  for (p = 0; p < clk->num_parents; ++p) {
+    const uint32_t parent_id = PM_CLOCK_PARENT_ID(clk->parents[p]);
+    const pm_clock* parent = pm_clock_find(parent_id, false);
+    rtems_pm_clock_config config = *best;
+    uint64_t rate;
+    uint64_t d;
+    if (p != current && !pm_clock_has_node(clk, PM_CLOCK_NODE_MUX)) {
+      continue;
+    }
+    if (pm_clock_get(parent_id, PM_CLOCK_GETRATE, PM_CLOCK_RATE, &rate) < 0) {
+      continue;
+    }
+    d = (rate + config.requested / 2) / config.requested;
+    if (d == 0) {
+      d = 1;
+    } else if (d > max_div) {
+      d = max_div;
+    }
+    config.parent = p;
+    config.divider = d;
+    config.rate = rate / d;
+    config.pll = RTEMS_PM_CLOCK_NONE;
+    config.pll_mode = config.pll_fbdiv = config.pll_frac = 0;
+    if (pm_clock_scale_better(&config, best, current)) {
+      *best = config;
+    }
+    if ((flags & RTEMS_PM_CLOCK_SCALE_PLL) != 0 && parent != NULL &&
+        pm_clock_has_node(parent, PM_CLOCK_NODE_PLL)) {
+      pm_clock_scale_pll(parent_id, parent, max_div, current, &config, best);
+    }
+  }
+  if (best->divider == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+static int pm_clock_scale_apply(
+  pm_clock* clk, uint32_t current, const rtems_pm_clock_config* config) {
+  pm_ret_payload res;
+  int r = 0;
+  if (config->pll != RTEMS_PM_CLOCK_NONE) {
+    pm_clock* pll = pm_clock_find(config->pll, false);
+    const uint32_t pll_id = pm_clock_node_id(pll, config->pll);
+    r = pm_clock_call(PM_PLL_SET_MODE, pll_id, config->pll_mode, 0, &res);
+    if (r == 0) {
+      r = pm_clock_call(
+        PM_PLL_SET_PARAMETER, pll_id, PM_PLL_PARAM_FBDIV, config->pll_fbdiv,
+        &res);
+    }
+    if (r == 0 && config->pll_mode == PM_PLL_MODE_FRACTIONAL) {
+      r = pm_clock_call(
+        PM_PLL_SET_PARAMETER, pll_id, PM_PLL_PARAM_DATA, config->pll_frac,
+        &res);
+    }
+    pm_clock_invalidate_values(pll, PM_CLOCK_SET_VALUES);
+  }
+  if (r == 0 && config->parent != current) {
+    r = pm_clock_call(
+      PM_CLOCK_SETPARENT, clk->node_id, config->parent, 0, &res);
+  }
+  if (r == 0) {
+    r = pm_clock_call(
+      PM_CLOCK_SETDIVIDER, clk->node_id, config->divider, 0, &res);
+  }
+  pm_clock_invalidate_values(clk, PM_CLOCK_SET_VALUES);
+  return r;
+}
+
+int rtems_pm_clock_scale(
+  uint32_t id, uint64_t rate, uint32_t flags, rtems_pm_clock_config* config) {
+  pm_clock* clk;
+  pm_ret_payload res;
+  uint64_t current = 0;
+  int r;
+  if (rate == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(config, 0, sizeof(*config));
+  config->requested = rate;
+  config->pll = RTEMS_PM_CLOCK_NONE;
+  rtems_mutex_lock(&clock_lock);
+  clk = pm_clock_find(id, true);
+  if (clk == NULL) {
+    const int error = clocks == NULL ? errno : EINVAL;
+    rtems_mutex_unlock(&clock_lock);
+    errno = error;
+    return -1;
+  }
+  if (!pm_clock_has_node(clk, PM_CLOCK_NODE_DIV1) &&
+      !pm_clock_has_node(clk, PM_CLOCK_NODE_DIV2)) {
+    /*
+     * No divider, the firmware sets the rate.
+     */
+    r = 0;
+    if ((flags & RTEMS_PM_CLOCK_SCALE_PLAN) == 0) {
+      r = pm_clock_call(
+        PM_CLOCK_SETRATE, clk->node_id, pm_lower_32(rate), pm_upper_32(rate),
+        &res);
+      pm_clock_invalidate_values(clk, PM_CLOCK_SET_VALUES);
+    }
+  } else {
+    if (clk->num_parents > 0) {
+      r = pm_clock_get(id, PM_CLOCK_GETPARENT, PM_CLOCK_PARENT, &current);
+    } else {
+      r = 0;
+    }
+    if (r == 0) {
+      r = pm_clock_scale_plan(clk, flags, current, config);
+    }
+    if (r == 0 && (flags & RTEMS_PM_CLOCK_SCALE_PLAN) == 0) {
+      r = pm_clock_scale_apply(clk, current, config);
+    }
+  }
+  if (r == 0 && (flags & RTEMS_PM_CLOCK_SCALE_PLAN) == 0) {
+    r = pm_clock_get(id, PM_CLOCK_GETRATE, PM_CLOCK_RATE, &config->rate);
+  }
+  rtems_mutex_unlock(&clock_lock);
+  return r;
+}
+
+int rtems_pm_clock_lookup(const char* name, uint32_t* id) {
+  uint32_t low = 0;
+  uint32_t high;
+  rtems_mutex_lock(&clock_lock);
+  if (pm_clock_tree_load() < 0) {
+    rtems_mutex_unlock(&clock_lock);
+    return -1;
+  }
+  high = clock_count;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const uint32_t c = clock_by_name[mid];
+    const int cmp = strcmp(clocks[c].name, name);
+    if (cmp == 0 && clocks[c].name[0] != '\0') {
+      *id = c;
+      rtems_mutex_unlock(&clock_lock);
+      return 0;
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  rtems_mutex_unlock(&clock_lock);
+  errno = ENOENT;
+  return -1;
+}
+
+int rtems_pm_clock_info_get(uint32_t id, rtems_pm_clock_info* info) {
+  const pm_clock* clk;
+  rtems_mutex_lock(&clock_lock);
+  clk = pm_clock_find(id, true);
+  if (clk == NULL) {
+    const int error = clocks == NULL ? errno : EINVAL;
+    rtems_mutex_unlock(&clock_lock);
+    errno = error;
+    return -1;
+  }
+  info->id = id;
+  memcpy(info->name, clk->name, sizeof(info->name));
+  info->attributes = clk->attributes;
+  info->nodes = clk->num_nodes;
+  info->parents = clk->num_parents;
+  rtems_mutex_unlock(&clock_lock);
+  return 0;
+}
+
+/*
+ * The tree is kept, it does not change.
+ */
+void rtems_pm_clock_invalidate(void) {
+  uint32_t c;
+  rtems_mutex_lock(&clock_lock);
+  for (c = 0; c < clock_count; ++c) {
+    clocks[c].valid = 0;
+  }
+  clock_tree_error = 0;
+  ++clock_stats.invalidations;
+  rtems_mutex_unlock(&clock_lock);
+}
+
+void rtems_pm_clock_get_stats(rtems_pm_clock_stats* stats) {
+  rtems_mutex_lock(&clock_lock);
+  *stats = clock_stats;
+  rtems_mutex_unlock(&clock_lock);
+}
+
+void rtems_pm_clock_reset_stats(void) {
+  rtems_mutex_lock(&clock_lock);
+  clock_stats.hits = 0;
+  clock_stats.misses = 0;
+  clock_stats.invalidations = 0;
+  rtems_mutex_unlock(&clock_lock);
+}
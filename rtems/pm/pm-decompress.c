@@ -0,0 +1,587 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Compressed image decoding.
+ *
+ * Images are mostly padding and repeated configuration frames so they
+ * compress well and a compressed file means less data to read over a
+ * network file system. The decoder reads the compressed stream in large
+ * reads and writes the image straight into the image buffer. There is no
+ * window or second copy as the whole image buffer is the history.
+ *
+ * LZ4 frames are decoded here. The header, block and content checksums are
+ * checked when the frame has them. Gzip uses the zlib in RTEMS.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+/*
+ * The compressed stream is read in blocks of this size.
+ */
+#define PM_DECODE_READ_SIZE (256 * 1024)
+
+/*
+ * The gzip output is passed on in parts of this size so the first part can
+ * be checked before all of the file is read.
+ */
+#define PM_DECODE_OUTPUT_SIZE (64 * 1024)
+
+#define LZ4_MAGIC          0x184D2204U
+#define LZ4_FLG_VERSION    0xc0
+#define LZ4_FLG_VERSION_01 0x40
+#define LZ4_FLG_BLOCK_CSUM (1 << 4)
+#define LZ4_FLG_SIZE       (1 << 3)
+#define LZ4_FLG_CSUM       (1 << 2)
+#define LZ4_FLG_RESERVED   (1 << 1)
+#define LZ4_FLG_DICT_ID    (1 << 0)
+#define LZ4_BD_MAX_SIZE(_bd) (((_bd) >> 4) & 7)
+#define LZ4_BLOCK_RAW      (1U << 31)
+#define LZ4_MIN_MATCH      4
+#define LZ4_HEADER_MIN     7
+#define LZ4_HEADER_MAX     19
+
+#define ZSTD_MAGIC 0xFD2FB528U
+
+typedef struct {
+  pm_image_decoder* decoder;
+  uint8_t* buffer;
+  size_t pos;
+  size_t len;
+} pm_decode_input;
+
+static uint32_t pm_decode_le32(const uint8_t* p) {
+  return
+    ((uint32_t) p[0]) | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t pm_decode_le64(const uint8_t* p) {
+  return ((uint64_t) pm_decode_le32(p + 4) << 32) | pm_decode_le32(p);
+}
+
+rtems_pm_image_format rtems_pm_image_format_detect(
+  const void* data, size_t size) {
+  const uint8_t* p = data;
+  if (size >= 4) {
+    const uint32_t magic = pm_decode_le32(p);
+    if (magic == LZ4_MAGIC) {
+      return RTEMS_PM_IMAGE_FORMAT_LZ4;
+    }
+    if (magic == ZSTD_MAGIC) {
+      return RTEMS_PM_IMAGE_FORMAT_ZSTD;
+    }
+  }
+  if (size >= 3 && p[0] == 0x1f && p[1] == 0x8b && p[2] == Z_DEFLATED) {
+    return RTEMS_PM_IMAGE_FORMAT_GZIP;
+  }
+  return RTEMS_PM_IMAGE_FORMAT_RAW;
+}
+
+const char* rtems_pm_image_format_name(rtems_pm_image_format format) {
+  switch (format) {
+  case RTEMS_PM_IMAGE_FORMAT_RAW:
+    return "raw";
+  case RTEMS_PM_IMAGE_FORMAT_LZ4:
+    return "lz4";
+  case RTEMS_PM_IMAGE_FORMAT_GZIP:
+    return "gzip";
+  case RTEMS_PM_IMAGE_FORMAT_ZSTD:
+    return "zstd";
+  default:
+    break;
+  }
+  return "invalid";
+}
+
+/*
+ * XXH32 as used by the LZ4 frame format.
+ */
+#define XXH_PRIME32_1 2654435761U
+#define XXH_PRIME32_2 2246822519U
+#define XXH_PRIME32_3 3266489917U
+#define XXH_PRIME32_4 668265263U
+#define XXH_PRIME32_5 374761393U
+
+static uint32_t pm_xxh32_rotl(uint32_t x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t pm_xxh32_round(uint32_t acc, uint32_t input) {
+  acc += input * XXH_PRIME32_2;
+  acc = pm_xxh32_rotl(acc, 13);
+  return acc * XXH_PRIME32_1;
+}
+
+static uint32_t pm_xxh32(const void* data, size_t size, uint32_t seed) {
+  const uint8_t* p = data;
+  const uint8_t* end = p + size;
+  uint32_t h;
+  if (size >= 16) {
+    const uint8_t* limit = end - 16;
+    uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+    uint32_t v2 = seed + XXH_PRIME32_2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - XXH_PRIME32_1;
+    do {
+      v1 = pm_xxh32_round(v1, pm_decode_le32(p));
+      v2 = pm_xxh32_round(v2, pm_decode_le32(p + 4));
+      v3 = pm_xxh32_round(v3, pm_decode_le32(p + 8));
+      v4 = pm_xxh32_round(v4, pm_decode_le32(p + 12));
+      p += 16;
+    } while (p <= limit);
+    h = pm_xxh32_rotl(v1, 1) + pm_xxh32_rotl(v2, 7) +
+      pm_xxh32_rotl(v3, 12) + pm_xxh32_rotl(v4, 18);
+  } else {
+    h = seed + XXH_PRIME32_5;
+  }
+  h += (uint32_t) size;
+  while (p + 4 <= end) {
+    h += pm_decode_le32(p) * XXH_PRIME32_3;
+    h = pm_xxh32_rotl(h, 17) * XXH_PRIME32_4;
+    p += 4;
+  }
+  while (p < end) {
+    h += (*p) * XXH_PRIME32_5;
+    h = pm_xxh32_rotl(h, 11) * XXH_PRIME32_1;
+    ++p;
+  }
+  h ^= h >> 15;
+  h *= XXH_PRIME32_2;
+  h ^= h >> 13;
+  h *= XXH_PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+static ssize_t pm_decode_fill(pm_decode_input* in) {
+  pm_image_decoder* decoder = in->decoder;
+  ssize_t r;
+  in->pos = 0;
+  in->len = 0;
+  r = decoder->read(decoder->arg, in->buffer, PM_DECODE_READ_SIZE);
+  if (r > 0) {
+    in->len = r;
+  }
+  return r;
+}
+
+static int pm_decode_get(pm_decode_input* in, void* buffer, size_t size) {
+  uint8_t* out = buffer;
+  while (size > 0) {
+    size_t n;
+    if (in->pos == in->len) {
+      ssize_t r = pm_decode_fill(in);
+      if (r <= 0) {
+        if (r == 0) {
+          pm_debug("decode: truncated\n");
+          errno = EIO;
+        }
+        return -1;
+      }
+    }
+    n = in->len - in->pos;
+    if (n > size) {
+      n = size;
+    }
+    memcpy(out, in->buffer + in->pos, n);
+    in->pos += n;
+    out += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int pm_decode_corrupt(const char* what) {
+  pm_debug("decode: lz4: %s\n", what);
+  errno = EIO;
+  return -1;
+}
+
+static size_t pm_lz4_length(const uint8_t** in, const uint8_t* end, bool* ok) {
+  const uint8_t* p = *in;
+  size_t length = 0;
+  uint8_t b;
+  do {
+    if (p >= end) {
+      *ok = false;
+      return 0;
+    }
+    b = *p++;
+    length += b;
+  } while (b == 255);
+  *in = p;
+  return length;
+}
+
+/*
+ * Decode a block into the image buffer at the offset. A match can reach
+ * back into the blocks before so linked blocks decode without a window.
+ */
+static int pm_lz4_block(
+  const uint8_t* in, size_t in_size, uint8_t* base, size_t* offset,
+  size_t out_size) {
+  const uint8_t* ip = in;
+  const uint8_t* const iend = in + in_size;
+  uint8_t* op = base + *offset;
+  uint8_t* const oend = base + out_size;
+  bool ok = true;
+  while (true) {
+    const uint8_t* match;
+    size_t length;
+    size_t distance;
+    uint32_t token;
+    if (ip >= iend) {
+      return pm_decode_corrupt("block ends without literals");
+    }
+    token = *ip++;
+    length = token >> 4;
+    if (length == 15) {
+      length += pm_lz4_length(&ip, iend, &ok);
+    }
+    if (!ok || length > (size_t) (iend - ip) || length > (size_t) (oend - op)) {
+      return pm_decode_corrupt("literals overrun");
+    }
+    memcpy(op, ip, length);
+    op += length;
+    ip += length;
+    /*
+     * The last sequence is only literals.
+     */
+    if (ip == iend) {
+      break;
+    }
+    if (iend - ip < 2) {
+      return pm_decode_corrupt("truncated offset");
+    }
+    distance = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (distance == 0 || distance > (size_t) (op - base)) {
+      return pm_decode_corrupt("invalid offset");
+    }
+    length = token & 15;
+    if (length == 15) {
+      length += pm_lz4_length(&ip, iend, &ok);
+    }
+    length += LZ4_MIN_MATCH;
+    if (!ok || length > (size_t) (oend - op)) {
+      return pm_decode_corrupt("match overrun");
+    }
+    match = op - distance;
+    /*
+     * An overlapping match repeats the bytes at the distance. Copy the
+     * repeat doubling each time so runs of padding are fast.
+     */
+    while (length > 0) {
+      size_t n = op - match;
+      if (n > length) {
+        n = length;
+      }
+      memcpy(op, match, n);
+      op += n;
+      length -= n;
+    }
+  }
+  *offset = op - base;
+  return 0;
+}
+
+static int pm_lz4_header(
+  const uint8_t* head, size_t size, size_t* header_size, size_t* block_max,
+  uint64_t* content_size) {
+  uint8_t flg;
+  uint8_t bd;
+  size_t hs = LZ4_HEADER_MIN;
+  if (size < LZ4_HEADER_MIN || pm_decode_le32(head) != LZ4_MAGIC) {
+    return pm_decode_corrupt("invalid frame");
+  }
+  flg = head[4];
+  bd = head[5];
+  if ((flg & LZ4_FLG_VERSION) != LZ4_FLG_VERSION_01 ||
+      (flg & LZ4_FLG_RESERVED) != 0 || LZ4_BD_MAX_SIZE(bd) < 4 ||
+      (bd & 0x8f) != 0) {
+    return pm_decode_corrupt("invalid frame descriptor");
+  }
+  if ((flg & LZ4_FLG_DICT_ID) != 0) {
+    pm_debug("decode: lz4: dictionaries not supported\n");
+    errno = ENOTSUP;
+    return -1;
+  }
+  if ((flg & LZ4_FLG_SIZE) != 0) {
+    hs += 8;
+  }
+  if (size < hs) {
+    return pm_decode_corrupt("truncated frame descriptor");
+  }
+  if (head[hs - 1] != ((pm_xxh32(head + 4, hs - 5, 0) >> 8) & 0xff)) {
+    return pm_decode_corrupt("frame descriptor checksum");
+  }
+  *header_size = hs;
+  *block_max = (size_t) 1 << (8 + 2 * LZ4_BD_MAX_SIZE(bd));
+  *content_size = (flg & LZ4_FLG_SIZE) != 0 ? pm_decode_le64(head + 6) : 0;
+  return 0;
+}
+
+static int pm_lz4_decode(pm_image_decoder* decoder, pm_decode_input* in) {
+  uint8_t header[LZ4_HEADER_MAX];
+  uint8_t* block;
+  size_t header_size;
+  size_t block_max;
+  uint64_t content_size;
+  size_t offset = 0;
+  uint8_t flg;
+  int r;
+  /*
+   * Read the fixed part then the rest once its size is known.
+   */
+  r = pm_decode_get(in, header, LZ4_HEADER_MIN);
+  if (r < 0) {
+    return -1;
+  }
+  flg = header[4];
+  header_size = LZ4_HEADER_MIN + ((flg & LZ4_FLG_SIZE) != 0 ? 8 : 0);
+  r = pm_decode_get(in, header + LZ4_HEADER_MIN, header_size - LZ4_HEADER_MIN);
+  if (r < 0) {
+    return -1;
+  }
+  r = pm_lz4_header(header, header_size, &header_size, &block_max, &content_size);
+  if (r < 0) {
+    return -1;
+  }
+  if (content_size != 0 && content_size != decoder->out_size) {
+    return pm_decode_corrupt("content size does not match");
+  }
+  block = malloc(block_max);
+  if (block == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  while (true) {
+    uint8_t word[4];
+    uint32_t block_size;
+    bool raw;
+    r = pm_decode_get(in, word, sizeof(word));
+    if (r < 0) {
+      break;
+    }
+    block_size = pm_decode_le32(word);
+    if (block_size == 0) {
+      break;
+    }
+    raw = (block_size & LZ4_BLOCK_RAW) != 0;
+    block_size &= ~LZ4_BLOCK_RAW;
+    if (block_size > block_max) {
+      r = pm_decode_corrupt("block too big");
+      break;
+    }
+    r = pm_decode_get(in, block, block_size);
+    if (r < 0) {
+      break;
+    }
+    if ((flg & LZ4_FLG_BLOCK_CSUM) != 0) {
+      r = pm_decode_get(in, word, sizeof(word));
+      if (r < 0) {
+        break;
+      }
+      if (pm_decode_le32(word) != pm_xxh32(block, block_size, 0)) {
+        r = pm_decode_corrupt("block checksum");
+        break;
+      }
+    }
+    if (raw) {
+      if (block_size > decoder->out_size - offset) {
+        r = pm_decode_corrupt("raw block overrun");
+        break;
+      }
+      memcpy(decoder->out + offset, block, block_size);
+      r = decoder->output(decoder->arg, offset, block_size);
+      offset += block_size;
+    } else {
+      const size_t start = offset;
+      r = pm_lz4_block(
+        block, block_size, decoder->out, &offset, decoder->out_size);
+      if (r == 0) {
+        r = decoder->output(decoder->arg, start, offset - start);
+      }
+    }
+    if (r < 0) {
+      break;
+    }
+  }
+  free(block);
+  if (r < 0) {
+    return -1;
+  }
+  if (offset != decoder->out_size) {
+    return pm_decode_corrupt("short content");
+  }
+  if ((flg & LZ4_FLG_CSUM) != 0) {
+    uint8_t word[4];
+    r = pm_decode_get(in, word, sizeof(word));
+    if (r < 0) {
+      return -1;
+    }
+    if (pm_decode_le32(word) != pm_xxh32(decoder->out, decoder->out_size, 0)) {
+      return pm_decode_corrupt("content checksum");
+    }
+  }
+  return 0;
+}
+
+static int pm_gzip_decode(pm_image_decoder* decoder, pm_decode_input* in) {
+  z_stream zs;
+  size_t offset = 0;
+  int zr;
+  int r = 0;
+  memset(&zs, 0, sizeof(zs));
+  /*
+   * A window size of 15 plus 16 accepts only a gzip wrapper.
+   */
+  zr = inflateInit2(&zs, 15 + 16);
+  if (zr != Z_OK) {
+    errno = zr == Z_MEM_ERROR ? ENOMEM : EIO;
+    return -1;
+  }
+  zs.next_out = decoder->out;
+  while (true) {
+    size_t out_size = decoder->out_size - offset;
+    size_t produced;
+    if (zs.avail_in == 0) {
+      ssize_t rr = pm_decode_fill(in);
+      if (rr <= 0) {
+        if (rr == 0) {
+          pm_debug("decode: gzip: truncated\n");
+          errno = EIO;
+        }
+        r = -1;
+        break;
+      }
+      zs.next_in = in->buffer;
+      zs.avail_in = in->len;
+    }
+    if (out_size > PM_DECODE_OUTPUT_SIZE) {
+      out_size = PM_DECODE_OUTPUT_SIZE;
+    }
+    zs.avail_out = out_size;
+    zr = inflate(&zs, Z_NO_FLUSH);
+    produced = out_size - zs.avail_out;
+    if (zr != Z_OK && zr != Z_STREAM_END &&
+        (zr != Z_BUF_ERROR || zs.avail_in != 0)) {
+      pm_debug("decode: gzip: %s\n", zs.msg != NULL ? zs.msg : "error");
+      errno = zr == Z_MEM_ERROR ? ENOMEM : EIO;
+      r = -1;
+      break;
+    }
+    if (produced != 0) {
+      r = decoder->output(decoder->arg, offset, produced);
+      if (r < 0) {
+        break;
+      }
+      offset += produced;
+    }
+    if (zr == Z_STREAM_END) {
+      break;
+    }
+  }
+  inflateEnd(&zs);
+  if (r == 0 && offset != decoder->out_size) {
+    pm_debug("decode: gzip: size does not match the trailer\n");
+    errno = EIO;
+    r = -1;
+  }
+  return r;
+}
+
+int pm_image_decompressed_size(
+  rtems_pm_image_format format, const void* head, size_t head_size,
+  const void* tail, size_t* size) {
+  size_t header_size;
+  size_t block_max;
+  uint64_t content_size;
+  switch (format) {
+  case RTEMS_PM_IMAGE_FORMAT_LZ4:
+    if (pm_lz4_header(
+          head, head_size, &header_size, &block_max, &content_size) < 0) {
+      return -1;
+    }
+    if (content_size == 0 || content_size > SIZE_MAX) {
+      pm_debug("decode: lz4: no content size in the frame\n");
+      errno = ENOTSUP;
+      return -1;
+    }
+    *size = content_size;
+    break;
+  case RTEMS_PM_IMAGE_FORMAT_GZIP:
+    /*
+     * The trailer holds the size modulo 2^32 which is fine for images.
+     */
+    *size = pm_decode_le32(tail);
+    if (*size == 0) {
+      errno = EIO;
+      return -1;
+    }
+    break;
+  default:
+    errno = ENOTSUP;
+    return -1;
+  }
+  return 0;
+}
+
+int pm_image_decode(pm_image_decoder* decoder) {
+  pm_decode_input in = {
+    .decoder = decoder
+  };
+  int r;
+  if (decoder->format != RTEMS_PM_IMAGE_FORMAT_LZ4 &&
+      decoder->format != RTEMS_PM_IMAGE_FORMAT_GZIP) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  in.buffer = malloc(PM_DECODE_READ_SIZE);
+  if (in.buffer == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (decoder->format == RTEMS_PM_IMAGE_FORMAT_LZ4) {
+    r = pm_lz4_decode(decoder, &in);
+  } else {
+    r = pm_gzip_decode(decoder, &in);
+  }
+  free(in.buffer);
+  return r;
+}
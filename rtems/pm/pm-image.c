@@ -25,17 +25,37 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <rtems.h>
+
 #include <rtems/pm/pm.h>
 #include <rtems/pm/pm-image.h>
 
+#include "pm-private.h"
 #include "pm-trace.h"
 
 #include "xilpdi.h"
 
+/*
+ * The header checksums use NEON on AArch64. Define PM_CHECKSUM_NEON to 0 to
+ * use the scalar loop.
+ */
+#ifndef PM_CHECKSUM_NEON
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PM_CHECKSUM_NEON 1
+#else
+#define PM_CHECKSUM_NEON 0
+#endif
+#endif /* PM_CHECKSUM_NEON */
+
+#if PM_CHECKSUM_NEON
+#include <arm_neon.h>
+#endif
+
 #define PFI_BOOT_HEADER (0x3f0 - sizeof(uint32_t))
 
 static const char* error_labels[] = {
@@ -44,6 +64,10 @@ static const char* error_labels[] = {
   "invalid header length",
   "invalid header checksum",
   "invalid header",
+  "invalid header identification",
+  "header offset outside image",
+  "invalid image or partition count",
+  "invalid partition",
 };
 
 static const uint8_t boot_header_X8[] = {
@@ -68,13 +92,64 @@ const char* rtems_pm_image_error_text(rtems_pm_image_status status) {
   return "invalid error code";
 }
 
-uint32_t rtems_pm_checksum(const uint32_t* words, size_t size) {
+uint32_t pm_checksum_sum_scalar(const uint32_t* words, size_t size) {
   uint32_t checksum = 0;
   size_t count;
   for (count = 0; count < size; ++count) {
     checksum += words[count];
   }
-  return checksum ^ 0xffffffffU;
+  return checksum;
+}
+
+#if PM_CHECKSUM_NEON
+/*
+ * The checksum is a modulo 2^32 sum so the words can be summed in any
+ * order. Four vector accumulators hide the add latency and the lanes are
+ * folded at the end. The loads do not need to be aligned.
+ */
+static uint32_t pm_checksum_sum_neon(const uint32_t* words, size_t size) {
+  uint32x4_t acc0 = vdupq_n_u32(0);
+  uint32x4_t acc1 = vdupq_n_u32(0);
+  uint32x4_t acc2 = vdupq_n_u32(0);
+  uint32x4_t acc3 = vdupq_n_u32(0);
+  uint32_t checksum;
+  size_t count = 0;
+  for (; count + 16 <= size; count += 16) {
+    acc0 = vaddq_u32(acc0, vld1q_u32(&words[count]));
+    acc1 = vaddq_u32(acc1, vld1q_u32(&words[count + 4]));
+    acc2 = vaddq_u32(acc2, vld1q_u32(&words[count + 8]));
+    acc3 = vaddq_u32(acc3, vld1q_u32(&words[count + 12]));
+  }
+  acc0 = vaddq_u32(vaddq_u32(acc0, acc1), vaddq_u32(acc2, acc3));
+  for (; count + 4 <= size; count += 4) {
+    acc0 = vaddq_u32(acc0, vld1q_u32(&words[count]));
+  }
+  checksum = vaddvq_u32(acc0);
+  for (; count < size; ++count) {
+    checksum += words[count];
+  }
+  return checksum;
+}
+#endif /* PM_CHECKSUM_NEON */
+
+uint32_t pm_checksum_sum(const uint32_t* words, size_t size) {
+#if PM_CHECKSUM_NEON
+  return pm_checksum_sum_neon(words, size);
+#else
+  return pm_checksum_sum_scalar(words, size);
+#endif
+}
+
+const char* pm_checksum_impl(void) {
+#if PM_CHECKSUM_NEON
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+uint32_t rtems_pm_checksum(const uint32_t* words, size_t size) {
+  return pm_checksum_sum(words, size) ^ 0xffffffffU;
 }
 
 rtems_pm_image_status rtems_pm_image_header_checksum(const void* header, size_t size) {
@@ -145,17 +220,500 @@ const void* rtems_pm_acap_image_header(const void* image) {
   return ihdrtab;
 }
 
+/*
+ * Checksum a header as the PLM does. The last word of the header is the
+ * checksum of the words before it.
+ */
+static rtems_pm_image_status pm_header_checksum(const void* header, size_t len) {
+  const uint32_t* words = (const uint32_t*) header;
+  size_t count = len / sizeof(uint32_t);
+  return
+    words[count - 1] == rtems_pm_checksum(words, count - 1) ?
+    RTEMS_PM_IMAGE_SUCCESS : RTEMS_PM_IMAGE_INVALID_CSUM;
+}
+
+static bool pm_image_range_valid(
+  uint64_t offset, uint64_t length, size_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+static rtems_pm_image_status pm_partition_valid(
+  const XilPdi_PrtnHdr* phdr, size_t size) {
+  uint32_t type = phdr->PrtnAttrb & XIH_PH_ATTRB_PRTN_TYPE_MASK;
+  if (pm_header_checksum(phdr, XIH_PH_LEN) != RTEMS_PM_IMAGE_SUCCESS) {
+    return RTEMS_PM_IMAGE_INVALID_CSUM;
+  }
+  if (phdr->TotalDataWordLen == 0 ||
+      phdr->UnEncDataWordLen == 0 ||
+      phdr->EncDataWordLen == 0 ||
+      phdr->TotalDataWordLen < phdr->UnEncDataWordLen ||
+      phdr->TotalDataWordLen < phdr->EncDataWordLen) {
+    return RTEMS_PM_IMAGE_INVALID_LENGTH;
+  }
+  if (type == XIH_PH_ATTRB_PRTN_TYPE_RSVD) {
+    return RTEMS_PM_IMAGE_INVALID_PARTITION;
+  }
+  if (!pm_image_range_valid(
+        (uint64_t) phdr->DataWordOfst * XIH_PRTN_WORD_LEN,
+        (uint64_t) phdr->TotalDataWordLen * XIH_PRTN_WORD_LEN, size)) {
+    return RTEMS_PM_IMAGE_INVALID_OFFSET;
+  }
+  return RTEMS_PM_IMAGE_SUCCESS;
+}
+
+rtems_pm_image_status rtems_pm_acap_verify(
+  const void* image, size_t size, rtems_pm_pdi_report* report) {
+  rtems_pm_pdi_report local;
+  const XilPdi_ImgHdrTbl* ihdrtab;
+  const XilPdi_ImgHdr* ihdr;
+  const XilPdi_PrtnHdr* phdr;
+  uint32_t image_partitions = 0;
+  uint32_t u;
+  if (report == NULL) {
+    report = &local;
+  }
+  memset(report, 0, sizeof(*report));
+  report->status = RTEMS_PM_IMAGE_INVALID_LENGTH;
+  report->iht_status = RTEMS_PM_IMAGE_INVALID_LENGTH;
+  report->iht_offset = sizeof(boot_header_X32);
+  if (image == NULL || size < sizeof(boot_header_X32)) {
+    return report->status;
+  }
+  report->status = rtems_pm_acap_verify_pdi_header(image);
+  if (report->status != RTEMS_PM_IMAGE_SUCCESS) {
+    return report->status;
+  }
+  if (size >= sizeof(boot_header_X32) + sizeof(XilPdi_BootHdr) &&
+      rtems_pm_acap_verify_boot_header(image) == RTEMS_PM_IMAGE_SUCCESS) {
+    const XilPdi_BootHdr* bhdr =
+      (const XilPdi_BootHdr*) (image + sizeof(boot_header_X32));
+    report->boot_pdi = true;
+    report->iht_offset = bhdr->BootHdrFwRsvd.MetaHdrOfst;
+  }
+  if (!pm_image_range_valid(report->iht_offset, XIH_IHT_LEN, size)) {
+    report->status = report->iht_status = RTEMS_PM_IMAGE_INVALID_OFFSET;
+    return report->status;
+  }
+  ihdrtab = (const XilPdi_ImgHdrTbl*) (image + report->iht_offset);
+  report->iht_status = pm_header_checksum(ihdrtab, XIH_IHT_LEN);
+  if (report->iht_status != RTEMS_PM_IMAGE_SUCCESS) {
+    report->status = report->iht_status;
+    return report->status;
+  }
+  report->pdi_id = ihdrtab->PdiId;
+  report->images = ihdrtab->NoOfImgs;
+  report->partitions = ihdrtab->NoOfPrtns;
+  if (report->images < XIH_MIN_IMGS || report->images > XIH_MAX_IMGS ||
+      report->partitions < XIH_MIN_PRTNS || report->partitions > XIH_MAX_PRTNS) {
+    report->status = RTEMS_PM_IMAGE_INVALID_COUNT;
+    return report->status;
+  }
+  if (!pm_image_range_valid(
+        (uint64_t) ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN,
+        (uint64_t) report->images * XIH_IH_LEN, size) ||
+      !pm_image_range_valid(
+        (uint64_t) ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN,
+        (uint64_t) report->partitions * XIH_PH_LEN, size)) {
+    report->status = RTEMS_PM_IMAGE_INVALID_OFFSET;
+    return report->status;
+  }
+  report->status = RTEMS_PM_IMAGE_SUCCESS;
+  ihdr = (const XilPdi_ImgHdr*) (image + ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN);
+  for (u = 0; u < report->images; ++u) {
+    rtems_pm_image_status status = pm_header_checksum(&ihdr[u], XIH_IH_LEN);
+    image_partitions += ihdr[u].NoOfPrtns;
+    if (status == RTEMS_PM_IMAGE_SUCCESS &&
+        (ihdr[u].NoOfPrtns == 0 || image_partitions > report->partitions)) {
+      status = RTEMS_PM_IMAGE_INVALID_COUNT;
+    }
+    if (status != RTEMS_PM_IMAGE_SUCCESS) {
+      if (report->image_errors == 0) {
+        report->image_status = status;
+      }
+      report->image_errors |= 1U << u;
+    }
+  }
+  phdr = (const XilPdi_PrtnHdr*) (image + ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN);
+  for (u = 0; u < report->partitions; ++u) {
+    rtems_pm_image_status status = pm_partition_valid(&phdr[u], size);
+    if (status == RTEMS_PM_IMAGE_SUCCESS) {
+      size_t len = (size_t) phdr[u].TotalDataWordLen * XIH_PRTN_WORD_LEN;
+      size_t end = (size_t) phdr[u].DataWordOfst * XIH_PRTN_WORD_LEN + len;
+      report->data_size += len;
+      if (end > report->data_end) {
+        report->data_end = end;
+      }
+    } else {
+      if (report->partition_errors == 0) {
+        report->partition_status = status;
+      }
+      report->partition_errors |= 1U << u;
+    }
+  }
+  if (report->image_errors != 0) {
+    report->status = report->image_status;
+  } else if (report->partition_errors != 0) {
+    report->status = report->partition_status;
+  }
+  return report->status;
+}
+
+typedef uint32_t (*pm_pdi_key)(const rtems_pm_pdi_index* index, uint32_t n);
+
+static uint32_t pm_pdi_key_img_id(const rtems_pm_pdi_index* index, uint32_t n) {
+  const XilPdi_ImgHdr* ihdr = rtems_pm_pdi_image(index, n);
+  return ihdr->ImgID;
+}
+
+static uint32_t pm_pdi_key_uid(const rtems_pm_pdi_index* index, uint32_t n) {
+  const XilPdi_ImgHdr* ihdr = rtems_pm_pdi_image(index, n);
+  return ihdr->UID;
+}
+
+static uint32_t pm_pdi_key_prtn_id(const rtems_pm_pdi_index* index, uint32_t n) {
+  const XilPdi_PrtnHdr* phdr = rtems_pm_pdi_partition(index, n);
+  return phdr->PrtnId;
+}
+
+static uint32_t pm_pdi_hash(uint32_t key) {
+  return ((key * 0x9e3779b1U) >> 16) % RTEMS_PM_PDI_LOOKUP_SIZE;
+}
+
+/*
+ * The first header with a key is found if there are duplicates.
+ */
+static void pm_pdi_lookup_insert(
+  const rtems_pm_pdi_index* index, uint8_t* table, pm_pdi_key key, uint32_t n) {
+  uint32_t k = key(index, n);
+  uint32_t h = pm_pdi_hash(k);
+  while (table[h] != 0) {
+    if (key(index, table[h] - 1) == k) {
+      return;
+    }
+    h = (h + 1) % RTEMS_PM_PDI_LOOKUP_SIZE;
+  }
+  table[h] = n + 1;
+}
+
+static int pm_pdi_lookup_find(
+  const rtems_pm_pdi_index* index, const uint8_t* table, pm_pdi_key key,
+  uint32_t k) {
+  uint32_t h = pm_pdi_hash(k);
+  while (table[h] != 0) {
+    if (key(index, table[h] - 1) == k) {
+      return table[h] - 1;
+    }
+    h = (h + 1) % RTEMS_PM_PDI_LOOKUP_SIZE;
+  }
+  return -1;
+}
+
+rtems_pm_image_status rtems_pm_pdi_index_build(
+  rtems_pm_pdi_index* index, const void* image, size_t size) {
+  rtems_pm_pdi_report* report = &index->report;
+  const XilPdi_ImgHdrTbl* ihdrtab;
+  const XilPdi_ImgHdr* ihdr;
+  uint32_t first = 0;
+  uint32_t u;
+  memset(index, 0, sizeof(*index));
+  index->image = image;
+  index->size = size;
+  rtems_pm_acap_verify(image, size, report);
+  /*
+   * The header tables are in the image if the verify passed or only
+   * individual headers failed.
+   */
+  if (report->status != RTEMS_PM_IMAGE_SUCCESS &&
+      report->image_errors == 0 && report->partition_errors == 0) {
+    return report->status;
+  }
+  if (report->boot_pdi) {
+    index->boot_header = image + sizeof(boot_header_X32);
+  }
+  ihdrtab = (const XilPdi_ImgHdrTbl*) (image + report->iht_offset);
+  index->image_header_table = ihdrtab;
+  index->image_headers = image + ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN;
+  index->partition_headers = image + ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN;
+  ihdr = index->image_headers;
+  for (u = 0; u < report->images; ++u) {
+    index->image_first_partition[u] = first;
+    if ((report->image_errors & (1U << u)) == 0) {
+      pm_pdi_lookup_insert(index, index->by_img_id, pm_pdi_key_img_id, u);
+      pm_pdi_lookup_insert(index, index->by_uid, pm_pdi_key_uid, u);
+      first += ihdr[u].NoOfPrtns;
+    } else {
+      first = report->partitions;
+    }
+  }
+  for (u = 0; u < report->partitions; ++u) {
+    if ((report->partition_errors & (1U << u)) == 0) {
+      pm_pdi_lookup_insert(index, index->by_prtn_id, pm_pdi_key_prtn_id, u);
+    }
+  }
+  return report->status;
+}
+
+bool rtems_pm_pdi_index_valid(const rtems_pm_pdi_index* index) {
+  return index->image_header_table != NULL;
+}
+
+uint32_t rtems_pm_pdi_images(const rtems_pm_pdi_index* index) {
+  return rtems_pm_pdi_index_valid(index) ? index->report.images : 0;
+}
+
+uint32_t rtems_pm_pdi_partitions(const rtems_pm_pdi_index* index) {
+  return rtems_pm_pdi_index_valid(index) ? index->report.partitions : 0;
+}
+
+const void* rtems_pm_pdi_image(const rtems_pm_pdi_index* index, uint32_t image) {
+  const XilPdi_ImgHdr* ihdr = index->image_headers;
+  if (image >= rtems_pm_pdi_images(index)) {
+    return NULL;
+  }
+  return &ihdr[image];
+}
+
+const void* rtems_pm_pdi_partition(
+  const rtems_pm_pdi_index* index, uint32_t partition) {
+  const XilPdi_PrtnHdr* phdr = index->partition_headers;
+  if (partition >= rtems_pm_pdi_partitions(index)) {
+    return NULL;
+  }
+  return &phdr[partition];
+}
+
+int rtems_pm_pdi_image_partitions(
+  const rtems_pm_pdi_index* index, uint32_t image,
+  uint32_t* first, uint32_t* count) {
+  const XilPdi_ImgHdr* ihdr = rtems_pm_pdi_image(index, image);
+  if (ihdr == NULL || (index->report.image_errors & (1U << image)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  *first = index->image_first_partition[image];
+  *count = ihdr->NoOfPrtns;
+  return 0;
+}
+
+int rtems_pm_pdi_find_image(const rtems_pm_pdi_index* index, uint32_t img_id) {
+  return pm_pdi_lookup_find(index, index->by_img_id, pm_pdi_key_img_id, img_id);
+}
+
+int rtems_pm_pdi_find_uid(const rtems_pm_pdi_index* index, uint32_t uid) {
+  return pm_pdi_lookup_find(index, index->by_uid, pm_pdi_key_uid, uid);
+}
+
+int rtems_pm_pdi_find_partition(
+  const rtems_pm_pdi_index* index, uint32_t prtn_id) {
+  return pm_pdi_lookup_find(index, index->by_prtn_id, pm_pdi_key_prtn_id, prtn_id);
+}
+
+typedef struct {
+  size_t start;
+  size_t end;
+} pm_pdi_range;
+
+#define PM_PDI_RANGES (5 + (3 * XIH_MAX_PRTNS))
+
+/*
+ * The PLM reads an authentication certificate from its offset. The size
+ * depends on the key types so clean the largest, an RSA-4096 certificate
+ * is less than 4K. The partition checksum is at most a SHA3-384 hash.
+ */
+#define PM_PDI_AC_SIZE       (8 * 1024)
+#define PM_PDI_CHECKSUM_SIZE 64
+
+static bool pm_pdi_range_add(
+  pm_pdi_range* ranges, size_t capacity, size_t* count,
+  size_t start, size_t length) {
+  pm_pdi_range* range;
+  size_t r;
+  if (*count >= capacity) {
+    return false;
+  }
+  /*
+   * Insertion sort by start, there are only a few ranges.
+   */
+  for (r = *count; r > 0 && ranges[r - 1].start > start; --r) {
+    ranges[r] = ranges[r - 1];
+  }
+  range = &ranges[r];
+  range->start = start;
+  range->end = start + length;
+  ++*count;
+  return true;
+}
+
+/*
+ * Get the ranges the PLM reads merged to cache lines. Returns the number of
+ * ranges or 0 if the ranges do not fit and the image is cleaned in full.
+ */
+static size_t pm_pdi_ranges(
+  const rtems_pm_pdi_index* index, pm_pdi_range* ranges, size_t capacity) {
+  const rtems_pm_pdi_report* report = &index->report;
+  const XilPdi_ImgHdrTbl* ihdrtab = index->image_header_table;
+  const size_t line = rtems_cache_get_data_line_size();
+  size_t count = 0;
+  size_t merged = 0;
+  size_t r;
+  size_t ih_offset = (size_t) ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN;
+  size_t iht_len = XIH_IHT_LEN;
+  size_t ih_len = report->images * XIH_IH_LEN;
+  bool ok;
+  uint32_t u;
+  ok = pm_pdi_range_add(
+    ranges, capacity, &count, 0, sizeof(boot_header_X32));
+  /*
+   * The IHT optional data is between the IHT and the first image header.
+   */
+  if (ih_offset > report->iht_offset + iht_len) {
+    iht_len = ih_offset - report->iht_offset;
+  }
+  ok = ok && pm_pdi_range_add(
+    ranges, capacity, &count, report->iht_offset, iht_len);
+  /*
+   * Secure headers are read as one block of the total header length.
+   */
+  if ((size_t) ihdrtab->TotalHdrLen * XIH_PRTN_WORD_LEN > ih_len) {
+    ih_len = (size_t) ihdrtab->TotalHdrLen * XIH_PRTN_WORD_LEN;
+  }
+  ok = ok && pm_pdi_range_add(ranges, capacity, &count, ih_offset, ih_len);
+  if (ihdrtab->AcOffset != 0) {
+    ok = ok && pm_pdi_range_add(
+      ranges, capacity, &count,
+      (size_t) ihdrtab->AcOffset * XIH_PRTN_WORD_LEN, PM_PDI_AC_SIZE);
+  }
+  ok = ok && pm_pdi_range_add(
+    ranges, capacity, &count, ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN,
+    report->partitions * XIH_PH_LEN);
+  for (u = 0; ok && u < report->partitions; ++u) {
+    const XilPdi_PrtnHdr* phdr = rtems_pm_pdi_partition(index, u);
+    ok = pm_pdi_range_add(
+      ranges, capacity, &count,
+      (size_t) phdr->DataWordOfst * XIH_PRTN_WORD_LEN,
+      (size_t) phdr->TotalDataWordLen * XIH_PRTN_WORD_LEN);
+    if (ok && phdr->AuthCertificateOfst != 0) {
+      ok = pm_pdi_range_add(
+        ranges, capacity, &count,
+        (size_t) phdr->AuthCertificateOfst * XIH_PRTN_WORD_LEN,
+        PM_PDI_AC_SIZE);
+    }
+    if (ok && phdr->ChecksumWordOfst != 0) {
+      ok = pm_pdi_range_add(
+        ranges, capacity, &count,
+        (size_t) phdr->ChecksumWordOfst * XIH_PRTN_WORD_LEN,
+        PM_PDI_CHECKSUM_SIZE);
+    }
+  }
+  if (!ok) {
+    return 0;
+  }
+  for (r = 0; r < count; ++r) {
+    size_t start = ranges[r].start & ~(line - 1);
+    size_t end = (ranges[r].end + line - 1) & ~(line - 1);
+    if (start >= index->size) {
+      break;
+    }
+    if (end > index->size) {
+      end = index->size;
+    }
+    if (merged > 0 && start <= ranges[merged - 1].end) {
+      if (end > ranges[merged - 1].end) {
+        ranges[merged - 1].end = end;
+      }
+    } else {
+      ranges[merged].start = start;
+      ranges[merged].end = end;
+      ++merged;
+    }
+  }
+  return merged;
+}
+
+size_t rtems_pm_pdi_clean_size(const rtems_pm_pdi_index* index) {
+  pm_pdi_range ranges[PM_PDI_RANGES];
+  size_t size = 0;
+  size_t count;
+  size_t r;
+  if (!rtems_pm_pdi_index_valid(index) ||
+      index->report.status != RTEMS_PM_IMAGE_SUCCESS) {
+    return index->size;
+  }
+  count = pm_pdi_ranges(index, ranges, PM_PDI_RANGES);
+  if (count == 0) {
+    return index->size;
+  }
+  for (r = 0; r < count; ++r) {
+    size += ranges[r].end - ranges[r].start;
+  }
+  return size;
+}
+
+size_t rtems_pm_pdi_clean(const rtems_pm_pdi_index* index) {
+  pm_pdi_range ranges[PM_PDI_RANGES];
+  const uint8_t* image = index->image;
+  size_t size = 0;
+  size_t count;
+  size_t r;
+  /*
+   * The ranges are only known for a verified image.
+   */
+  if (!rtems_pm_pdi_index_valid(index) ||
+      index->report.status != RTEMS_PM_IMAGE_SUCCESS) {
+    rtems_cache_flush_multiple_data_lines(index->image, index->size);
+    return index->size;
+  }
+  count = pm_pdi_ranges(index, ranges, PM_PDI_RANGES);
+  if (count == 0) {
+    rtems_cache_flush_multiple_data_lines(index->image, index->size);
+    return index->size;
+  }
+  for (r = 0; r < count; ++r) {
+    rtems_cache_flush_multiple_data_lines(
+      image + ranges[r].start, ranges[r].end - ranges[r].start);
+    size += ranges[r].end - ranges[r].start;
+  }
+  return size;
+}
+
+void rtems_pm_acap_report_print(const rtems_pm_pdi_report* report) {
+  printf("ACAP (PDI) verify     : %s\n", rtems_pm_image_error_text(report->status));
+  printf(" Type                 : %s\n", report->boot_pdi ? "boot" : "partial");
+  printf(" Image header table   : %s @ 0x%08zx\n",
+         rtems_pm_image_error_text(report->iht_status), report->iht_offset);
+  printf(" PDI Id               : 0x%08" PRIx32 "\n", report->pdi_id);
+  printf(" Images               : %" PRIu32 " (errors: 0x%08" PRIx32 ")\n",
+         report->images, report->image_errors);
+  if (report->image_errors != 0) {
+    printf("  First error         : %s\n",
+           rtems_pm_image_error_text(report->image_status));
+  }
+  printf(" Partitions           : %" PRIu32 " (errors: 0x%08" PRIx32 ")\n",
+         report->partitions, report->partition_errors);
+  if (report->partition_errors != 0) {
+    printf("  First error         : %s\n",
+           rtems_pm_image_error_text(report->partition_status));
+  }
+  printf(" Partition data       : %zu bytes, end 0x%08zx\n",
+         report->data_size, report->data_end);
+}
+
 void rtems_pm_acap_print(const void* image, size_t size) {
-  rtems_pm_image_status status;
-  XilPdi_BootHdr* bhdr;
-  XilPdi_ImgHdrTbl* ihdrtab;
-  XilPdi_ImgHdr* ihdr;
-  XilPdi_PrtnHdr* phdr;
+  rtems_pm_pdi_index index;
+  const rtems_pm_pdi_report* report = &index.report;
+  const XilPdi_BootHdr* bhdr;
+  const XilPdi_ImgHdrTbl* ihdrtab;
+  const XilPdi_ImgHdr* ihdr;
+  const XilPdi_PrtnHdr* phdr;
   int max = 0;
   uint32_t u;
-  status = rtems_pm_acap_verify_boot_header(image);
-  if (status == RTEMS_PM_IMAGE_SUCCESS) {
-    bhdr = (XilPdi_BootHdr*) (image + sizeof(boot_header_X32));
+  rtems_pm_pdi_index_build(&index, image, size);
+  if (!rtems_pm_pdi_index_valid(&index)) {
+    printf("error: ACAP image: %s\n", rtems_pm_image_error_text(report->status));
+    return;
+  }
+  bhdr = index.boot_header;
+  if (bhdr != NULL) {
     printf("ACAP (PDI) Image @ %p len: %zu\n", image, size);
     printf(" PLM:\n");
     printf("  PLM source offset  : 0x%08" PRIx32 "\n", bhdr->DpiSrcOfst);
@@ -166,15 +724,8 @@ void rtems_pm_acap_print(const void* image, size_t size) {
     printf("  PLM total length   : %" PRIu32 "\n", bhdr->TotalPlmLen);
     printf(" Boot attributes     : 0x%08" PRIx32 "\n", bhdr->ImgAttrb);
     printf(" PMC metadata offset : 0x%08" PRIx32 "\n", bhdr->BootHdrFwRsvd.MetaHdrOfst);
-    ihdrtab = (XilPdi_ImgHdrTbl*) (image + bhdr->BootHdrFwRsvd.MetaHdrOfst);
-  } else {
-    ihdrtab = (XilPdi_ImgHdrTbl*) (image + sizeof(boot_header_X32));
-  }
-  status = rtems_pm_acap_verify_image_header(ihdrtab);
-  if (status != RTEMS_PM_IMAGE_SUCCESS) {
-    printf("error: ACAP boot header: %s\n", rtems_pm_image_error_text(status));
-    return;
   }
+  ihdrtab = index.image_header_table;
   printf(" Image Header Table (metadata):\n");
   printf("  Version            : %i.%i\n", ihdrtab->Version >> 16, ihdrtab->Version & 0xffff);
   printf("  Images             : %" PRIu32 "\n", ihdrtab->NoOfImgs);
@@ -184,28 +735,32 @@ void rtems_pm_acap_print(const void* image, size_t size) {
   printf("  Device Id          : 0x%08" PRIx32 "\n", ihdrtab->Idcode);
   printf("  Attributes         : 0x%08" PRIx32 "\n", ihdrtab->Attr);
   printf("  Parition Id        : %" PRIu32 "\n", ihdrtab->PdiId);
-  ihdr = (XilPdi_ImgHdr*) (image + ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN);
-  for (u = 0; u < ihdrtab->NoOfImgs; ++u) {
-    int len = strnlen((char*) ihdr[u].ImgName, 64);
+  for (u = 0; u < rtems_pm_pdi_images(&index); ++u) {
+    int len;
+    ihdr = rtems_pm_pdi_image(&index, u);
+    len = strnlen((const char*) ihdr->ImgName, 64);
     if (len > max) {
       max = len;
     }
   }
   printf(" Images:\n");
-  printf("    %-*s parts node id  uid      puid     func id  DDR addr\n", max, "name");
-  for (u = 0; u < ihdrtab->NoOfImgs; ++u) {
+  printf("    %-*s parts node id  uid      puid     func id  DDR addr           csum\n", max, "name");
+  for (u = 0; u < rtems_pm_pdi_images(&index); ++u) {
+    ihdr = rtems_pm_pdi_image(&index, u);
     printf(
-      " %2u %-*s %-5" PRIu32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 " 0x%016" PRIx64 "\n",
-      u, max, ihdr[u].ImgName, ihdr[u].NoOfPrtns, ihdr[u].ImgID, ihdr[u].UID, ihdr[u].PUID,
-      ihdr[u].FuncID, ihdr[u].CopyToMemoryAddr);
+      " %2u %-*s %-5" PRIu32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 " 0x%016" PRIx64 " %s\n",
+      u, max, ihdr->ImgName, ihdr->NoOfPrtns, ihdr->ImgID, ihdr->UID, ihdr->PUID,
+      ihdr->FuncID, ihdr->CopyToMemoryAddr,
+      (report->image_errors & (1U << u)) == 0 ? "ok" : "BAD");
   }
-  phdr = (XilPdi_PrtnHdr*) (image + ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN);
   printf(" Partitions:\n");
-  printf("    id   secs offset   load addr        exec addr\n");
-  for (u = 0; u < ihdrtab->NoOfPrtns; ++u) {
+  printf("    id   secs offset   load addr        exec addr        csum\n");
+  for (u = 0; u < rtems_pm_pdi_partitions(&index); ++u) {
+    phdr = rtems_pm_pdi_partition(&index, u);
     printf(
-      " %2u %-4" PRIu32 " %-4" PRIu32 " %08" PRIx32 " %016" PRIx64 " %016" PRIx64 "\n",
-      u, phdr[u].PrtnId, phdr[u].SectionCount, phdr[u].DataWordOfst * XIH_PRTN_WORD_LEN,
-      phdr[u].DstnLoadAddr, phdr[u].DstnExecutionAddr);
+      " %2u %-4" PRIu32 " %-4" PRIu32 " %08" PRIx32 " %016" PRIx64 " %016" PRIx64 " %s\n",
+      u, phdr->PrtnId, phdr->SectionCount, phdr->DataWordOfst * XIH_PRTN_WORD_LEN,
+      phdr->DstnLoadAddr, phdr->DstnExecutionAddr,
+      (report->partition_errors & (1U << u)) == 0 ? "ok" : "BAD");
   }
 }
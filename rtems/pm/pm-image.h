@@ -29,6 +29,8 @@
 #define RTEMS_PM_PM_IMAGE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,17 +43,252 @@ typedef enum {
   RTEMS_PM_IMAGE_INVALID_CSUM,
   RTEMS_PM_IMAGE_INVALID_HEADER,
   RTEMS_PM_IMAGE_INVALID_IDENT,
+  RTEMS_PM_IMAGE_INVALID_OFFSET,
+  RTEMS_PM_IMAGE_INVALID_COUNT,
+  RTEMS_PM_IMAGE_INVALID_PARTITION,
 } rtems_pm_image_status;
 
+/*
+ * The result of verifying a PDI. The image and partition error masks have a
+ * bit set for each header that fails, a PDI has no more than 32 of each.
+ * Offsets are in bytes from the start of the image.
+ */
+typedef struct {
+  rtems_pm_image_status status;
+  rtems_pm_image_status iht_status;
+  bool boot_pdi;
+  size_t iht_offset;
+  uint32_t pdi_id;
+  uint32_t images;
+  uint32_t partitions;
+  uint32_t image_errors;
+  uint32_t partition_errors;
+  rtems_pm_image_status image_status;
+  rtems_pm_image_status partition_status;
+  size_t data_size;
+  size_t data_end;
+} rtems_pm_pdi_report;
+
+/*
+ * A PDI can have up to 32 images and partitions. The lookup tables are
+ * open addressed and twice that size so probes stay short.
+ */
+#define RTEMS_PM_PDI_MAX_HEADERS 32
+#define RTEMS_PM_PDI_LOOKUP_SIZE (2 * RTEMS_PM_PDI_MAX_HEADERS)
+
+/*
+ * An index of a PDI image built once from a verified image. The header
+ * pointers are in the image and are only valid while the image is. The
+ * lookup tables hold a header number plus 1 and 0 is empty. Headers with
+ * errors are not entered in the lookup tables.
+ */
+typedef struct {
+  const void* image;
+  size_t size;
+  rtems_pm_pdi_report report;
+  const void* boot_header;
+  const void* image_header_table;
+  const void* image_headers;
+  const void* partition_headers;
+  uint8_t image_first_partition[RTEMS_PM_PDI_MAX_HEADERS];
+  uint8_t by_img_id[RTEMS_PM_PDI_LOOKUP_SIZE];
+  uint8_t by_uid[RTEMS_PM_PDI_LOOKUP_SIZE];
+  uint8_t by_prtn_id[RTEMS_PM_PDI_LOOKUP_SIZE];
+} rtems_pm_pdi_index;
+
+/*
+ * Image loader flags.
+ *
+ *  VERIFY: Check the PDI headers as soon as the first block is read.
+ *  CLEAN : Clean the data cache as each block is read so the image is in
+ *          memory for the PLM when the load finishes.
+ *  RAW   : Load a compressed file as is.
+ */
+#define RTEMS_PM_IMAGE_LOAD_VERIFY (1 << 0)
+#define RTEMS_PM_IMAGE_LOAD_CLEAN  (1 << 1)
+#define RTEMS_PM_IMAGE_LOAD_RAW    (1 << 2)
+
+/*
+ * Compressed image formats. The loader detects the format from the first
+ * bytes of the file and decompresses into the image buffer as the file is
+ * read. An LZ4 frame needs the content size in its header (lz4
+ * --content-size) and a gzip file holds the size in its trailer. Zstandard
+ * is detected and rejected as there is no decoder.
+ */
+typedef enum {
+  RTEMS_PM_IMAGE_FORMAT_RAW,
+  RTEMS_PM_IMAGE_FORMAT_LZ4,
+  RTEMS_PM_IMAGE_FORMAT_GZIP,
+  RTEMS_PM_IMAGE_FORMAT_ZSTD
+} rtems_pm_image_format;
+
+/*
+ * An image loaded into a cache line aligned buffer. The clean field is true
+ * if the data cache has been cleaned for all of the image.
+ */
+typedef struct {
+  void* image;
+  size_t size;
+  uint32_t flags;
+  bool clean;
+} rtems_pm_image;
+
 const char* rtems_pm_image_error_text(rtems_pm_image_status status);
+uint32_t rtems_pm_checksum(const uint32_t* words, size_t size);
 rtems_pm_image_status rtems_pm_pdi_header_checksum(
   const void* header, size_t size);
 
 rtems_pm_image_status rtems_pm_acap_verify_image_header(const void* header);
+rtems_pm_image_status rtems_pm_acap_verify_pdi_header(const void* header);
 rtems_pm_image_status rtems_pm_acap_verify_boot_header(const void* header);
 
 const void* rtems_pm_acap_image_header(const void* image);
 
+/*
+ * Verify the image header table and every image and partition header in one
+ * pass. All offsets are checked against the image size before they are used.
+ * The report can be NULL.
+ */
+rtems_pm_image_status rtems_pm_acap_verify(
+  const void* image, size_t size, rtems_pm_pdi_report* report);
+void rtems_pm_acap_report_print(const rtems_pm_pdi_report* report);
+
+/*
+ * Build an index of an image. The status is the verify status. The header
+ * pointers are set if the header tables are in the image even if a header
+ * fails verification so the image can be printed.
+ */
+rtems_pm_image_status rtems_pm_pdi_index_build(
+  rtems_pm_pdi_index* index, const void* image, size_t size);
+bool rtems_pm_pdi_index_valid(const rtems_pm_pdi_index* index);
+uint32_t rtems_pm_pdi_images(const rtems_pm_pdi_index* index);
+uint32_t rtems_pm_pdi_partitions(const rtems_pm_pdi_index* index);
+const void* rtems_pm_pdi_image(const rtems_pm_pdi_index* index, uint32_t image);
+const void* rtems_pm_pdi_partition(
+  const rtems_pm_pdi_index* index, uint32_t partition);
+int rtems_pm_pdi_image_partitions(
+  const rtems_pm_pdi_index* index, uint32_t image,
+  uint32_t* first, uint32_t* count);
+
+/*
+ * Clean the data cache for the parts of an image the PLM reads. This is the
+ * SMAP header, the header tables with the IHT optional data, the
+ * authentication certificates, the partition data and checksums. Ranges
+ * closer than a cache line are merged. The number of bytes cleaned is returned.
+ */
+size_t rtems_pm_pdi_clean(const rtems_pm_pdi_index* index);
+size_t rtems_pm_pdi_clean_size(const rtems_pm_pdi_index* index);
+
+/*
+ * Find a header by its identifier. The header number is returned or -1 if
+ * it is not found.
+ */
+int rtems_pm_pdi_find_image(const rtems_pm_pdi_index* index, uint32_t img_id);
+int rtems_pm_pdi_find_uid(const rtems_pm_pdi_index* index, uint32_t uid);
+int rtems_pm_pdi_find_partition(
+  const rtems_pm_pdi_index* index, uint32_t prtn_id);
+
+/*
+ * Load a file into a cache line aligned buffer. The reads are directly into
+ * the buffer and the block size grows as the reads complete. Returns -1 with
+ * errno set on error.
+ */
+int rtems_pm_image_load(const char* path, uint32_t flags, rtems_pm_image* image);
+void rtems_pm_image_free(rtems_pm_image* image);
+
+rtems_pm_image_format rtems_pm_image_format_detect(
+  const void* data, size_t size);
+const char* rtems_pm_image_format_name(rtems_pm_image_format format);
+
+/*
+ * Decompress an image in memory into a new image buffer. The flags are the
+ * loader flags.
+ */
+int rtems_pm_image_decompress(
+  const void* data, size_t size, uint32_t flags, rtems_pm_image* image);
+
+/*
+ * Staging arena. A region reserved at boot that image buffers are allocated
+ * from so large loads do not fragment or fail on the heap. The allocations
+ * are cache line aligned. An uncached arena is mapped non-cacheable and
+ * images in it need no cache maintenance. The init call uses a region the
+ * application has reserved and the create call allocates the region from
+ * the heap. If there is no arena or it is full, buffers come from the heap.
+ */
+#define RTEMS_PM_ARENA_UNCACHED (1 << 0)
+
+typedef struct {
+  size_t size;
+  size_t used;
+  size_t peak;
+  size_t largest_free;
+  uint32_t blocks;
+  uint64_t allocs;
+  uint64_t failures;
+  bool uncached;
+} rtems_pm_arena_stats;
+
+int rtems_pm_arena_init(void* base, size_t size, uint32_t flags);
+int rtems_pm_arena_create(size_t size, uint32_t flags);
+bool rtems_pm_arena_active(void);
+void* rtems_pm_arena_alloc(size_t size);
+void rtems_pm_arena_free(void* ptr);
+bool rtems_pm_arena_contains(const void* ptr);
+void rtems_pm_arena_get_stats(rtems_pm_arena_stats* stats);
+
+/*
+ * Read ahead. The depth is the number of blocks a read ahead task can read
+ * ahead of the loading task and 0 disables the task. A priority of 0 runs
+ * the task at the loading task's priority.
+ */
+#define RTEMS_PM_IMAGE_READ_AHEAD_MAX 8
+int rtems_pm_image_read_ahead_set(uint32_t depth, uint32_t priority);
+void rtems_pm_image_read_ahead_get(uint32_t* depth, uint32_t* priority);
+
+/*
+ * Image cache. Images are held in memory and kept clean in the data cache
+ * so a repeated load does not read the file or clean the cache again. A
+ * file is found by its path, size and modification time and an image in
+ * memory by its PDI Id and a hash of its contents. A compressed image in
+ * memory is decompressed when it is added. The least recently used
+ * images are evicted when the cache is over its limit. Referenced and pinned
+ * images are not evicted. A limit of 0 disables the cache and images are
+ * loaded and freed on release.
+ */
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint32_t entries;
+  size_t size;
+  size_t limit;
+} rtems_pm_cache_stats;
+
+typedef struct {
+  const char* path;
+  uint32_t pdi_id;
+  uint64_t hash;
+  size_t size;
+  uint32_t refs;
+  uint32_t hits;
+  bool pinned;
+} rtems_pm_cache_info;
+
+typedef void (*rtems_pm_cache_visitor)(const rtems_pm_cache_info* info, void* arg);
+
+void rtems_pm_cache_set_limit(size_t limit);
+int rtems_pm_cache_load_file(
+  const char* path, uint32_t flags, rtems_pm_image** image);
+int rtems_pm_cache_load_memory(
+  const void* data, size_t size, rtems_pm_image** image);
+void rtems_pm_cache_release(rtems_pm_image* image);
+void rtems_pm_cache_pin(rtems_pm_image* image, bool pin);
+void rtems_pm_cache_flush(void);
+void rtems_pm_cache_get_stats(rtems_pm_cache_stats* stats);
+void rtems_pm_cache_reset_stats(void);
+void rtems_pm_cache_iterate(rtems_pm_cache_visitor visitor, void* arg);
+uint64_t rtems_pm_cache_hash(const void* data, size_t size);
+
 void rtems_pm_acap_image_print(const void* image);
 void rtems_pm_acap_print(const void* image, size_t size);
 
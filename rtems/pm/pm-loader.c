@@ -0,0 +1,531 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Image loader.
+ *
+ * Images are read directly into a cache line aligned buffer. The first read
+ * is small so the headers can be checked quickly and each read after that
+ * doubles up to a limit so large images on network file systems need fewer
+ * requests. The data cache is cleaned as each block arrives while the data
+ * is still in the cache rather than in one pass at the end.
+ *
+ * A read ahead task can read the blocks so the file system reads overlap
+ * the checks and cache cleaning of the blocks already read. The blocks are
+ * read straight into the image buffer so there is no copy. The depth is the
+ * number of blocks the reader can be ahead.
+ *
+ * A compressed file is decompressed into the image buffer as it is read.
+ * The decoder makes the reads so there is no read ahead task and each part
+ * of the image is checked and cleaned as it is written.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rtems.h>
+
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#include "xilpdi.h"
+
+#define PM_IMAGE_BLOCK_MIN (64 * 1024)
+#define PM_IMAGE_BLOCK_MAX (4 * 1024 * 1024)
+
+static size_t pm_image_align_down(size_t offset, size_t line) {
+  return offset & ~(line - 1);
+}
+
+/*
+ * Check the headers in the first block. A boot PDI's image header table can
+ * be anywhere in the image so only the partial PDI table is checked here.
+ * The full verify happens when the image is loaded.
+ */
+static int pm_image_verify_first(
+  const char* path, const void* image, size_t size) {
+  rtems_pm_image_status status = RTEMS_PM_IMAGE_INVALID_LENGTH;
+  if (size >= SMAP_BUS_WIDTH_LENGTH) {
+    status = rtems_pm_acap_verify_pdi_header(image);
+  }
+  if (status == RTEMS_PM_IMAGE_SUCCESS &&
+      size >= SMAP_BUS_WIDTH_LENGTH + XIH_IHT_LEN &&
+      (size < SMAP_BUS_WIDTH_LENGTH + sizeof(XilPdi_BootHdr) ||
+       rtems_pm_acap_verify_boot_header(image) != RTEMS_PM_IMAGE_SUCCESS)) {
+    status = rtems_pm_acap_verify_image_header(image + SMAP_BUS_WIDTH_LENGTH);
+  }
+  if (status != RTEMS_PM_IMAGE_SUCCESS) {
+    printf("error: image: %s: %s\n", path, rtems_pm_image_error_text(status));
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+static ssize_t pm_image_read(int fd, void* buffer, size_t size) {
+  char* in = buffer;
+  size_t total = 0;
+  while (total < size) {
+    ssize_t r = read(fd, in + total, size - total);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (r == 0) {
+      break;
+    }
+    total += r;
+  }
+  return total;
+}
+
+/*
+ * A block read by the read ahead task. The offset and size are in the image
+ * buffer and the size is the number of bytes read or -1 with the errno.
+ */
+typedef struct {
+  size_t offset;
+  ssize_t size;
+  int eno;
+} pm_image_block;
+
+typedef struct {
+  const char* path;
+  int fd;
+  const uint8_t* data;
+  size_t data_size;
+  size_t data_offset;
+  rtems_pm_image* image;
+  size_t line;
+  size_t cleaned;
+  uint64_t clean_ns;
+  bool uncached;
+  uint32_t depth;
+  bool abort;
+  rtems_counting_semaphore free_blocks;
+  rtems_counting_semaphore read_blocks;
+  rtems_binary_semaphore done;
+  pm_image_block blocks[RTEMS_PM_IMAGE_READ_AHEAD_MAX];
+} pm_image_loader;
+
+static uint32_t read_ahead_depth = 2;
+static uint32_t read_ahead_priority;
+
+int rtems_pm_image_read_ahead_set(uint32_t depth, uint32_t priority) {
+  if (depth > RTEMS_PM_IMAGE_READ_AHEAD_MAX || priority > RTEMS_MAXIMUM_PRIORITY) {
+    errno = EINVAL;
+    return -1;
+  }
+  read_ahead_depth = depth;
+  read_ahead_priority = priority;
+  return 0;
+}
+
+void rtems_pm_image_read_ahead_get(uint32_t* depth, uint32_t* priority) {
+  *depth = read_ahead_depth;
+  *priority = read_ahead_priority;
+}
+
+static size_t pm_image_block_size(const pm_image_loader* loader, size_t offset) {
+  size_t block = PM_IMAGE_BLOCK_MIN;
+  size_t size = loader->image->size - offset;
+  while (block < PM_IMAGE_BLOCK_MAX && block <= offset) {
+    block *= 2;
+  }
+  return size > block ? block : size;
+}
+
+/*
+ * A block has been read. Check the headers if this is the first block and
+ * clean the whole lines read. The last line may be partly written by the
+ * next read so it is left until then.
+ */
+static int pm_image_block_done(
+  pm_image_loader* loader, size_t offset, size_t size) {
+  rtems_pm_image* image = loader->image;
+  char* in = image->image;
+  if (offset == 0 && (image->flags & RTEMS_PM_IMAGE_LOAD_VERIFY) != 0) {
+    if (pm_image_verify_first(loader->path, in, size) < 0) {
+      return -1;
+    }
+  }
+  if ((image->flags & RTEMS_PM_IMAGE_LOAD_CLEAN) != 0 && !loader->uncached) {
+    size_t end = offset + size;
+    if (end != image->size) {
+      end = pm_image_align_down(end, loader->line);
+    }
+    if (end > loader->cleaned) {
+      uint64_t start = pm_phase_start();
+      rtems_cache_flush_multiple_data_lines(
+        in + loader->cleaned, end - loader->cleaned);
+      loader->clean_ns += rtems_clock_get_uptime_nanoseconds() - start;
+      loader->cleaned = end;
+    }
+  }
+  return 0;
+}
+
+static int pm_image_load_serial(pm_image_loader* loader) {
+  rtems_pm_image* image = loader->image;
+  char* in = image->image;
+  size_t offset = 0;
+  while (offset < image->size) {
+    size_t size = pm_image_block_size(loader, offset);
+    ssize_t read_in = pm_image_read(loader->fd, in + offset, size);
+    if (read_in != size) {
+      if (read_in >= 0) {
+        errno = EIO;
+      }
+      return -1;
+    }
+    if (pm_image_block_done(loader, offset, size) < 0) {
+      return -1;
+    }
+    offset += size;
+  }
+  return 0;
+}
+
+/*
+ * The read ahead task reads blocks into the image buffer while the loading
+ * task checks and cleans the blocks already read. The free blocks count
+ * limits how far ahead the reads can be.
+ */
+static void pm_image_reader(rtems_task_argument arg) {
+  pm_image_loader* loader = (pm_image_loader*) arg;
+  rtems_pm_image* image = loader->image;
+  char* in = image->image;
+  size_t offset = 0;
+  uint32_t slot = 0;
+  while (offset < image->size) {
+    pm_image_block* block = &loader->blocks[slot];
+    size_t size;
+    rtems_counting_semaphore_wait(&loader->free_blocks);
+    if (loader->abort) {
+      break;
+    }
+    size = pm_image_block_size(loader, offset);
+    block->offset = offset;
+    block->size = pm_image_read(loader->fd, in + offset, size);
+    block->eno = block->size < 0 ? errno : EIO;
+    slot = (slot + 1) % loader->depth;
+    rtems_counting_semaphore_post(&loader->read_blocks);
+    if (block->size != size) {
+      break;
+    }
+    offset += size;
+  }
+  rtems_binary_semaphore_post(&loader->done);
+  rtems_task_exit();
+}
+
+static int pm_image_load_read_ahead(pm_image_loader* loader) {
+  rtems_pm_image* image = loader->image;
+  rtems_task_priority priority = read_ahead_priority;
+  rtems_status_code sc;
+  rtems_id id;
+  size_t offset = 0;
+  uint32_t slot = 0;
+  int eno = 0;
+  if (priority == 0) {
+    sc = rtems_task_set_priority(RTEMS_SELF, RTEMS_CURRENT_PRIORITY, &priority);
+    if (sc != RTEMS_SUCCESSFUL) {
+      return pm_image_load_serial(loader);
+    }
+  }
+  sc = rtems_task_create(
+    rtems_build_name('P', 'M', 'R', 'A'), priority,
+    RTEMS_MINIMUM_STACK_SIZE * 4, RTEMS_DEFAULT_MODES,
+    RTEMS_DEFAULT_ATTRIBUTES, &id);
+  if (sc != RTEMS_SUCCESSFUL) {
+    pm_debug("image: read ahead: task create: %s\n", rtems_status_text(sc));
+    return pm_image_load_serial(loader);
+  }
+  rtems_counting_semaphore_init(
+    &loader->free_blocks, "PM Image Free", loader->depth);
+  rtems_counting_semaphore_init(&loader->read_blocks, "PM Image Read", 0);
+  rtems_binary_semaphore_init(&loader->done, "PM Image Done");
+  sc = rtems_task_start(id, pm_image_reader, (rtems_task_argument) loader);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_task_delete(id);
+    rtems_counting_semaphore_destroy(&loader->free_blocks);
+    rtems_counting_semaphore_destroy(&loader->read_blocks);
+    rtems_binary_semaphore_destroy(&loader->done);
+    return pm_image_load_serial(loader);
+  }
+  while (offset < image->size) {
+    pm_image_block* block = &loader->blocks[slot];
+    rtems_counting_semaphore_wait(&loader->read_blocks);
+    slot = (slot + 1) % loader->depth;
+    if (block->size != pm_image_block_size(loader, block->offset)) {
+      eno = block->eno;
+      break;
+    }
+    if (pm_image_block_done(loader, block->offset, block->size) < 0) {
+      eno = errno;
+      break;
+    }
+    offset += block->size;
+    rtems_counting_semaphore_post(&loader->free_blocks);
+  }
+  /*
+   * Wake the reader if it is waiting for a free block so it sees the abort.
+   * The reader has finished with the buffer once done is posted.
+   */
+  if (eno != 0) {
+    loader->abort = true;
+    rtems_counting_semaphore_post(&loader->free_blocks);
+  }
+  rtems_binary_semaphore_wait(&loader->done);
+  rtems_counting_semaphore_destroy(&loader->free_blocks);
+  rtems_counting_semaphore_destroy(&loader->read_blocks);
+  rtems_binary_semaphore_destroy(&loader->done);
+  if (eno != 0) {
+    errno = eno;
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * The compressed stream is the file or a buffer in memory.
+ */
+static ssize_t pm_image_decode_read(void* arg, void* buffer, size_t size) {
+  pm_image_loader* loader = (pm_image_loader*) arg;
+  if (loader->data != NULL) {
+    size_t remaining = loader->data_size - loader->data_offset;
+    if (size > remaining) {
+      size = remaining;
+    }
+    memcpy(buffer, loader->data + loader->data_offset, size);
+    loader->data_offset += size;
+    return size;
+  }
+  return pm_image_read(loader->fd, buffer, size);
+}
+
+static int pm_image_decode_output(void* arg, size_t offset, size_t size) {
+  return pm_image_block_done((pm_image_loader*) arg, offset, size);
+}
+
+static int pm_image_load_compressed(
+  pm_image_loader* loader, rtems_pm_image_format format,
+  const void* head, size_t head_size, const void* tail) {
+  rtems_pm_image* image = loader->image;
+  pm_image_decoder decoder = {
+    .format = format,
+    .read = pm_image_decode_read,
+    .output = pm_image_decode_output,
+    .arg = loader
+  };
+  size_t size;
+  int r;
+  r = pm_image_decompressed_size(format, head, head_size, tail, &size);
+  if (r == 0) {
+    image->image = pm_image_buffer_alloc(size, &loader->uncached);
+    if (image->image == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    image->size = size;
+    decoder.out = image->image;
+    decoder.out_size = size;
+    pm_debug(
+      "image: decompress: %s %s size=%zu\n",
+      loader->path, rtems_pm_image_format_name(format), size);
+    r = pm_image_decode(&decoder);
+  }
+  if (r < 0) {
+    int eno = errno;
+    printf(
+      "error: image: %s: %s: %s\n",
+      loader->path, rtems_pm_image_format_name(format), strerror(eno));
+    if (image->image != NULL) {
+      rtems_pm_image_free(image);
+    }
+    errno = eno;
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Check the start of the file for a compressed format. A gzip file also
+ * needs its trailer for the size.
+ */
+static rtems_pm_image_format pm_image_file_format(
+  pm_image_loader* loader, uint8_t* head, size_t* head_size, uint8_t* tail,
+  off_t file_size) {
+  rtems_pm_image_format format;
+  ssize_t r;
+  r = pread(loader->fd, head, *head_size, 0);
+  if (r < 0) {
+    return RTEMS_PM_IMAGE_FORMAT_RAW;
+  }
+  *head_size = r;
+  format = rtems_pm_image_format_detect(head, r);
+  if (format == RTEMS_PM_IMAGE_FORMAT_GZIP &&
+      pread(loader->fd, tail, 4, file_size - 4) != 4) {
+    format = RTEMS_PM_IMAGE_FORMAT_RAW;
+  }
+  return format;
+}
+
+int rtems_pm_image_load(const char* path, uint32_t flags, rtems_pm_image* image) {
+  pm_image_loader loader = {
+    .path = path,
+    .image = image,
+    .line = rtems_cache_get_data_line_size(),
+    .depth = read_ahead_depth
+  };
+  struct stat sb;
+  rtems_pm_image_format format = RTEMS_PM_IMAGE_FORMAT_RAW;
+  uint8_t head[32];
+  size_t head_size = sizeof(head);
+  uint8_t tail[4];
+  const uint64_t start = pm_phase_start();
+  int r;
+  memset(image, 0, sizeof(*image));
+  image->flags = flags;
+  loader.fd = open(path, O_RDONLY);
+  if (loader.fd < 0) {
+    return -1;
+  }
+  r = fstat(loader.fd, &sb);
+  if (r < 0) {
+    int eno = errno;
+    close(loader.fd);
+    errno = eno;
+    return -1;
+  }
+  if (sb.st_size == 0) {
+    close(loader.fd);
+    errno = EINVAL;
+    return -1;
+  }
+  if ((flags & RTEMS_PM_IMAGE_LOAD_RAW) == 0) {
+    format = pm_image_file_format(&loader, head, &head_size, tail, sb.st_size);
+  }
+  if (format != RTEMS_PM_IMAGE_FORMAT_RAW) {
+    r = pm_image_load_compressed(&loader, format, head, head_size, tail);
+    if (r < 0) {
+      int eno = errno;
+      close(loader.fd);
+      errno = eno;
+      return -1;
+    }
+  } else {
+    image->size = sb.st_size;
+    image->image = pm_image_buffer_alloc(image->size, &loader.uncached);
+    if (image->image == NULL) {
+      close(loader.fd);
+      errno = ENOMEM;
+      return -1;
+    }
+    pm_debug(
+      "image: load: %s size=%zu read-ahead=%" PRIu32 "\n",
+      path, image->size, loader.depth);
+    /*
+     * An image that fits in the first block gains nothing from reading
+     * ahead.
+     */
+    if (loader.depth == 0 || image->size <= PM_IMAGE_BLOCK_MIN) {
+      r = pm_image_load_serial(&loader);
+    } else {
+      r = pm_image_load_read_ahead(&loader);
+    }
+  }
+  if (r < 0) {
+    int eno = errno;
+    close(loader.fd);
+    rtems_pm_image_free(image);
+    errno = eno;
+    return -1;
+  }
+  close(loader.fd);
+  /*
+   * An image in the uncached arena is never in the data cache.
+   */
+  image->clean = (flags & RTEMS_PM_IMAGE_LOAD_CLEAN) != 0 || loader.uncached;
+  /*
+   * The read time includes the cleaning as they overlap with a read ahead
+   * task. The clean time is the total for the image.
+   */
+  pm_phase_record(RTEMS_PM_PHASE_READ, start);
+  if (image->clean && !loader.uncached) {
+    pm_phase_record_ns(RTEMS_PM_PHASE_CLEAN, loader.clean_ns);
+  }
+  return 0;
+}
+
+int rtems_pm_image_decompress(
+  const void* data, size_t size, uint32_t flags, rtems_pm_image* image) {
+  pm_image_loader loader = {
+    .path = "memory",
+    .fd = -1,
+    .data = data,
+    .data_size = size,
+    .image = image,
+    .line = rtems_cache_get_data_line_size()
+  };
+  const rtems_pm_image_format format =
+    rtems_pm_image_format_detect(data, size);
+  const uint8_t* tail = data;
+  int r;
+  memset(image, 0, sizeof(*image));
+  image->flags = flags;
+  if (format == RTEMS_PM_IMAGE_FORMAT_RAW || size < 4) {
+    errno = EINVAL;
+    return -1;
+  }
+  tail += size - 4;
+  r = pm_image_load_compressed(&loader, format, data, size, tail);
+  if (r < 0) {
+    return -1;
+  }
+  image->clean = (flags & RTEMS_PM_IMAGE_LOAD_CLEAN) != 0 || loader.uncached;
+  if (image->clean && !loader.uncached) {
+    pm_phase_record_ns(RTEMS_PM_PHASE_CLEAN, loader.clean_ns);
+  }
+  return 0;
+}
+
+void rtems_pm_image_free(rtems_pm_image* image) {
+  pm_image_buffer_free(image->image);
+  image->image = NULL;
+  image->size = 0;
+  image->clean = false;
+}
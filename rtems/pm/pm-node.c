@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Node manager.
+ *
+ * Users acquire and release PM nodes and the manager counts the users. The
+ * first acquire requests the node from the firmware and the last release
+ * starts the node's hysteresis timer. The node is released to the firmware
+ * when the timer expires with no users so a node used in bursts stays
+ * powered between the bursts and is powered down when idle. An acquire
+ * while the timer runs cancels it and makes no firmware call.
+ *
+ * A request that powers a node up is the node's wake time. If the node has
+ * a maximum latency it is given to the firmware with PM_SET_MAX_LATENCY
+ * before the first request and wakes longer than the latency are counted.
+ *
+ * The timers run in the timer server task. The lock is held over the
+ * firmware calls so a release from the timer cannot overlap a request.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include <rtems.h>
+#include <rtems/counter.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#define PM_NODE_TIMER_STACK_SIZE (RTEMS_MINIMUM_STACK_SIZE * 2)
+
+typedef struct pm_node {
+  rtems_pm_node_info info;
+  rtems_id timer;
+  bool latency_set;
+  SLIST_ENTRY(pm_node) next;
+} pm_node;
+
+static SLIST_HEAD(pm_node_head, pm_node) nodes = SLIST_HEAD_INITIALIZER(nodes);
+static rtems_mutex node_lock = RTEMS_MUTEX_INITIALIZER("PM Node");
+static bool node_timer_server;
+
+static pm_node* pm_node_find(uint32_t id) {
+  pm_node* node;
+  SLIST_FOREACH(node, &nodes, next) {
+    if (node->info.node == id) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+static pm_node* pm_node_get(uint32_t id) {
+  pm_node* node = pm_node_find(id);
+  if (node == NULL) {
+    node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    node->info.node = id;
+    node->info.state = RTEMS_PM_NODE_OFF;
+    node->info.capabilities = RTEMS_PM_NODE_CAP_ACCESS;
+    node->info.hysteresis_ms = RTEMS_PM_NODE_HYSTERESIS_MS;
+    SLIST_INSERT_HEAD(&nodes, node, next);
+  }
+  return node;
+}
+
+static int pm_node_release_now(pm_node* node) {
+  pm_ret_payload res;
+  int r = pm_node_call(PM_RELEASE_NODE, node->info.node, 0, 0, 0, &res);
+  if (r == 0) {
+    ++node->info.releases;
+  } else {
+    pm_info(
+      "pm: node: %08" PRIx32 ": release: %s\n", node->info.node,
+      strerror(errno));
+  }
+  /*
+   * The node is not held if the release failed, a later acquire requests
+   * it again.
+   */
+  node->info.state = RTEMS_PM_NODE_OFF;
+  return r;
+}
+
+static rtems_timer_service_routine pm_node_timeout(rtems_id timer, void* arg) {
+  pm_node* node = arg;
+  rtems_mutex_lock(&node_lock);
+  if (node->info.state == RTEMS_PM_NODE_IDLE && node->info.refs == 0) {
+    pm_node_release_now(node);
+  }
+  rtems_mutex_unlock(&node_lock);
+}
+
+static int pm_node_timer_fire(pm_node* node) {
+  rtems_interval ticks;
+  rtems_status_code sc;
+  if (!node_timer_server) {
+    sc = rtems_timer_initiate_server(
+      RTEMS_TIMER_SERVER_DEFAULT_PRIORITY, PM_NODE_TIMER_STACK_SIZE,
+      RTEMS_DEFAULT_ATTRIBUTES);
+    if (sc != RTEMS_SUCCESSFUL && sc != RTEMS_INCORRECT_STATE) {
+      pm_info("pm: node: timer server: %s\n", rtems_status_text(sc));
+      return -1;
+    }
+    node_timer_server = true;
+  }
+  if (node->timer == 0) {
+    sc = rtems_timer_create(rtems_build_name('P', 'M', 'N', 'D'), &node->timer);
+    if (sc != RTEMS_SUCCESSFUL) {
+      pm_info("pm: node: timer: %s\n", rtems_status_text(sc));
+      node->timer = 0;
+      return -1;
+    }
+  }
+  ticks = RTEMS_MILLISECONDS_TO_TICKS(node->info.hysteresis_ms);
+  if (ticks == 0) {
+    ticks = 1;
+  }
+  sc = rtems_timer_server_fire_after(node->timer, ticks, pm_node_timeout, node);
+  if (sc != RTEMS_SUCCESSFUL) {
+    pm_info("pm: node: timer: fire: %s\n", rtems_status_text(sc));
+    return -1;
+  }
+  return 0;
+}
+
+static int pm_node_request(pm_node* node) {
+  pm_ret_payload res;
+  rtems_counter_ticks start;
+  uint64_t ns;
+  int r;
+  if (node->info.max_latency_us != 0 && !node->latency_set) {
+    r = pm_node_call(
+      PM_SET_MAX_LATENCY, node->info.node, node->info.max_latency_us, 0, 0,
+      &res);
+    if (r < 0) {
+      return r;
+    }
+    node->latency_set = true;
+  }
+  start = rtems_counter_read();
+  r = pm_node_call(
+    PM_REQUEST_NODE, node->info.node, node->info.capabilities,
+    RTEMS_PM_NODE_QOS_MAX, PM_REQUEST_ACK_BLOCKING, &res);
+  ns = rtems_counter_ticks_to_nanoseconds(
+    rtems_counter_difference(rtems_counter_read(), start));
+  if (r < 0) {
+    return r;
+  }
+  ++node->info.requests;
+  node->info.wake_last_ns = ns;
+  node->info.wake_total_ns += ns;
+  if (node->info.requests == 1 || ns < node->info.wake_min_ns) {
+    node->info.wake_min_ns = ns;
+  }
+  if (ns > node->info.wake_max_ns) {
+    node->info.wake_max_ns = ns;
+  }
+  if (node->info.max_latency_us != 0 &&
+      ns > (uint64_t) node->info.max_latency_us * 1000) {
+    ++node->info.late;
+  }
+  return 0;
+}
+
+int rtems_pm_node_configure(
+  uint32_t id, uint32_t capabilities, uint32_t hysteresis_ms,
+  uint32_t max_latency_us) {
+  pm_node* node;
+  int r = 0;
+  if (capabilities == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  rtems_mutex_lock(&node_lock);
+  node = pm_node_get(id);
+  if (node == NULL) {
+    rtems_mutex_unlock(&node_lock);
+    return -1;
+  }
+  node->info.hysteresis_ms = hysteresis_ms;
+  if (max_latency_us != node->info.max_latency_us) {
+    node->info.max_latency_us = max_latency_us;
+    node->latency_set = false;
+  }
+  if (capabilities != node->info.capabilities) {
+    node->info.capabilities = capabilities;
+    if (node->info.state != RTEMS_PM_NODE_OFF) {
+      pm_ret_payload res;
+      r = pm_node_call(
+        PM_SET_REQUIREMENT, id, capabilities, RTEMS_PM_NODE_QOS_MAX,
+        PM_REQUEST_ACK_BLOCKING, &res);
+    }
+  }
+  rtems_mutex_unlock(&node_lock);
+  return r;
+}
+
+int rtems_pm_node_acquire(uint32_t id) {
+  pm_node* node;
+  int r = 0;
+  rtems_mutex_lock(&node_lock);
+  node = pm_node_get(id);
+  if (node == NULL) {
+    rtems_mutex_unlock(&node_lock);
+    return -1;
+  }
+  switch (node->info.state) {
+    case RTEMS_PM_NODE_OFF:
+      r = pm_node_request(node);
+      break;
+    case RTEMS_PM_NODE_IDLE:
+      rtems_timer_cancel(node->timer);
+      ++node->info.reuses;
+      break;
+    default:
+      break;
+  }
+  if (r == 0) {
+    ++node->info.refs;
+    node->info.state = RTEMS_PM_NODE_ON;
+  }
+  rtems_mutex_unlock(&node_lock);
+  return r;
+}
+
+int rtems_pm_node_release(uint32_t id) {
+  pm_node* node;
+  int r = 0;
+  rtems_mutex_lock(&node_lock);
+  node = pm_node_find(id);
+  if (node == NULL || node->info.refs == 0) {
+    rtems_mutex_unlock(&node_lock);
+    errno = EINVAL;
+    return -1;
+  }
+  --node->info.refs;
+  if (node->info.refs == 0) {
+    node->info.state = RTEMS_PM_NODE_IDLE;
+    if (node->info.hysteresis_ms == 0 || pm_node_timer_fire(node) < 0) {
+      r = pm_node_release_now(node);
+    }
+  }
+  rtems_mutex_unlock(&node_lock);
+  return r;
+}
+
+/*
+ * Release idle nodes now rather than when their timers expire.
+ */
+void rtems_pm_node_flush(void) {
+  pm_node* node;
+  rtems_mutex_lock(&node_lock);
+  SLIST_FOREACH(node, &nodes, next) {
+    if (node->info.state == RTEMS_PM_NODE_IDLE) {
+      rtems_timer_cancel(node->timer);
+      pm_node_release_now(node);
+    }
+  }
+  rtems_mutex_unlock(&node_lock);
+}
+
+int rtems_pm_node_info_get(uint32_t id, rtems_pm_node_info* info) {
+  pm_node* node;
+  rtems_mutex_lock(&node_lock);
+  node = pm_node_find(id);
+  if (node == NULL) {
+    rtems_mutex_unlock(&node_lock);
+    errno = ENOENT;
+    return -1;
+  }
+  *info = node->info;
+  rtems_mutex_unlock(&node_lock);
+  return 0;
+}
+
+void rtems_pm_node_iterate(rtems_pm_node_visitor visitor, void* arg) {
+  pm_node* node;
+  rtems_mutex_lock(&node_lock);
+  SLIST_FOREACH(node, &nodes, next) {
+    visitor(&node->info, arg);
+  }
+  rtems_mutex_unlock(&node_lock);
+}
+
+const char* rtems_pm_node_state_name(rtems_pm_node_state state) {
+  switch (state) {
+    case RTEMS_PM_NODE_OFF:
+      return "off";
+    case RTEMS_PM_NODE_ON:
+      return "on";
+    case RTEMS_PM_NODE_IDLE:
+      return "idle";
+    default:
+      break;
+  }
+  return "invalid";
+}
@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Firmware notifications.
+ *
+ * TF-A raises an SGI when the PLM has a callback for this subsystem. The
+ * interrupt handler only wakes the dispatcher task. The dispatcher reads
+ * the callback data with GET_CALLBACK_DATA and passes it to the registered
+ * notifiers so tasks can block on a change rather than poll the firmware.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#define PM_NOTIFY_STACK_SIZE (RTEMS_MINIMUM_STACK_SIZE * 2)
+
+static rtems_mutex notify_lock = RTEMS_MUTEX_INITIALIZER("PM Notify");
+static rtems_counting_semaphore notify_work;
+static rtems_pm_notifier* notifiers;
+static rtems_pm_notify_stats notify_stats;
+
+static void pm_notify_isr(void* arg) {
+  pm_notify_raise();
+}
+
+void pm_notify_raise(void) {
+  if (notify_stats.running) {
+    ++notify_stats.interrupts;
+    rtems_counting_semaphore_post(&notify_work);
+  }
+}
+
+/*
+ * Call with the lock held.
+ */
+static uint32_t pm_notify_deliver(const rtems_pm_notification* notification) {
+  rtems_pm_notifier* notifier;
+  uint32_t delivered = 0;
+  for (notifier = notifiers; notifier != NULL; notifier = notifier->next) {
+    if (notifier->node != notification->node ||
+        (notifier->event & notification->event) == 0) {
+      continue;
+    }
+    ++notifier->count;
+    notifier->last = *notification;
+    if (notifier->handler != NULL) {
+      notifier->handler(notifier, notification, notifier->arg);
+    }
+    if (notifier->task != 0) {
+      rtems_event_send(notifier->task, notifier->events);
+    }
+    if (notifier->queue != 0) {
+      rtems_status_code sc = rtems_message_queue_send(
+        notifier->queue, notification, sizeof(*notification));
+      if (sc != RTEMS_SUCCESSFUL) {
+        pm_debug("notify: queue send: %s\n", rtems_status_text(sc));
+      }
+    }
+    ++delivered;
+  }
+  return delivered;
+}
+
+static void pm_notify_dispatcher(rtems_task_argument arg) {
+  while (true) {
+    pm_ret_payload payload;
+    rtems_pm_notification notification;
+    uint32_t delivered = 0;
+    rtems_counting_semaphore_wait(&notify_work);
+    if (pm_get_callback_data(&payload) < 0) {
+      pm_debug("notify: callback data: %s\n", strerror(errno));
+      continue;
+    }
+    notification.type = payload.r0;
+    notification.node = payload.r1;
+    notification.event = payload.r2;
+    notification.data = payload.r3;
+    pm_debug(
+      "notify: type=%" PRIu32 " node=%08" PRIx32 " event=%08" PRIx32
+      " data=%08" PRIx32 "\n",
+      notification.type, notification.node, notification.event,
+      notification.data);
+    rtems_mutex_lock(&notify_lock);
+    ++notify_stats.callbacks;
+    if (notification.type == PM_NOTIFY_CB) {
+      delivered = pm_notify_deliver(&notification);
+    }
+    if (delivered == 0) {
+      ++notify_stats.unhandled;
+    }
+    notify_stats.delivered += delivered;
+    rtems_mutex_unlock(&notify_lock);
+  }
+}
+
+int rtems_pm_notifier_start(uint32_t sgi, uint32_t priority) {
+  rtems_status_code sc;
+  rtems_id id;
+  int r;
+  rtems_mutex_lock(&notify_lock);
+  if (notify_stats.running) {
+    rtems_mutex_unlock(&notify_lock);
+    errno = EALREADY;
+    return -1;
+  }
+  sc = rtems_task_create(
+    rtems_build_name('P', 'M', 'N', 'T'), priority, PM_NOTIFY_STACK_SIZE,
+    RTEMS_DEFAULT_MODES, RTEMS_DEFAULT_ATTRIBUTES, &id);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_mutex_unlock(&notify_lock);
+    pm_info("notify: task create: %s\n", rtems_status_text(sc));
+    errno = ENOMEM;
+    return -1;
+  }
+  rtems_counting_semaphore_init(&notify_work, "PM Notify Work", 0);
+  sc = rtems_task_start(id, pm_notify_dispatcher, 0);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_task_delete(id);
+    rtems_counting_semaphore_destroy(&notify_work);
+    rtems_mutex_unlock(&notify_lock);
+    pm_info("notify: task start: %s\n", rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  sc = rtems_interrupt_handler_install(
+    sgi, "PM Notify", RTEMS_INTERRUPT_UNIQUE, pm_notify_isr, NULL);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_task_delete(id);
+    rtems_counting_semaphore_destroy(&notify_work);
+    rtems_mutex_unlock(&notify_lock);
+    pm_info("notify: SGI %" PRIu32 " install: %s\n", sgi, rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  notify_stats.running = true;
+  notify_stats.sgi = sgi;
+  r = pm_register_sgi(sgi, false);
+  if (r < 0) {
+    int eno = errno;
+    notify_stats.running = false;
+    rtems_interrupt_handler_remove(sgi, pm_notify_isr, NULL);
+    rtems_task_delete(id);
+    rtems_counting_semaphore_destroy(&notify_work);
+    rtems_mutex_unlock(&notify_lock);
+    pm_info("notify: register SGI %" PRIu32 ": %s\n", sgi, strerror(eno));
+    errno = eno;
+    return -1;
+  }
+  rtems_mutex_unlock(&notify_lock);
+  return 0;
+}
+
+int rtems_pm_notifier_register(rtems_pm_notifier* notifier) {
+  rtems_pm_notifier* n;
+  int r;
+  if (notifier == NULL || notifier->event == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!notify_stats.running) {
+    if (rtems_pm_notifier_start(
+          RTEMS_PM_NOTIFY_SGI, RTEMS_PM_NOTIFY_PRIORITY) < 0 &&
+        errno != EALREADY) {
+      return -1;
+    }
+  }
+  rtems_mutex_lock(&notify_lock);
+  for (n = notifiers; n != NULL; n = n->next) {
+    if (n == notifier) {
+      rtems_mutex_unlock(&notify_lock);
+      errno = EEXIST;
+      return -1;
+    }
+  }
+  r = pm_register_notifier(notifier->node, notifier->event, notifier->wake, true);
+  if (r < 0) {
+    int eno = errno;
+    rtems_mutex_unlock(&notify_lock);
+    errno = eno;
+    return -1;
+  }
+  notifier->count = 0;
+  memset(&notifier->last, 0, sizeof(notifier->last));
+  notifier->next = notifiers;
+  notifiers = notifier;
+  ++notify_stats.notifiers;
+  rtems_mutex_unlock(&notify_lock);
+  return 0;
+}
+
+int rtems_pm_notifier_unregister(rtems_pm_notifier* notifier) {
+  rtems_pm_notifier** link;
+  rtems_pm_notifier* n;
+  uint32_t events;
+  rtems_mutex_lock(&notify_lock);
+  link = &notifiers;
+  while (*link != NULL && *link != notifier) {
+    link = &(*link)->next;
+  }
+  if (*link == NULL) {
+    rtems_mutex_unlock(&notify_lock);
+    errno = ENOENT;
+    return -1;
+  }
+  *link = notifier->next;
+  notifier->next = NULL;
+  --notify_stats.notifiers;
+  /*
+   * Only disable the events no other notifier has for the node.
+   */
+  events = notifier->event;
+  for (n = notifiers; n != NULL; n = n->next) {
+    if (n->node == notifier->node) {
+      events &= ~n->event;
+    }
+  }
+  if (events != 0) {
+    pm_register_notifier(notifier->node, events, notifier->wake, false);
+  }
+  rtems_mutex_unlock(&notify_lock);
+  return 0;
+}
+
+void rtems_pm_notify_get_stats(rtems_pm_notify_stats* stats) {
+  rtems_mutex_lock(&notify_lock);
+  *stats = notify_stats;
+  rtems_mutex_unlock(&notify_lock);
+}
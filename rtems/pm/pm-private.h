@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTEMS_PM_PM_PRIVATE_H
+#define RTEMS_PM_PM_PRIVATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <smc/smccc.h>
+
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The payload returned by a PM call. The firmware's status is in r0.
+ */
+typedef struct {
+  uint32_t r0;
+  uint32_t r1;
+  uint32_t r2;
+  uint32_t r3;
+} pm_ret_payload;
+
+/*
+ * An extended query returns the status and up to 15 words in x0 to x15 so
+ * a paged query returns 5 pages in a call. It is not in the firmware ABI,
+ * the firmware's PM_QUERY_DATA version 2 returns x0 and x1 only, and it
+ * needs a backend that declares it, SMCCC 1.2 and a PM_QUERY_DATA version
+ * of 2 or later.
+ */
+#define PM_QUERY_EXT_WORDS        15
+#define PM_QUERY_DATA_EXT_VERSION 2
+
+typedef struct {
+  uint32_t r0;
+  uint32_t words[PM_QUERY_EXT_WORDS];
+} pm_ret_ext_payload;
+
+/*
+ * A backend makes the SMCCC call. The arguments are the packed 64-bit
+ * registers x1 to x3 and the result is the payload packed in x0 and x1 as
+ * TF-A returns it. The extended call is an SMCCC 1.2 call with x0 to x17
+ * and a word in each result register.
+ *
+ * The flags are the calls the backend has that are not in the firmware ABI.
+ *
+ *  FPGA_READ_FRAME: A configuration read starts at the frame in the fifth
+ *                   argument. The firmware has no start frame and reads
+ *                   from the first frame.
+ *  QUERY_EXT      : An extended query returns 15 words.
+ */
+#define PM_BACKEND_FPGA_READ_FRAME (1 << 0)
+#define PM_BACKEND_QUERY_EXT       (1 << 1)
+
+typedef struct {
+  const char* name;
+  uint32_t flags;
+  int (*init)(void);
+  int (*call)(
+    uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2,
+    struct arm_smccc_res* res);
+  int (*call_ext)(
+    const struct arm_smccc_1_2_regs* args, struct arm_smccc_1_2_regs* res);
+} pm_backend_ops;
+
+extern const pm_backend_ops pm_backend_smc;
+extern const pm_backend_ops pm_backend_hvc;
+extern const pm_backend_ops pm_backend_sim;
+
+const pm_backend_ops* pm_backend_get(void);
+
+/*
+ * Firmware call trace, recorded by pm_invoke() when on.
+ */
+extern bool pm_call_trace_on;
+
+void pm_call_trace_record(
+  uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2, int ret,
+  const struct arm_smccc_res* res, uint32_t entry, uint32_t exit);
+
+/*
+ * The SMCCC SIP API id translation, the inverse returns PM_API_MAX if the
+ * SIP id is not known.
+ */
+uint32_t pm_sip_api_id(const pm_api_id api_id);
+pm_api_id pm_api_from_sip_id(uint32_t sip_id);
+
+/*
+ * Firmware notifications. The callback data is the callback type, node,
+ * event and data and is not a status. Raise is the notification interrupt
+ * and the simulator raises it to deliver its callbacks.
+ */
+#define PM_NOTIFY_CB 32
+
+int pm_register_notifier(uint32_t node, uint32_t event, bool wake, bool enable);
+int pm_register_sgi(uint32_t sgi, bool reset);
+int pm_get_callback_data(pm_ret_payload* payload);
+void pm_notify_raise(void);
+
+/*
+ * Query, clock and node calls. A clock name query returns the name in r0 to r3
+ * and has no status. The clock tree is reset when the backend changes.
+ */
+int pm_query(
+  uint32_t qid, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+  pm_ret_payload* res);
+int pm_query_ext(
+  uint32_t qid, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+  pm_ret_ext_payload* res);
+void pm_query_ext_reset(void);
+int pm_clock_call(
+  pm_api_id api_id, uint32_t clock, uint32_t arg1, uint32_t arg2,
+  pm_ret_payload* res);
+int pm_node_call(
+  pm_api_id api_id, uint32_t node, uint32_t arg1, uint32_t arg2,
+  uint32_t arg3, pm_ret_payload* res);
+void pm_clock_tree_reset(void);
+
+/*
+ * PDI header checksum sums. The selected sum is NEON on AArch64. The sums
+ * are not inverted.
+ */
+uint32_t pm_checksum_sum(const uint32_t* words, size_t size);
+uint32_t pm_checksum_sum_scalar(const uint32_t* words, size_t size);
+const char* pm_checksum_impl(void);
+
+/*
+ * Load path phase timing. The start is the uptime in nanoseconds and the
+ * record takes the time from the start to now. The 32-bit counter wraps in
+ * seconds and a file read or full load can take longer. The ns variant
+ * records a time already measured.
+ */
+uint64_t pm_phase_start(void);
+void pm_phase_record(rtems_pm_phase phase, uint64_t start);
+void pm_phase_record_ns(rtems_pm_phase phase, uint64_t ns);
+
+/*
+ * Image buffers. The buffer is from the staging arena if there is one with
+ * space else the heap. Uncached is set if the buffer needs no cache
+ * maintenance.
+ */
+void* pm_image_buffer_alloc(size_t size, bool* uncached);
+void pm_image_buffer_free(void* buffer);
+
+/*
+ * Image decoder. The read call fills the buffer from the compressed stream
+ * and returns the bytes read, 0 at the end or -1. The output call is made
+ * as each part of the image is written so it can be checked and cleaned.
+ */
+typedef struct {
+  rtems_pm_image_format format;
+  ssize_t (*read)(void* arg, void* buffer, size_t size);
+  int (*output)(void* arg, size_t offset, size_t size);
+  void* arg;
+  uint8_t* out;
+  size_t out_size;
+} pm_image_decoder;
+
+/*
+ * The decompressed size from the start and the last 4 bytes of a compressed
+ * image.
+ */
+int pm_image_decompressed_size(
+  rtems_pm_image_format format, const void* head, size_t head_size,
+  const void* tail, size_t* size);
+int pm_image_decode(pm_image_decoder* decoder);
+
+/*
+ * Software SHA3-384.
+ */
+#define PM_SHA3_384_RATE 104
+
+typedef struct {
+  uint64_t state[25];
+  size_t offset;
+} pm_sha3_context;
+
+void pm_sha3_init(pm_sha3_context* ctx);
+void pm_sha3_update(pm_sha3_context* ctx, const void* data, size_t size);
+void pm_sha3_final(pm_sha3_context* ctx, uint8_t* digest);
+void pm_sha3_software(const void* data, size_t size, uint8_t* digest);
+
+static inline uint32_t pm_lower_32(uint64_t u64) {
+  return (uint32_t) (u64 & 0xffffffff);
+}
+
+static inline uint32_t pm_upper_32(uint64_t u64) {
+  /*
+   * Shift as 2 x 16 to supress a shift by 32 warning
+   */
+  return (uint32_t) ((u64 >> 16) >> 16);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTEMS_PM_PM_PRIVATE_H */
@@ -0,0 +1,490 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Configuration scrubber.
+ *
+ * Radiation upsets change configuration bits and a periodic full reload is
+ * the only repair without readback. The scrubber task reads each region's
+ * frames back with PM_FPGA_READ a slice at a time and computes the
+ * region's SHA3-384 digest as the slices are read. When the region has
+ * been read the digest is compared with the golden digest and only a
+ * region that does not match is reloaded.
+ *
+ * Dynamic bits are cleared with the region's mask before they are hashed.
+ * A repair is made with the lock released and the region being repaired
+ * cannot be removed.
+ *
+ * The task sleeps after each slice so the frames read follow the frame
+ * rate. The sleep is to a deadline kept in nanoseconds so the rate holds
+ * when a slice is shorter than a clock tick. A task that falls behind
+ * does not read in bursts to catch up.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#define PM_SCRUB_STACK_SIZE (RTEMS_MINIMUM_STACK_SIZE * 2)
+#define PM_SCRUB_STOP_EVENT RTEMS_EVENT_0
+
+static rtems_mutex scrub_lock = RTEMS_MUTEX_INITIALIZER("PM Scrub");
+static rtems_binary_semaphore scrub_stopped =
+  RTEMS_BINARY_SEMAPHORE_INITIALIZER("PM Scrub Stopped");
+static rtems_pm_scrub_region* regions;
+static rtems_pm_scrub_stats scrub_stats;
+static rtems_id scrub_task;
+static bool scrub_stopping;
+static uint8_t* scrub_buffer;
+static uint64_t scrub_started;
+static uint64_t scrub_due;
+
+/*
+ * The region being read, the frames read and the digest so far.
+ */
+static rtems_pm_scrub_region* scrub_region;
+static uint32_t scrub_offset;
+static pm_sha3_context scrub_sha3;
+
+/*
+ * The region being repaired.
+ */
+static rtems_pm_scrub_region* scrub_repair;
+
+static bool pm_scrub_frame_reads(void) {
+  return (pm_backend_get()->flags & PM_BACKEND_FPGA_READ_FRAME) != 0;
+}
+
+/*
+ * Can the region be read in slices of the size.
+ */
+static bool pm_scrub_readable(
+  const rtems_pm_scrub_region* region, uint32_t slice) {
+  return pm_scrub_frame_reads() ||
+    (region->frame == 0 && region->frames <= slice);
+}
+
+static void pm_scrub_mask(
+  const rtems_pm_scrub_region* region, uint32_t offset, uint32_t frames,
+  uint8_t* buffer) {
+  const uint32_t* mask;
+  uint32_t* words = (uint32_t*) buffer;
+  size_t w;
+  if (region->mask == NULL) {
+    return;
+  }
+  mask = region->mask + ((size_t) offset * RTEMS_PM_FPGA_FRAME_WORDS);
+  for (w = 0; w < (size_t) frames * RTEMS_PM_FPGA_FRAME_WORDS; ++w) {
+    words[w] &= ~mask[w];
+  }
+}
+
+/*
+ * Call with the lock released.
+ */
+static void pm_scrub_repair(rtems_pm_scrub_region* region) {
+  uint32_t status = 0;
+  int r;
+  if (region->acap) {
+    r = rtems_pm_acap_reload(region->image, region->size, &status);
+  } else {
+    r = rtems_pm_fpga_load(
+      region->image, region->size, region->flags | PM_FPGA_PARTIAL, &status);
+  }
+  rtems_mutex_lock(&scrub_lock);
+  if (r < 0) {
+    ++scrub_stats.repair_errors;
+    pm_info(
+      "scrub: %s: repair: %s (status=%08" PRIx32 ")\n",
+      region->name, strerror(errno), status);
+  } else {
+    ++region->repairs;
+    ++scrub_stats.repairs;
+  }
+  scrub_repair = NULL;
+  rtems_mutex_unlock(&scrub_lock);
+}
+
+/*
+ * Read the next slice. Call with the lock held. Returns the frames read and
+ * the region to repair is set if a region with an image has an upset.
+ */
+static uint32_t pm_scrub_slice(rtems_pm_scrub_region** repair) {
+  rtems_pm_scrub_region* region;
+  uint64_t start;
+  uint32_t frames;
+  if (scrub_region == NULL) {
+    scrub_region = regions;
+    scrub_offset = 0;
+    if (scrub_region == NULL) {
+      return 0;
+    }
+  }
+  region = scrub_region;
+  frames = region->frames - scrub_offset;
+  if (frames > scrub_stats.slice_frames) {
+    frames = scrub_stats.slice_frames;
+  }
+  start = rtems_clock_get_uptime_nanoseconds();
+  if (scrub_offset == 0) {
+    pm_sha3_init(&scrub_sha3);
+  }
+  if (rtems_pm_fpga_read(region->frame + scrub_offset, frames, scrub_buffer) < 0) {
+    ++scrub_stats.read_errors;
+    pm_debug(
+      "scrub: %s: read: frame %08" PRIx32 ": %s\n",
+      region->name, region->frame + scrub_offset, strerror(errno));
+    scrub_region = region->next;
+    scrub_offset = 0;
+    return frames;
+  }
+  pm_scrub_mask(region, scrub_offset, frames, scrub_buffer);
+  pm_sha3_update(&scrub_sha3, scrub_buffer, frames * RTEMS_PM_FPGA_FRAME_SIZE);
+  scrub_offset += frames;
+  scrub_stats.frames += frames;
+  if (scrub_offset == region->frames) {
+    uint8_t digest[RTEMS_PM_SHA3_384_SIZE];
+    pm_sha3_final(&scrub_sha3, digest);
+    scrub_stats.busy_ns += rtems_clock_get_uptime_nanoseconds() - start;
+    ++region->checks;
+    ++scrub_stats.checks;
+    if (memcmp(digest, region->digest, sizeof(digest)) != 0) {
+      ++region->upsets;
+      ++scrub_stats.upsets;
+      pm_info(
+        "scrub: %s: upset: frames %08" PRIx32 "-%08" PRIx32 "\n",
+        region->name, region->frame, region->frame + region->frames - 1);
+      if (region->image != NULL) {
+        scrub_repair = region;
+        *repair = region;
+      }
+    }
+    scrub_region = region->next;
+    scrub_offset = 0;
+    if (scrub_region == NULL) {
+      ++scrub_stats.passes;
+    }
+  } else {
+    scrub_stats.busy_ns += rtems_clock_get_uptime_nanoseconds() - start;
+  }
+  return frames;
+}
+
+/*
+ * The ticks to the next slice's deadline, 0 if it is due.
+ */
+static rtems_interval pm_scrub_ticks(uint32_t frames) {
+  const uint64_t tick = rtems_configuration_get_nanoseconds_per_tick();
+  const uint64_t now = rtems_clock_get_uptime_nanoseconds();
+  if (frames == 0) {
+    scrub_due = now + 1000000000ULL;
+  } else {
+    scrub_due +=
+      ((uint64_t) frames * 1000000000ULL) / scrub_stats.frames_per_sec;
+  }
+  if (scrub_due <= now) {
+    scrub_due = now;
+    return 0;
+  }
+  return (rtems_interval) ((scrub_due - now + tick - 1) / tick);
+}
+
+static void pm_scrub_task(rtems_task_argument arg) {
+  while (true) {
+    rtems_pm_scrub_region* repair = NULL;
+    rtems_event_set events;
+    rtems_interval ticks;
+    uint32_t frames;
+    rtems_mutex_lock(&scrub_lock);
+    if (scrub_stopping) {
+      rtems_mutex_unlock(&scrub_lock);
+      break;
+    }
+    frames = pm_scrub_slice(&repair);
+    ticks = pm_scrub_ticks(frames);
+    rtems_mutex_unlock(&scrub_lock);
+    if (repair != NULL) {
+      pm_scrub_repair(repair);
+    }
+    if (ticks == 0) {
+      rtems_task_wake_after(RTEMS_YIELD_PROCESSOR);
+    } else {
+      rtems_event_receive(
+        PM_SCRUB_STOP_EVENT, RTEMS_EVENT_ANY | RTEMS_WAIT, ticks, &events);
+    }
+  }
+  rtems_binary_semaphore_post(&scrub_stopped);
+  rtems_task_exit();
+}
+
+static int pm_scrub_read_digest(
+  const rtems_pm_scrub_region* region, uint8_t* buffer, uint32_t slice,
+  uint8_t* digest) {
+  pm_sha3_context ctx;
+  uint32_t offset = 0;
+  pm_sha3_init(&ctx);
+  while (offset < region->frames) {
+    uint32_t frames = region->frames - offset;
+    if (frames > slice) {
+      frames = slice;
+    }
+    if (rtems_pm_fpga_read(region->frame + offset, frames, buffer) < 0) {
+      return -1;
+    }
+    pm_scrub_mask(region, offset, frames, buffer);
+    pm_sha3_update(&ctx, buffer, frames * RTEMS_PM_FPGA_FRAME_SIZE);
+    offset += frames;
+  }
+  pm_sha3_final(&ctx, digest);
+  return 0;
+}
+
+/*
+ * The slice size regions are checked against, the running slice or the
+ * default.
+ */
+static uint32_t pm_scrub_slice_frames(void) {
+  return scrub_stats.running ?
+    scrub_stats.slice_frames : RTEMS_PM_SCRUB_SLICE_FRAMES;
+}
+
+int rtems_pm_scrub_region_capture(rtems_pm_scrub_region* region) {
+  uint32_t slice = RTEMS_PM_SCRUB_SLICE_FRAMES;
+  uint8_t* buffer;
+  int r;
+  if (region == NULL || region->frames == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!pm_scrub_frame_reads()) {
+    if (region->frame != 0) {
+      errno = ENOTSUP;
+      return -1;
+    }
+    slice = region->frames;
+  }
+  buffer = rtems_cache_aligned_malloc(slice * RTEMS_PM_FPGA_FRAME_SIZE);
+  if (buffer == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  rtems_mutex_lock(&scrub_lock);
+  r = pm_scrub_read_digest(region, buffer, slice, region->digest);
+  if (region == scrub_region) {
+    scrub_offset = 0;
+  }
+  rtems_mutex_unlock(&scrub_lock);
+  free(buffer);
+  return r;
+}
+
+int rtems_pm_scrub_region_add(rtems_pm_scrub_region* region) {
+  rtems_pm_scrub_region** next;
+  if (region == NULL || region->frames == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  rtems_mutex_lock(&scrub_lock);
+  if (!pm_scrub_readable(region, pm_scrub_slice_frames())) {
+    rtems_mutex_unlock(&scrub_lock);
+    pm_info(
+      "scrub: %s: region cannot be read: frame %08" PRIx32 " frames %" PRIu32
+      "\n", region->name, region->frame, region->frames);
+    errno = ENOTSUP;
+    return -1;
+  }
+  for (next = &regions; *next != NULL; next = &(*next)->next) {
+    if (*next == region) {
+      rtems_mutex_unlock(&scrub_lock);
+      errno = EEXIST;
+      return -1;
+    }
+  }
+  region->next = NULL;
+  region->checks = 0;
+  region->upsets = 0;
+  region->repairs = 0;
+  *next = region;
+  ++scrub_stats.regions;
+  rtems_mutex_unlock(&scrub_lock);
+  return 0;
+}
+
+int rtems_pm_scrub_region_remove(rtems_pm_scrub_region* region) {
+  rtems_pm_scrub_region** next;
+  rtems_mutex_lock(&scrub_lock);
+  if (region == scrub_repair) {
+    rtems_mutex_unlock(&scrub_lock);
+    errno = EBUSY;
+    return -1;
+  }
+  for (next = &regions; *next != NULL; next = &(*next)->next) {
+    if (*next == region) {
+      *next = region->next;
+      if (scrub_region == region) {
+        scrub_region = region->next;
+        scrub_offset = 0;
+      }
+      region->next = NULL;
+      --scrub_stats.regions;
+      rtems_mutex_unlock(&scrub_lock);
+      return 0;
+    }
+  }
+  rtems_mutex_unlock(&scrub_lock);
+  errno = ENOENT;
+  return -1;
+}
+
+int rtems_pm_scrub_start(
+  uint32_t priority, uint32_t slice_frames, uint32_t frames_per_sec) {
+  const rtems_pm_scrub_region* region;
+  rtems_status_code sc;
+  rtems_id id;
+  if (slice_frames == 0 || frames_per_sec == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  rtems_mutex_lock(&scrub_lock);
+  if (scrub_stats.running) {
+    rtems_mutex_unlock(&scrub_lock);
+    errno = EALREADY;
+    return -1;
+  }
+  for (region = regions; region != NULL; region = region->next) {
+    if (!pm_scrub_readable(region, slice_frames)) {
+      rtems_mutex_unlock(&scrub_lock);
+      pm_info("scrub: %s: region larger than the slice\n", region->name);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  scrub_buffer =
+    rtems_cache_aligned_malloc(slice_frames * RTEMS_PM_FPGA_FRAME_SIZE);
+  if (scrub_buffer == NULL) {
+    rtems_mutex_unlock(&scrub_lock);
+    errno = ENOMEM;
+    return -1;
+  }
+  sc = rtems_task_create(
+    rtems_build_name('P', 'M', 'S', 'C'), priority, PM_SCRUB_STACK_SIZE,
+    RTEMS_DEFAULT_MODES, RTEMS_DEFAULT_ATTRIBUTES, &id);
+  if (sc != RTEMS_SUCCESSFUL) {
+    free(scrub_buffer);
+    scrub_buffer = NULL;
+    rtems_mutex_unlock(&scrub_lock);
+    pm_info("scrub: task create: %s\n", rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  scrub_stats.slice_frames = slice_frames;
+  scrub_stats.frames_per_sec = frames_per_sec;
+  scrub_stats.running = true;
+  scrub_stopping = false;
+  scrub_region = NULL;
+  scrub_offset = 0;
+  scrub_started = rtems_clock_get_uptime_nanoseconds();
+  scrub_due = scrub_started;
+  scrub_task = id;
+  sc = rtems_task_start(id, pm_scrub_task, 0);
+  if (sc != RTEMS_SUCCESSFUL) {
+    rtems_task_delete(id);
+    free(scrub_buffer);
+    scrub_buffer = NULL;
+    scrub_stats.running = false;
+    rtems_mutex_unlock(&scrub_lock);
+    pm_info("scrub: task start: %s\n", rtems_status_text(sc));
+    errno = EIO;
+    return -1;
+  }
+  rtems_mutex_unlock(&scrub_lock);
+  return 0;
+}
+
+int rtems_pm_scrub_stop(void) {
+  rtems_mutex_lock(&scrub_lock);
+  if (!scrub_stats.running || scrub_stopping) {
+    rtems_mutex_unlock(&scrub_lock);
+    errno = ESRCH;
+    return -1;
+  }
+  scrub_stopping = true;
+  rtems_event_send(scrub_task, PM_SCRUB_STOP_EVENT);
+  rtems_mutex_unlock(&scrub_lock);
+  rtems_binary_semaphore_wait(&scrub_stopped);
+  rtems_mutex_lock(&scrub_lock);
+  scrub_stats.run_ns += rtems_clock_get_uptime_nanoseconds() - scrub_started;
+  scrub_stats.running = false;
+  scrub_stopping = false;
+  scrub_region = NULL;
+  free(scrub_buffer);
+  scrub_buffer = NULL;
+  rtems_mutex_unlock(&scrub_lock);
+  return 0;
+}
+
+void rtems_pm_scrub_iterate(
+  void (*visitor)(const rtems_pm_scrub_region* region, void* arg), void* arg) {
+  const rtems_pm_scrub_region* region;
+  rtems_mutex_lock(&scrub_lock);
+  for (region = regions; region != NULL; region = region->next) {
+    visitor(region, arg);
+  }
+  rtems_mutex_unlock(&scrub_lock);
+}
+
+void rtems_pm_scrub_get_stats(rtems_pm_scrub_stats* stats) {
+  rtems_mutex_lock(&scrub_lock);
+  *stats = scrub_stats;
+  if (scrub_stats.running) {
+    stats->run_ns += rtems_clock_get_uptime_nanoseconds() - scrub_started;
+  }
+  rtems_mutex_unlock(&scrub_lock);
+}
+
+void rtems_pm_scrub_reset_stats(void) {
+  rtems_mutex_lock(&scrub_lock);
+  scrub_stats.frames = 0;
+  scrub_stats.passes = 0;
+  scrub_stats.checks = 0;
+  scrub_stats.upsets = 0;
+  scrub_stats.repairs = 0;
+  scrub_stats.repair_errors = 0;
+  scrub_stats.read_errors = 0;
+  scrub_stats.busy_ns = 0;
+  scrub_stats.run_ns = 0;
+  scrub_started = rtems_clock_get_uptime_nanoseconds();
+  rtems_mutex_unlock(&scrub_lock);
+}
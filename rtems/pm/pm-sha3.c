@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * SHA3-384 in software.
+ *
+ * This is the fallback when the PMC SHA3 engine cannot be used and it is the
+ * engine the simulator uses. The state is kept as 25 64bit lanes and the
+ * input is absorbed a lane at a time so the block loop works with unaligned
+ * data.
+ */
+
+#include <string.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+
+#define PM_SHA3_ROUNDS 24
+
+static const uint64_t keccak_rc[PM_SHA3_ROUNDS] = {
+  UINT64_C(0x0000000000000001), UINT64_C(0x0000000000008082),
+  UINT64_C(0x800000000000808a), UINT64_C(0x8000000080008000),
+  UINT64_C(0x000000000000808b), UINT64_C(0x0000000080000001),
+  UINT64_C(0x8000000080008081), UINT64_C(0x8000000000008009),
+  UINT64_C(0x000000000000008a), UINT64_C(0x0000000000000088),
+  UINT64_C(0x0000000080008009), UINT64_C(0x000000008000000a),
+  UINT64_C(0x000000008000808b), UINT64_C(0x800000000000008b),
+  UINT64_C(0x8000000000008089), UINT64_C(0x8000000000008003),
+  UINT64_C(0x8000000000008002), UINT64_C(0x8000000000000080),
+  UINT64_C(0x000000000000800a), UINT64_C(0x800000008000000a),
+  UINT64_C(0x8000000080008081), UINT64_C(0x8000000000008080),
+  UINT64_C(0x0000000080000001), UINT64_C(0x8000000080008008)
+};
+
+static const uint8_t keccak_rotc[PM_SHA3_ROUNDS] = {
+  1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14,
+  27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+
+static const uint8_t keccak_piln[PM_SHA3_ROUNDS] = {
+  10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4,
+  15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+static uint64_t pm_sha3_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t pm_sha3_le64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static void pm_sha3_keccakf(uint64_t st[25]) {
+  uint64_t bc0, bc1, bc2, bc3, bc4;
+  uint64_t d0, d1, d2, d3, d4;
+  uint64_t t;
+  int round;
+  int i;
+  int j;
+  for (round = 0; round < PM_SHA3_ROUNDS; ++round) {
+    /* Theta */
+    bc0 = st[0] ^ st[5] ^ st[10] ^ st[15] ^ st[20];
+    bc1 = st[1] ^ st[6] ^ st[11] ^ st[16] ^ st[21];
+    bc2 = st[2] ^ st[7] ^ st[12] ^ st[17] ^ st[22];
+    bc3 = st[3] ^ st[8] ^ st[13] ^ st[18] ^ st[23];
+    bc4 = st[4] ^ st[9] ^ st[14] ^ st[19] ^ st[24];
+    d0 = bc4 ^ pm_sha3_rotl(bc1, 1);
+    d1 = bc0 ^ pm_sha3_rotl(bc2, 1);
+    d2 = bc1 ^ pm_sha3_rotl(bc3, 1);
+    d3 = bc2 ^ pm_sha3_rotl(bc4, 1);
+    d4 = bc3 ^ pm_sha3_rotl(bc0, 1);
+    for (j = 0; j < 25; j += 5) {
+      st[j] ^= d0;
+      st[j + 1] ^= d1;
+      st[j + 2] ^= d2;
+      st[j + 3] ^= d3;
+      st[j + 4] ^= d4;
+    }
+    /* Rho and pi */
+    t = st[1];
+    for (i = 0; i < PM_SHA3_ROUNDS; ++i) {
+      j = keccak_piln[i];
+      bc0 = st[j];
+      st[j] = pm_sha3_rotl(t, keccak_rotc[i]);
+      t = bc0;
+    }
+    /* Chi */
+    for (j = 0; j < 25; j += 5) {
+      bc0 = st[j];
+      bc1 = st[j + 1];
+      bc2 = st[j + 2];
+      bc3 = st[j + 3];
+      bc4 = st[j + 4];
+      st[j] = bc0 ^ (~bc1 & bc2);
+      st[j + 1] = bc1 ^ (~bc2 & bc3);
+      st[j + 2] = bc2 ^ (~bc3 & bc4);
+      st[j + 3] = bc3 ^ (~bc4 & bc0);
+      st[j + 4] = bc4 ^ (~bc0 & bc1);
+    }
+    /* Iota */
+    st[0] ^= keccak_rc[round];
+  }
+}
+
+void pm_sha3_init(pm_sha3_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void pm_sha3_update(pm_sha3_context* ctx, const void* data, size_t size) {
+  const uint8_t* in = data;
+  while (size > 0) {
+    /*
+     * Absorb whole blocks directly.
+     */
+    if (ctx->offset == 0 && size >= PM_SHA3_384_RATE) {
+      size_t lane;
+      for (lane = 0; lane < PM_SHA3_384_RATE / 8; ++lane) {
+        ctx->state[lane] ^= pm_sha3_le64(in + lane * 8);
+      }
+      pm_sha3_keccakf(ctx->state);
+      in += PM_SHA3_384_RATE;
+      size -= PM_SHA3_384_RATE;
+      continue;
+    }
+    /*
+     * Whole lanes at a time when the block is lane aligned.
+     */
+    if (ctx->offset % 8 == 0 && size >= 8) {
+      ctx->state[ctx->offset / 8] ^= pm_sha3_le64(in);
+      ctx->offset += 8;
+      in += 8;
+      size -= 8;
+    } else {
+      ctx->state[ctx->offset / 8] ^=
+        ((uint64_t) *in) << (8 * (ctx->offset % 8));
+      ++ctx->offset;
+      ++in;
+      --size;
+    }
+    if (ctx->offset == PM_SHA3_384_RATE) {
+      pm_sha3_keccakf(ctx->state);
+      ctx->offset = 0;
+    }
+  }
+}
+
+void pm_sha3_final(pm_sha3_context* ctx, uint8_t* digest) {
+  size_t b;
+  ctx->state[ctx->offset / 8] ^= UINT64_C(0x06) << (8 * (ctx->offset % 8));
+  ctx->state[(PM_SHA3_384_RATE - 1) / 8] ^=
+    UINT64_C(0x80) << (8 * ((PM_SHA3_384_RATE - 1) % 8));
+  pm_sha3_keccakf(ctx->state);
+  for (b = 0; b < RTEMS_PM_SHA3_384_SIZE; ++b) {
+    digest[b] = (uint8_t) (ctx->state[b / 8] >> (8 * (b % 8)));
+  }
+}
+
+void pm_sha3_software(const void* data, size_t size, uint8_t* digest) {
+  pm_sha3_context ctx;
+  pm_sha3_init(&ctx);
+  pm_sha3_update(&ctx, data, size);
+  pm_sha3_final(&ctx, digest);
+}
@@ -32,14 +32,18 @@
 #include <unistd.h>
 
 #include <rtems.h>
+#include <rtems/counter.h>
 #include <rtems/error.h>
 #include <rtems/shell.h>
 
 #include <rtems/pm/pm.h>
 #include <rtems/pm/pm-image.h>
 
+#include "pm-private.h"
 #include "pm-trace.h"
 
+#include "xilpdi.h"
+
 typedef struct
 {
   const char* subcmd;
@@ -131,64 +135,17 @@ static const char* api_id_labels[PM_API_MAX] = {
   "PM_BBRAM_LOCK_USERDATA",
 };
 
-typedef struct {
-  void* image;
-  size_t size;
-} image_loader;
-
-static int pm_image_load(const char* name, image_loader* image) {
-  struct stat sb;
-  char* in;
-  ssize_t size;
-  int fd;
+static int pm_image_load(const char* name, uint32_t flags, rtems_pm_image* image) {
   int r;
-  image->image = NULL;
-  image->size = 0;
-  r = stat(name, &sb);
+  r = rtems_pm_image_load(name, flags, image);
   if (r < 0) {
-    printf("error: stat: %s: %s\n", name, strerror(errno));
+    printf("error: load: %s: %s\n", name, strerror(errno));
     return errno;
   }
-  image->size = sb.st_size;
-  image->image = malloc(image->size);
-  if (image->image == NULL) {
-    printf("error: no memory for image buffer\n");
-    return ENOMEM;
-  }
   printf("load: %s size: %zu bytes\n", name, image->size);
-  fd = open(name, O_RDONLY);
-  if (fd < 0) {
-    free(image->image);
-    printf("error: open: %s: %s\n", name, strerror(errno));
-    return errno;
-  }
-  #define LOAD_BLOCK_SIZE (32 * 1024)
-  in = image->image;
-  size = image->size;
-  while (size > 0) {
-    ssize_t block = size > LOAD_BLOCK_SIZE ? LOAD_BLOCK_SIZE : size;
-    ssize_t read_in = read(fd, in, block);
-    if (read_in != block) {
-      close(fd);
-      free(image->image);
-      if (read_in < 0) {
-        printf("error: read: %s: %s\n", name, strerror(errno));
-        return errno;
-      }
-      printf("error: read: %s: block read too small\n", name);
-      return EIO;
-    }
-    size -= block;
-    in += block;
-  }
-  close(fd);
   return 0;
 }
 
-static void pm_image_free(image_loader* image) {
-  free(image->image);
-}
-
 static int pm_subcmd_help(
   const char* command, const pm_shell_subcmd subcmds[], const size_t count,
   int argc, char* argv[]) {
@@ -280,20 +237,259 @@ static int pm_subcmd_chipid(int argc, char *argv[]) {
   return 0;
 }
 
+static int pm_subcmd_backend(int argc, char *argv[]) {
+  rtems_pm_backend_id id;
+  int r;
+  --argc;
+  ++argv;
+  if (argc == 0) {
+    printf("PM backend: %s\n", rtems_pm_backend_name(rtems_pm_backend_current()));
+    return 0;
+  }
+  if (argc != 1) {
+    printf("error: backend: invalid command line\n");
+    return 1;
+  }
+  r = rtems_pm_backend_find(argv[0], &id);
+  if (r < 0) {
+    printf("error: backend: not found: %s\n", argv[0]);
+    return 1;
+  }
+  r = rtems_pm_backend_select(id);
+  if (r < 0) {
+    printf("error: backend: %s: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+  printf("PM backend: %s\n", rtems_pm_backend_name(id));
+  return 0;
+}
+
+static int pm_subcmd_readahead(int argc, char *argv[]) {
+  uint32_t depth;
+  uint32_t priority;
+  --argc;
+  ++argv;
+  rtems_pm_image_read_ahead_get(&depth, &priority);
+  if (argc > 2) {
+    printf("error: readahead: invalid command line\n");
+    return 1;
+  }
+  if (argc > 0) {
+    char* end;
+    depth = strtoul(argv[0], &end, 0);
+    if (*end != '\0') {
+      printf("error: readahead: invalid depth: %s\n", argv[0]);
+      return 1;
+    }
+    if (argc > 1) {
+      priority = strtoul(argv[1], &end, 0);
+      if (*end != '\0') {
+        printf("error: readahead: invalid priority: %s\n", argv[1]);
+        return 1;
+      }
+    }
+    if (rtems_pm_image_read_ahead_set(depth, priority) < 0) {
+      printf("error: readahead: %s\n", strerror(errno));
+      return 1;
+    }
+  }
+  printf("Image read ahead: depth: %" PRIu32 " priority: ", depth);
+  if (priority == 0) {
+    printf("loader\n");
+  } else {
+    printf("%" PRIu32 "\n", priority);
+  }
+  return 0;
+}
+
+static int pm_parse_digest(const char* hex, uint8_t* digest) {
+  size_t b;
+  if (strlen(hex) != RTEMS_PM_SHA3_384_SIZE * 2) {
+    return -1;
+  }
+  for (b = 0; b < RTEMS_PM_SHA3_384_SIZE; ++b) {
+    char byte[3] = { hex[b * 2], hex[b * 2 + 1], '\0' };
+    char* end;
+    digest[b] = (uint8_t) strtoul(byte, &end, 16);
+    if (*end != '\0') {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void pm_print_digest(const uint8_t* digest) {
+  size_t b;
+  for (b = 0; b < RTEMS_PM_SHA3_384_SIZE; ++b) {
+    printf("%02x", digest[b]);
+  }
+}
+
+static int pm_subcmd_sha3(int argc, char *argv[]) {
+  rtems_pm_image image;
+  uint8_t digest[RTEMS_PM_SHA3_384_SIZE];
+  rtems_counter_ticks start;
+  uint64_t ns;
+  int r;
+  --argc;
+  ++argv;
+  if (argc >= 2 && strcmp(argv[0], "-e") == 0) {
+    rtems_pm_sha3_engine engine;
+    for (engine = 0; engine < RTEMS_PM_SHA3_MAX; ++engine) {
+      if (strcmp(argv[1], rtems_pm_sha3_engine_name(engine)) == 0) {
+        break;
+      }
+    }
+    if (engine == RTEMS_PM_SHA3_MAX) {
+      printf("error: sha3: invalid engine: %s\n", argv[1]);
+      return 1;
+    }
+    rtems_pm_sha3_engine_set(engine);
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc > 1) {
+    printf("error: sha3: invalid command line\n");
+    return 1;
+  }
+  printf(
+    "SHA3 engine: %s\n",
+    rtems_pm_sha3_engine_name(rtems_pm_sha3_engine_get()));
+  if (argc == 0) {
+    return 0;
+  }
+  r = pm_image_load(argv[0], 0, &image);
+  if (r != 0) {
+    return 1;
+  }
+  start = rtems_counter_read();
+  r = rtems_pm_sha3_digest(image.image, image.size, digest);
+  ns = rtems_counter_ticks_to_nanoseconds(
+    rtems_counter_difference(rtems_counter_read(), start));
+  rtems_pm_image_free(&image);
+  if (r < 0) {
+    printf("error: sha3: %s\n", strerror(errno));
+    return 1;
+  }
+  pm_print_digest(digest);
+  printf(
+    "  %s\n %" PRIu64 " us, %" PRIu64 " MB/s\n", argv[0], ns / 1000,
+    ns == 0 ? 0 : ((uint64_t) image.size * 1000) / ns);
+  return 0;
+}
+
+static int pm_subcmd_arena(int argc, char *argv[]) {
+  rtems_pm_arena_stats stats;
+  --argc;
+  ++argv;
+  if (argc > 0) {
+    uint32_t flags = 0;
+    size_t size;
+    char* end;
+    if (strcmp(argv[0], "create") != 0 || argc < 2 || argc > 3) {
+      printf("error: arena: invalid command line\n");
+      return 1;
+    }
+    size = strtoul(argv[1], &end, 0);
+    if (*end == 'k' || *end == 'K') {
+      size *= 1024;
+      ++end;
+    } else if (*end == 'm' || *end == 'M') {
+      size *= 1024 * 1024;
+      ++end;
+    }
+    if (*end != '\0' || size == 0) {
+      printf("error: arena: invalid size: %s\n", argv[1]);
+      return 1;
+    }
+    if (argc > 2) {
+      if (strcmp(argv[2], "-u") != 0) {
+        printf("error: arena: invalid option: %s\n", argv[2]);
+        return 1;
+      }
+      flags |= RTEMS_PM_ARENA_UNCACHED;
+    }
+    if (rtems_pm_arena_create(size, flags) < 0) {
+      printf("error: arena: create: %s\n", strerror(errno));
+      return 1;
+    }
+  }
+  if (!rtems_pm_arena_active()) {
+    printf("Image arena: none\n");
+    return 0;
+  }
+  rtems_pm_arena_get_stats(&stats);
+  printf(
+    "Image arena: %s\n"
+    "        size: %zu\n"
+    "        used: %zu\n"
+    "        peak: %zu\n"
+    "largest free: %zu\n"
+    "      blocks: %" PRIu32 "\n"
+    "      allocs: %" PRIu64 "\n"
+    "    failures: %" PRIu64 "\n",
+    stats.uncached ? "uncached" : "cached",
+    stats.size, stats.used, stats.peak, stats.largest_free,
+    stats.blocks, stats.allocs, stats.failures);
+  return 0;
+}
+
+static int pm_subcmd_clean(int argc, char *argv[]) {
+  rtems_pm_clean_strategy strategy;
+  if (argc > 2) {
+    printf("error: clean: invalid command line\n");
+    return 1;
+  }
+  if (argc == 2) {
+    for (strategy = 0; strategy < RTEMS_PM_CLEAN_MAX; ++strategy) {
+      if (strcmp(argv[1], rtems_pm_clean_strategy_name(strategy)) == 0) {
+        break;
+      }
+    }
+    if (strategy == RTEMS_PM_CLEAN_MAX) {
+      printf("error: clean: invalid strategy: %s\n", argv[1]);
+      return 1;
+    }
+    rtems_pm_clean_strategy_set(strategy);
+  }
+  printf(
+    "Cache clean strategy: %s\n",
+    rtems_pm_clean_strategy_name(rtems_pm_clean_strategy_get()));
+  return 0;
+}
+
 static int pm_subcmd_features(int argc, char *argv[]) {
+  rtems_pm_caps caps;
   uint32_t i;
   size_t max = 0;
+  if (argc > 2 || (argc == 2 && strcmp(argv[1], "probe") != 0)) {
+    printf("error: features: invalid command line\n");
+    return 1;
+  }
+  if (argc == 2) {
+    rtems_pm_caps_probe();
+  }
+  rtems_pm_caps_snapshot(&caps);
   for (i = 0; i < NUMOF(api_id_labels); ++i) {
     size_t len = strlen(api_id_labels[i]);
     if (len > max) {
       max = len;
     }
   }
+  printf(
+    "Capabilities: generation %" PRIu32 ", %s, probe %" PRIu64 " usecs\n",
+    caps.generation, rtems_pm_backend_name(caps.backend),
+    caps.probe_ns / 1000);
   for (i = 0; i < NUMOF(api_id_labels); ++i) {
-    rtems_pm_feature_check(i);
-    printf(
-      "%-*s (0x%04" PRIx32 ") : %s\n", (int) max,
-      api_id_labels[i], rtems_pm_get_api_id(i), strerror(errno));
+    if ((caps.present[i / 64] & (UINT64_C(1) << (i % 64))) != 0) {
+      printf(
+        "%-*s (0x%04" PRIx32 ") : present, version %" PRIu32 "\n", (int) max,
+        api_id_labels[i], rtems_pm_get_api_id(i), caps.version[i]);
+    } else {
+      printf(
+        "%-*s (0x%04" PRIx32 ") : %s\n", (int) max,
+        api_id_labels[i], rtems_pm_get_api_id(i), strerror(caps.error[i]));
+    }
   }
   return 0;
 }
@@ -301,7 +497,7 @@ static int pm_subcmd_features(int argc, char *argv[]) {
 static int pm_subcmd_fpga_load(int argc, char *argv[]) {
   uint32_t flags = PM_FPGA_FULL;
   uint32_t status;
-  image_loader image;
+  rtems_pm_image image;
   int r;
   --argc;
   ++argv;
@@ -367,12 +563,12 @@ static int pm_subcmd_fpga_load(int argc, char *argv[]) {
       return 1;
     }
   }
-  r = pm_image_load(argv[0], &image);
+  r = pm_image_load(argv[0], 0, &image);
   if (r != 0) {
     return 1;
   }
   r = rtems_pm_fpga_load(image.image, image.size, flags, &status);
-  pm_image_free(&image);
+  rtems_pm_image_free(&image);
   if (r < 0) {
     printf("error: fpga: load: %s\n", strerror(errno));
     return 1;
@@ -392,6 +588,110 @@ static int pm_subcmd_fpga_status(int argc, char *argv[]) {
   return 0;
 }
 
+static int pm_subcmd_reset(int argc, char *argv[]) {
+  static const char* actions[RTEMS_PM_RESET_MAX] = {
+    "release", "assert", "pulse"
+  };
+  uint32_t reset;
+  bool asserted;
+  char* end;
+  int action;
+  if (argc != 2 && argc != 3) {
+    printf("error: reset: invalid command line\n");
+    return 1;
+  }
+  reset = strtoul(argv[1], &end, 0);
+  if (*end != '\0') {
+    printf("error: reset: invalid reset: %s\n", argv[1]);
+    return 1;
+  }
+  if (argc == 3) {
+    for (action = 0; action < RTEMS_PM_RESET_MAX; ++action) {
+      if (strcmp(argv[2], actions[action]) == 0) {
+        break;
+      }
+    }
+    if (action == RTEMS_PM_RESET_MAX) {
+      printf("error: reset: invalid action: %s\n", argv[2]);
+      return 1;
+    }
+    if (rtems_pm_reset(reset, action) < 0) {
+      printf("error: reset: %s: %s\n", argv[2], strerror(errno));
+      return 1;
+    }
+  }
+  if (rtems_pm_reset_get_status(reset, &asserted) < 0) {
+    printf("error: reset: status: %s\n", strerror(errno));
+    return 1;
+  }
+  printf("Reset: %08" PRIx32 ": %s\n", reset, asserted ? "asserted" : "released");
+  return 0;
+}
+
+static int pm_subcmd_mmio_read(int argc, char *argv[]) {
+  uint32_t address;
+  uint32_t value;
+  char* end;
+  if (argc != 2) {
+    printf("error: mmio: read: invalid command line\n");
+    return 1;
+  }
+  address = strtoul(argv[1], &end, 0);
+  if (*end != '\0') {
+    printf("error: mmio: read: invalid address: %s\n", argv[1]);
+    return 1;
+  }
+  if (rtems_pm_mmio_read(address, &value) < 0) {
+    printf("error: mmio: read: %s\n", strerror(errno));
+    return 1;
+  }
+  printf("%08" PRIx32 ": %08" PRIx32 "\n", address, value);
+  return 0;
+}
+
+static int pm_subcmd_mmio_write(int argc, char *argv[]) {
+  uint32_t address;
+  uint32_t value;
+  uint32_t mask = 0xffffffff;
+  char* end;
+  if (argc != 3 && argc != 4) {
+    printf("error: mmio: write: invalid command line\n");
+    return 1;
+  }
+  address = strtoul(argv[1], &end, 0);
+  if (*end != '\0') {
+    printf("error: mmio: write: invalid address: %s\n", argv[1]);
+    return 1;
+  }
+  value = strtoul(argv[2], &end, 0);
+  if (*end != '\0') {
+    printf("error: mmio: write: invalid value: %s\n", argv[2]);
+    return 1;
+  }
+  if (argc == 4) {
+    mask = strtoul(argv[3], &end, 0);
+    if (*end != '\0') {
+      printf("error: mmio: write: invalid mask: %s\n", argv[3]);
+      return 1;
+    }
+  }
+  if (rtems_pm_mmio_write(address, mask, value) < 0) {
+    printf("error: mmio: write: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static pm_shell_subcmd mmio_subcmds[] = {
+  { "read", "Read a secure register: ADDR", pm_subcmd_mmio_read, NULL },
+  { "write", "Write a secure register: ADDR VALUE [MASK]", pm_subcmd_mmio_write, NULL },
+};
+
+static int pm_subcmd_mmio(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], mmio_subcmds, NUMOF(mmio_subcmds), argc - 1, argv + 1);
+}
+
 static pm_shell_subcmd fpga_subcmds[] = {
   { "load", "Load the PFGA bitfile", pm_subcmd_fpga_load, NULL },
   { "status", "Print FPGA status", pm_subcmd_fpga_status, NULL },
@@ -402,8 +702,37 @@ static int pm_subcmd_fpga(int argc, char *argv[]) {
     argv[0], fpga_subcmds, NUMOF(fpga_subcmds), argc - 1, argv + 1);
 }
 
+/*
+ * Load through the loader task and wait for the completion event.
+ */
+static int pm_acap_load_async(
+  rtems_pm_image* image, const uint8_t* digest, uint32_t* status) {
+  rtems_pm_acap_request req = {
+    .image = image,
+    .digest = digest,
+    .task = rtems_task_self(),
+    .events = RTEMS_EVENT_0
+  };
+  rtems_event_set out;
+  int r;
+  r = rtems_pm_acap_load_async(&req);
+  if (r < 0) {
+    return r;
+  }
+  rtems_event_receive(RTEMS_EVENT_0, RTEMS_EVENT_ALL | RTEMS_WAIT, RTEMS_NO_TIMEOUT, &out);
+  printf(
+    "ACAP async: queued: %" PRIu64 " us load: %" PRIu64 " us\n",
+    (req.started - req.queued) / 1000, (req.finished - req.started) / 1000);
+  *status = req.status;
+  errno = req.error;
+  return req.result;
+}
+
 static int pm_subcmd_acap_load(int argc, char *argv[]) {
-  image_loader image;
+  rtems_pm_image* image;
+  uint8_t digest[RTEMS_PM_SHA3_384_SIZE];
+  bool verify = false;
+  bool async = false;
   uint32_t status;
   int r;
   --argc;
@@ -430,6 +759,16 @@ static int pm_subcmd_acap_load(int argc, char *argv[]) {
         }
       } else if (argv[0][1] == '-') {
         if (strcmp(argv[0], "--info") == 0) {
+        } else if (strcmp(argv[0], "--async") == 0) {
+          async = true;
+        } else if (strcmp(argv[0], "--sha3") == 0) {
+          if (argc < 2 || pm_parse_digest(argv[1], digest) < 0) {
+            printf("error: --sha3 needs a SHA3-384 digest in hex\n");
+            return 1;
+          }
+          verify = true;
+          --argc;
+          ++argv;
         } else {
           printf("error: invalid option: %s\n", argv[0]);
           return 1;
@@ -446,12 +785,19 @@ static int pm_subcmd_acap_load(int argc, char *argv[]) {
       return 1;
     }
   }
-  r = pm_image_load(argv[0], &image);
-  if (r != 0) {
+  r = rtems_pm_cache_load_file(argv[0], RTEMS_PM_IMAGE_LOAD_VERIFY, &image);
+  if (r < 0) {
+    printf("error: load: %s: %s\n", argv[0], strerror(errno));
     return 1;
   }
-  r = rtems_pm_acap_load(image.image, image.size, &status);
-  pm_image_free(&image);
+  if (async) {
+    r = pm_acap_load_async(image, verify ? digest : NULL, &status);
+  } else if (verify) {
+    r = rtems_pm_acap_load_verified(image, digest, &status);
+  } else {
+    r = rtems_pm_acap_load_image(image, &status);
+  }
+  rtems_pm_cache_release(image);
   if (r < 0) {
     printf("error: acapi: load: %s\n", strerror(errno));
     return 1;
@@ -461,7 +807,7 @@ static int pm_subcmd_acap_load(int argc, char *argv[]) {
 }
 
 static int pm_subcmd_acap_info(int argc, char *argv[]) {
-  image_loader image;
+  rtems_pm_image image;
   int r;
   --argc;
   ++argv;
@@ -473,18 +819,98 @@ static int pm_subcmd_acap_info(int argc, char *argv[]) {
     printf("error: ACAP file: invalid command line\n");
     return 1;
   }
-  r = pm_image_load(argv[0], &image);
+  r = pm_image_load(argv[0], 0, &image);
   if (r != 0) {
     return 1;
   }
   rtems_pm_acap_print(image.image, image.size);
-  pm_image_free(&image);
+  rtems_pm_image_free(&image);
+  return 0;
+}
+
+static int pm_subcmd_acap_verify(int argc, char *argv[]) {
+  rtems_pm_image image;
+  rtems_pm_pdi_report report;
+  int r;
+  --argc;
+  ++argv;
+  if (argc == 0) {
+    printf("error: ACAP file missing\n");
+    return 1;
+  }
+  if (argc != 1) {
+    printf("error: ACAP file: invalid command line\n");
+    return 1;
+  }
+  r = pm_image_load(argv[0], 0, &image);
+  if (r != 0) {
+    return 1;
+  }
+  rtems_pm_acap_verify(image.image, image.size, &report);
+  rtems_pm_image_free(&image);
+  rtems_pm_acap_report_print(&report);
+  return report.status == RTEMS_PM_IMAGE_SUCCESS ? 0 : 1;
+}
+
+static int pm_subcmd_acap_inventory(int argc, char *argv[]) {
+  rtems_pm_image_info infos[RTEMS_PM_IMAGE_INFO_MAX];
+  uint32_t count = 0;
+  uint32_t i;
+  if (rtems_pm_image_info_list(infos, RTEMS_PM_IMAGE_INFO_MAX, &count) < 0) {
+    printf("error: acap: inventory: %s\n", strerror(errno));
+    return 1;
+  }
+  printf(" %-8s %-8s %-8s %-8s\n", "node id", "uid", "puid", "func id");
+  for (i = 0; i < count; ++i) {
+    printf(
+      " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n",
+      infos[i].img_id, infos[i].uid, infos[i].puid, infos[i].func_id);
+  }
+  return 0;
+}
+
+static int pm_subcmd_acap_resident(int argc, char *argv[]) {
+  rtems_pm_resident_stats stats;
+  if (argc == 2) {
+    if (strcmp(argv[1], "on") == 0) {
+      rtems_pm_acap_resident_check_set(true);
+    } else if (strcmp(argv[1], "off") == 0) {
+      rtems_pm_acap_resident_check_set(false);
+    } else {
+      rtems_pm_image image;
+      int r = pm_image_load(argv[1], 0, &image);
+      if (r != 0) {
+        return 1;
+      }
+      r = rtems_pm_acap_resident(image.image, image.size);
+      rtems_pm_image_free(&image);
+      if (r < 0) {
+        printf("error: acap: resident: %s\n", strerror(errno));
+        return 1;
+      }
+      printf("%s: %s\n", argv[1], r > 0 ? "resident" : "not resident");
+      return 0;
+    }
+  } else if (argc != 1) {
+    printf("error: acap: resident: invalid command line\n");
+    return 1;
+  }
+  rtems_pm_acap_resident_get_stats(&stats);
+  printf(
+    "check  : %s\n"
+    "checks : %" PRIu64 "\n"
+    "skips  : %" PRIu64 "\n"
+    "errors : %" PRIu64 "\n",
+    stats.check ? "on" : "off", stats.checks, stats.skips, stats.errors);
   return 0;
 }
 
 static pm_shell_subcmd acap_subcmds[] = {
   { "load", "Load the ACAP (PDI) image", pm_subcmd_acap_load, NULL },
   { "info", "Print ACAP (PDI) information", pm_subcmd_acap_info, NULL },
+  { "verify", "Verify all ACAP (PDI) headers", pm_subcmd_acap_verify, NULL },
+  { "inventory", "List the images resident in the PLM", pm_subcmd_acap_inventory, NULL },
+  { "resident", "Print or set the resident check [on|off] or check a file", pm_subcmd_acap_resident, NULL },
 };
 
 static int pm_subcmd_acap(int argc, char *argv[]) {
@@ -492,15 +918,1563 @@ static int pm_subcmd_acap(int argc, char *argv[]) {
     argv[0], acap_subcmds, NUMOF(acap_subcmds), argc - 1, argv + 1);
 }
 
+static int pm_subcmd_cache_stats(int argc, char *argv[]) {
+  rtems_pm_cache_stats stats;
+  rtems_pm_cache_get_stats(&stats);
+  printf("Image cache:\n");
+  printf(" Limit     : %zu bytes\n", stats.limit);
+  printf(" Size      : %zu bytes\n", stats.size);
+  printf(" Entries   : %" PRIu32 "\n", stats.entries);
+  printf(" Hits      : %" PRIu64 "\n", stats.hits);
+  printf(" Misses    : %" PRIu64 "\n", stats.misses);
+  printf(" Evictions : %" PRIu64 "\n", stats.evictions);
+  return 0;
+}
+
+static void pm_cache_list_entry(const rtems_pm_cache_info* info, void* arg) {
+  printf(
+    " %08" PRIx32 " %016" PRIx64 " %10zu %4" PRIu32 " %6" PRIu32 " %-3s %s\n",
+    info->pdi_id, info->hash, info->size, info->refs, info->hits,
+    info->pinned ? "yes" : "no", info->path == NULL ? "-" : info->path);
+}
+
+static int pm_subcmd_cache_list(int argc, char *argv[]) {
+  printf(
+    " %-8s %-16s %10s %4s %6s %-3s %s\n",
+    "pdi id", "hash", "size", "refs", "hits", "pin", "path");
+  rtems_pm_cache_iterate(pm_cache_list_entry, NULL);
+  return 0;
+}
+
+static int pm_subcmd_cache_limit(int argc, char *argv[]) {
+  char* end;
+  size_t limit;
+  if (argc != 2) {
+    printf("error: cache: limit: invalid command line\n");
+    return 1;
+  }
+  limit = strtoul(argv[1], &end, 0);
+  if (*end == 'k' || *end == 'K') {
+    limit *= 1024;
+    ++end;
+  } else if (*end == 'm' || *end == 'M') {
+    limit *= 1024 * 1024;
+    ++end;
+  }
+  if (*end != '\0') {
+    printf("error: cache: limit: invalid size: %s\n", argv[1]);
+    return 1;
+  }
+  rtems_pm_cache_set_limit(limit);
+  return pm_subcmd_cache_stats(0, NULL);
+}
+
+static int pm_cache_pin_file(int argc, char *argv[], bool pin) {
+  rtems_pm_cache_stats stats;
+  rtems_pm_image* image;
+  int r;
+  if (argc != 2) {
+    printf("error: cache: %s: file missing\n", argv[0]);
+    return 1;
+  }
+  rtems_pm_cache_get_stats(&stats);
+  if (stats.limit == 0) {
+    printf("error: cache: %s: cache is disabled, set a limit\n", argv[0]);
+    return 1;
+  }
+  r = rtems_pm_cache_load_file(argv[1], 0, &image);
+  if (r < 0) {
+    printf("error: cache: %s: %s: %s\n", argv[0], argv[1], strerror(errno));
+    return 1;
+  }
+  rtems_pm_cache_pin(image, pin);
+  rtems_pm_cache_release(image);
+  return 0;
+}
+
+static int pm_subcmd_cache_pin(int argc, char *argv[]) {
+  return pm_cache_pin_file(argc, argv, true);
+}
+
+static int pm_subcmd_cache_unpin(int argc, char *argv[]) {
+  return pm_cache_pin_file(argc, argv, false);
+}
+
+static int pm_subcmd_cache_flush(int argc, char *argv[]) {
+  rtems_pm_cache_flush();
+  return 0;
+}
+
+static int pm_subcmd_cache_reset(int argc, char *argv[]) {
+  rtems_pm_cache_reset_stats();
+  return 0;
+}
+
+static pm_shell_subcmd cache_subcmds[] = {
+  { "stats", "Print the image cache statistics", pm_subcmd_cache_stats, NULL },
+  { "list", "List the cached images", pm_subcmd_cache_list, NULL },
+  { "limit", "Set the cache size limit in bytes, k or M", pm_subcmd_cache_limit, NULL },
+  { "pin", "Load and pin an image in the cache", pm_subcmd_cache_pin, NULL },
+  { "unpin", "Unpin an image in the cache", pm_subcmd_cache_unpin, NULL },
+  { "flush", "Remove all unused and unpinned images", pm_subcmd_cache_flush, NULL },
+  { "reset", "Reset the cache statistics", pm_subcmd_cache_reset, NULL },
+};
+
+static int pm_subcmd_cache(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], cache_subcmds, NUMOF(cache_subcmds), argc - 1, argv + 1);
+}
+
+static int pm_notify_args(
+  const char* label, int argc, char* argv[], uint32_t* values, int count) {
+  int a;
+  if (argc != count + 1 && argc != count + 2) {
+    printf("error: notify: %s: invalid command line\n", label);
+    return -1;
+  }
+  for (a = 0; a < argc - 1; ++a) {
+    char* end;
+    values[a] = strtoul(argv[a + 1], &end, 0);
+    if (*end != '\0') {
+      printf("error: notify: %s: invalid value: %s\n", label, argv[a + 1]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int pm_subcmd_notify_stats(int argc, char *argv[]) {
+  rtems_pm_notify_stats stats;
+  rtems_pm_notify_get_stats(&stats);
+  printf("Notifier:\n");
+  if (!stats.running) {
+    printf(" Not running\n");
+    return 0;
+  }
+  printf(" SGI       : %" PRIu32 "\n", stats.sgi);
+  printf(" Notifiers : %" PRIu32 "\n", stats.notifiers);
+  printf(" Interrupts: %" PRIu64 "\n", stats.interrupts);
+  printf(" Callbacks : %" PRIu64 "\n", stats.callbacks);
+  printf(" Delivered : %" PRIu64 "\n", stats.delivered);
+  printf(" Unhandled : %" PRIu64 "\n", stats.unhandled);
+  return 0;
+}
+
+static int pm_subcmd_notify_start(int argc, char *argv[]) {
+  uint32_t values[2] = { RTEMS_PM_NOTIFY_SGI, RTEMS_PM_NOTIFY_PRIORITY };
+  if (argc > 3) {
+    printf("error: notify: start: invalid command line\n");
+    return 1;
+  }
+  if (argc > 1 && pm_notify_args(argv[0], argc, argv, values, argc - 1) < 0) {
+    return 1;
+  }
+  if (rtems_pm_notifier_start(values[0], values[1]) < 0) {
+    printf("error: notify: start: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Block until the node has one of the events or the timeout.
+ */
+static int pm_subcmd_notify_wait(int argc, char *argv[]) {
+  uint32_t values[3] = { 0, 0, 0 };
+  rtems_pm_notifier notifier;
+  rtems_event_set out;
+  rtems_interval ticks = RTEMS_NO_TIMEOUT;
+  rtems_status_code sc;
+  if (pm_notify_args(argv[0], argc, argv, values, 2) < 0) {
+    return 1;
+  }
+  if (values[2] != 0) {
+    ticks = RTEMS_MILLISECONDS_TO_TICKS(values[2]);
+    if (ticks == 0) {
+      ticks = 1;
+    }
+  }
+  memset(&notifier, 0, sizeof(notifier));
+  notifier.node = values[0];
+  notifier.event = values[1];
+  notifier.task = rtems_task_self();
+  notifier.events = RTEMS_EVENT_1;
+  if (rtems_pm_notifier_register(&notifier) < 0) {
+    printf("error: notify: wait: %s\n", strerror(errno));
+    return 1;
+  }
+  sc = rtems_event_receive(
+    RTEMS_EVENT_1, RTEMS_EVENT_ALL | RTEMS_WAIT, ticks, &out);
+  rtems_pm_notifier_unregister(&notifier);
+  if (sc != RTEMS_SUCCESSFUL) {
+    printf("error: notify: wait: %s\n", rtems_status_text(sc));
+    return 1;
+  }
+  printf(
+    "Notify: node: %08" PRIx32 " event: %08" PRIx32 " data: %08" PRIx32 "\n",
+    notifier.last.node, notifier.last.event, notifier.last.data);
+  return 0;
+}
+
+static int pm_subcmd_notify_raise(int argc, char *argv[]) {
+  uint32_t values[3] = { 0, 0, 0 };
+  if (pm_notify_args(argv[0], argc, argv, values, 2) < 0) {
+    return 1;
+  }
+  if (rtems_pm_sim_notify(values[0], values[1], values[2]) < 0) {
+    printf("error: notify: raise: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static pm_shell_subcmd notify_subcmds[] = {
+  { "stats", "Print the notifier statistics", pm_subcmd_notify_stats, NULL },
+  { "start", "Start the dispatcher [sgi [priority]]", pm_subcmd_notify_start, NULL },
+  { "wait", "Wait for a node event: node event [msecs]", pm_subcmd_notify_wait, NULL },
+  { "raise", "Simulator callback: node event [data]", pm_subcmd_notify_raise, NULL },
+};
+
+static int pm_subcmd_notify(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], notify_subcmds, NUMOF(notify_subcmds), argc - 1, argv + 1);
+}
+
+/*
+ * A clock is a name or an id.
+ */
+static int pm_clock_arg(const char* label, const char* arg, uint32_t* id) {
+  char* end;
+  *id = strtoul(arg, &end, 0);
+  if (*end == '\0') {
+    return 0;
+  }
+  if (rtems_pm_clock_lookup(arg, id) < 0) {
+    printf("error: clock: %s: %s: %s\n", label, arg, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_clock_list(int argc, char *argv[]) {
+  rtems_pm_clock_stats stats;
+  uint32_t id;
+  rtems_pm_clock_get_stats(&stats);
+  if (stats.clocks == 0) {
+    /*
+     * Reading a clock reads the tree.
+     */
+    rtems_pm_clock_info info;
+    if (rtems_pm_clock_info_get(0, &info) < 0) {
+      printf("error: clock: list: %s\n", strerror(errno));
+      return 1;
+    }
+    rtems_pm_clock_get_stats(&stats);
+  }
+  printf(" %-4s %-16s %5s %7s %12s %4s\n", "id", "name", "nodes", "parents", "rate", "div");
+  for (id = 0; id < stats.clocks; ++id) {
+    rtems_pm_clock_info info;
+    pm_data_control ctrl = { .write_not_read = false, .id = id };
+    uint64_t rate = 0;
+    uint32_t divider = 0;
+    if (rtems_pm_clock_info_get(id, &info) < 0 || info.name[0] == '\0') {
+      continue;
+    }
+    if (rtems_pm_clock_rate_control(&ctrl) == 0) {
+      rate = ((uint64_t) ctrl.arg2 << 32) | ctrl.arg1;
+    }
+    if (rtems_pm_clock_div_control(&ctrl) == 0) {
+      divider = ctrl.arg1;
+    }
+    printf(
+      " %-4" PRIu32 " %-16s %5" PRIu32 " %7" PRIu32 " %12" PRIu64 " %4" PRIu32 "\n",
+      id, info.name, info.nodes, info.parents, rate, divider);
+  }
+  return 0;
+}
+
+static int pm_subcmd_clock_stats(int argc, char *argv[]) {
+  rtems_pm_clock_stats stats;
+  if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+    rtems_pm_clock_reset_stats();
+  }
+  rtems_pm_clock_get_stats(&stats);
+  printf("Clock cache:\n");
+  printf(" Clocks        : %" PRIu32 "\n", stats.clocks);
+  printf(" Hits          : %" PRIu64 "\n", stats.hits);
+  printf(" Misses        : %" PRIu64 "\n", stats.misses);
+  printf(" Invalidations : %" PRIu64 "\n", stats.invalidations);
+  return 0;
+}
+
+/*
+ * Print or set a clock value. The rate is 64 bits.
+ */
+static int pm_clock_value(
+  int argc, char *argv[], int (*control)(pm_data_control* ctrl)) {
+  pm_data_control ctrl;
+  memset(&ctrl, 0, sizeof(ctrl));
+  if (argc != 2 && argc != 3) {
+    printf("error: clock: %s: invalid command line\n", argv[0]);
+    return 1;
+  }
+  if (pm_clock_arg(argv[0], argv[1], &ctrl.id) < 0) {
+    return 1;
+  }
+  if (argc == 3) {
+    char* end;
+    const uint64_t value = strtoull(argv[2], &end, 0);
+    if (*end != '\0') {
+      printf("error: clock: %s: invalid value: %s\n", argv[0], argv[2]);
+      return 1;
+    }
+    ctrl.write_not_read = true;
+    ctrl.arg1 = (uint32_t) value;
+    ctrl.arg2 = (uint32_t) (value >> 32);
+    if (control(&ctrl) < 0) {
+      printf("error: clock: %s: %s\n", argv[0], strerror(errno));
+      return 1;
+    }
+    ctrl.write_not_read = false;
+  }
+  if (control(&ctrl) < 0) {
+    printf("error: clock: %s: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+  printf(
+    "%s: %" PRIu64 "\n", argv[1], ((uint64_t) ctrl.arg2 << 32) | ctrl.arg1);
+  return 0;
+}
+
+static int pm_subcmd_clock_rate(int argc, char *argv[]) {
+  return pm_clock_value(argc, argv, rtems_pm_clock_rate_control);
+}
+
+static int pm_subcmd_clock_div(int argc, char *argv[]) {
+  return pm_clock_value(argc, argv, rtems_pm_clock_div_control);
+}
+
+static int pm_subcmd_clock_parent(int argc, char *argv[]) {
+  return pm_clock_value(argc, argv, rtems_pm_clock_parent_control);
+}
+
+static int pm_subcmd_clock_state(int argc, char *argv[]) {
+  return pm_clock_value(argc, argv, rtems_pm_clock_control);
+}
+
+static int pm_subcmd_clock_scale(int argc, char *argv[]) {
+  rtems_pm_clock_config config;
+  const char* clock = NULL;
+  const char* hz = NULL;
+  uint32_t flags = 0;
+  uint32_t id;
+  uint64_t rate;
+  char* end;
+  int arg;
+  for (arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-p") == 0) {
+      flags |= RTEMS_PM_CLOCK_SCALE_PLL;
+    } else if (strcmp(argv[arg], "-n") == 0) {
+      flags |= RTEMS_PM_CLOCK_SCALE_PLAN;
+    } else if (clock == NULL) {
+      clock = argv[arg];
+    } else if (hz == NULL) {
+      hz = argv[arg];
+    } else {
+      printf("error: clock: scale: invalid command line\n");
+      return 1;
+    }
+  }
+  if (hz == NULL) {
+    printf("error: clock: scale: clock and rate required\n");
+    return 1;
+  }
+  if (pm_clock_arg(argv[0], clock, &id) < 0) {
+    return 1;
+  }
+  rate = strtoull(hz, &end, 0);
+  if (*end != '\0' || rate == 0) {
+    printf("error: clock: scale: invalid rate: %s\n", hz);
+    return 1;
+  }
+  if (rtems_pm_clock_scale(id, rate, flags, &config) < 0) {
+    printf("error: clock: scale: %s\n", strerror(errno));
+    return 1;
+  }
+  printf(
+    "%s: requested: %" PRIu64 " rate: %" PRIu64 " parent: %" PRIu32
+    " divider: %" PRIu32 "\n",
+    clock, config.requested, config.rate, config.parent, config.divider);
+  if (config.pll != RTEMS_PM_CLOCK_NONE) {
+    printf(
+      "%s: pll: %" PRIu32 " mode: %s fbdiv: %" PRIu32 " frac: %" PRIu32 "\n",
+      clock, config.pll, config.pll_mode == 0 ? "integer" : "fractional",
+      config.pll_fbdiv, config.pll_frac);
+  }
+  return 0;
+}
+
+static int pm_subcmd_clock_invalidate(int argc, char *argv[]) {
+  rtems_pm_clock_invalidate();
+  return 0;
+}
+
+static pm_shell_subcmd clock_subcmds[] = {
+  { "list", "List the clocks", pm_subcmd_clock_list, NULL },
+  { "stats", "Print the clock cache statistics [reset]", pm_subcmd_clock_stats, NULL },
+  { "rate", "Print or set a clock's rate: clock [hz]", pm_subcmd_clock_rate, NULL },
+  { "div", "Print or set a clock's divider: clock [divider]", pm_subcmd_clock_div, NULL },
+  { "parent", "Print or set a clock's parent: clock [index]", pm_subcmd_clock_parent, NULL },
+  { "state", "Print or set a clock's state: clock [0|1]", pm_subcmd_clock_state, NULL },
+  { "scale", "Scale a clock to a rate: clock hz [-p pll] [-n plan]", pm_subcmd_clock_scale, NULL },
+  { "invalidate", "Invalidate the cached clock values", pm_subcmd_clock_invalidate, NULL },
+};
+
+static int pm_subcmd_clock(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], clock_subcmds, NUMOF(clock_subcmds), argc - 1, argv + 1);
+}
+
+static int pm_node_args(
+  const char* label, int argc, char* argv[], uint32_t* values, int min,
+  int max) {
+  int a;
+  if (argc < min + 1 || argc > max + 1) {
+    printf("error: node: %s: invalid command line\n", label);
+    return -1;
+  }
+  for (a = 0; a < argc - 1; ++a) {
+    char* end;
+    values[a] = strtoul(argv[a + 1], &end, 0);
+    if (*end != '\0') {
+      printf("error: node: %s: invalid value: %s\n", label, argv[a + 1]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void pm_node_list_entry(const rtems_pm_node_info* info, void* arg) {
+  printf(
+    " %08" PRIx32 " %-4s %4" PRIu32 " %4" PRIx32 " %6" PRIu32 " %6" PRIu32
+    " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+    " %8" PRIu64 " %5" PRIu64 "\n",
+    info->node, rtems_pm_node_state_name(info->state), info->refs,
+    info->capabilities, info->hysteresis_ms, info->max_latency_us,
+    info->requests, info->releases, info->reuses, info->wake_min_ns / 1000,
+    info->requests == 0 ? 0 : (info->wake_total_ns / info->requests) / 1000,
+    info->wake_max_ns / 1000, info->late);
+}
+
+static int pm_subcmd_node_list(int argc, char *argv[]) {
+  printf(
+    " %-8s %-4s %4s %4s %6s %6s %8s %8s %8s %8s %8s %8s %5s\n",
+    "node", "st", "refs", "caps", "hys-ms", "lat-us", "requests", "releases",
+    "reuses", "wake-min", "wake-avg", "wake-max", "late");
+  rtems_pm_node_iterate(pm_node_list_entry, NULL);
+  return 0;
+}
+
+static int pm_subcmd_node_acquire(int argc, char *argv[]) {
+  uint32_t node;
+  if (pm_node_args(argv[0], argc, argv, &node, 1, 1) < 0) {
+    return 1;
+  }
+  if (rtems_pm_node_acquire(node) < 0) {
+    printf("error: node: acquire: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_node_release(int argc, char *argv[]) {
+  uint32_t node;
+  if (pm_node_args(argv[0], argc, argv, &node, 1, 1) < 0) {
+    return 1;
+  }
+  if (rtems_pm_node_release(node) < 0) {
+    printf("error: node: release: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_node_config(int argc, char *argv[]) {
+  uint32_t values[4] = { 0, 0, 0, 0 };
+  if (pm_node_args(argv[0], argc, argv, values, 3, 4) < 0) {
+    return 1;
+  }
+  if (rtems_pm_node_configure(values[0], values[1], values[2], values[3]) < 0) {
+    printf("error: node: config: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_node_flush(int argc, char *argv[]) {
+  rtems_pm_node_flush();
+  return 0;
+}
+
+static pm_shell_subcmd node_subcmds[] = {
+  { "list", "List the managed nodes, wake times are usecs", pm_subcmd_node_list, NULL },
+  { "acquire", "Acquire a node: node", pm_subcmd_node_acquire, NULL },
+  { "release", "Release a node: node", pm_subcmd_node_release, NULL },
+  { "config", "Configure a node: node caps hysteresis-msecs [latency-usecs]", pm_subcmd_node_config, NULL },
+  { "flush", "Release the idle nodes", pm_subcmd_node_flush, NULL },
+};
+
+static int pm_subcmd_node(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], node_subcmds, NUMOF(node_subcmds), argc - 1, argv + 1);
+}
+
+/*
+ * Scrub regions added from the shell. A region with an image is an ACAP
+ * region and the image is the PDI that repairs it. The mask is the readback
+ * mask file for the region's frames.
+ */
+#define PM_SHELL_SCRUB_REGIONS 8
+
+typedef struct {
+  bool used;
+  char name[16];
+  rtems_pm_image image;
+  rtems_pm_image mask;
+  rtems_pm_scrub_region region;
+} pm_shell_scrub_region;
+
+static void pm_scrub_region_free(pm_shell_scrub_region* sr) {
+  if (sr->region.image != NULL) {
+    rtems_pm_image_free(&sr->image);
+  }
+  if (sr->region.mask != NULL) {
+    rtems_pm_image_free(&sr->mask);
+  }
+}
+
+static pm_shell_scrub_region shell_scrub_regions[PM_SHELL_SCRUB_REGIONS];
+
+static pm_shell_scrub_region* pm_scrub_find(const char* name) {
+  size_t r;
+  for (r = 0; r < PM_SHELL_SCRUB_REGIONS; ++r) {
+    if (shell_scrub_regions[r].used &&
+        strcmp(shell_scrub_regions[r].name, name) == 0) {
+      return &shell_scrub_regions[r];
+    }
+  }
+  return NULL;
+}
+
+static int pm_scrub_args(
+  const char* label, int argc, char* argv[], uint32_t* values, int count) {
+  int a;
+  for (a = 0; a < count; ++a) {
+    char* end;
+    values[a] = strtoul(argv[a], &end, 0);
+    if (*end != '\0') {
+      printf("error: scrub: %s: invalid value: %s\n", label, argv[a]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int pm_subcmd_scrub_start(int argc, char *argv[]) {
+  uint32_t values[3] = {
+    RTEMS_PM_SCRUB_SLICE_FRAMES, RTEMS_PM_SCRUB_FRAMES_PER_SEC,
+    RTEMS_PM_SCRUB_PRIORITY
+  };
+  if (argc > 4) {
+    printf("error: scrub: start: invalid command line\n");
+    return 1;
+  }
+  if (pm_scrub_args(argv[0], argc - 1, argv + 1, values, argc - 1) < 0) {
+    return 1;
+  }
+  if (rtems_pm_scrub_start(values[2], values[0], values[1]) < 0) {
+    printf("error: scrub: start: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_scrub_stop(int argc, char *argv[]) {
+  if (rtems_pm_scrub_stop() < 0) {
+    printf("error: scrub: stop: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int pm_subcmd_scrub_add(int argc, char *argv[]) {
+  pm_shell_scrub_region* sr;
+  uint32_t values[2];
+  size_t r;
+  if (argc < 4 || argc > 6) {
+    printf("error: scrub: add: invalid command line\n");
+    return 1;
+  }
+  if (pm_scrub_find(argv[1]) != NULL) {
+    printf("error: scrub: add: region exists: %s\n", argv[1]);
+    return 1;
+  }
+  if (pm_scrub_args(argv[0], 2, argv + 2, values, 2) < 0) {
+    return 1;
+  }
+  for (r = 0; r < PM_SHELL_SCRUB_REGIONS; ++r) {
+    if (!shell_scrub_regions[r].used) {
+      break;
+    }
+  }
+  if (r == PM_SHELL_SCRUB_REGIONS) {
+    printf("error: scrub: add: no free regions\n");
+    return 1;
+  }
+  sr = &shell_scrub_regions[r];
+  memset(sr, 0, sizeof(*sr));
+  strlcpy(sr->name, argv[1], sizeof(sr->name));
+  sr->region.name = sr->name;
+  sr->region.frame = values[0];
+  sr->region.frames = values[1];
+  if (argc >= 5 && strcmp(argv[4], "-") != 0) {
+    if (pm_image_load(argv[4], 0, &sr->image) != 0) {
+      return 1;
+    }
+    sr->region.image = sr->image.image;
+    sr->region.size = sr->image.size;
+    sr->region.acap = true;
+  }
+  if (argc == 6) {
+    if (pm_image_load(argv[5], RTEMS_PM_IMAGE_LOAD_RAW, &sr->mask) != 0) {
+      pm_scrub_region_free(sr);
+      return 1;
+    }
+    sr->region.mask = sr->mask.image;
+    if (sr->mask.size !=
+        (size_t) sr->region.frames * RTEMS_PM_FPGA_FRAME_SIZE) {
+      printf("error: scrub: add: mask size does not match the frames\n");
+      pm_scrub_region_free(sr);
+      return 1;
+    }
+  }
+  if (rtems_pm_scrub_region_capture(&sr->region) < 0 ||
+      rtems_pm_scrub_region_add(&sr->region) < 0) {
+    printf("error: scrub: add: %s\n", strerror(errno));
+    pm_scrub_region_free(sr);
+    return 1;
+  }
+  sr->used = true;
+  return 0;
+}
+
+static int pm_subcmd_scrub_remove(int argc, char *argv[]) {
+  pm_shell_scrub_region* sr;
+  if (argc != 2) {
+    printf("error: scrub: remove: invalid command line\n");
+    return 1;
+  }
+  sr = pm_scrub_find(argv[1]);
+  if (sr == NULL) {
+    printf("error: scrub: remove: region not found: %s\n", argv[1]);
+    return 1;
+  }
+  if (rtems_pm_scrub_region_remove(&sr->region) < 0) {
+    printf("error: scrub: remove: %s\n", strerror(errno));
+    return 1;
+  }
+  pm_scrub_region_free(sr);
+  sr->used = false;
+  return 0;
+}
+
+static void pm_scrub_list_entry(const rtems_pm_scrub_region* region, void* arg) {
+  printf(
+    " %-15s %08" PRIx32 " %8" PRIu32 " %-3s %8" PRIu64 " %8" PRIu64
+    " %8" PRIu64 "\n",
+    region->name, region->frame, region->frames,
+    region->image == NULL ? "no" : "yes", region->checks, region->upsets,
+    region->repairs);
+}
+
+static int pm_subcmd_scrub_list(int argc, char *argv[]) {
+  printf(
+    " %-15s %-8s %8s %-3s %8s %8s %8s\n",
+    "name", "frame", "frames", "img", "checks", "upsets", "repairs");
+  rtems_pm_scrub_iterate(pm_scrub_list_entry, NULL);
+  return 0;
+}
+
+static int pm_subcmd_scrub_stats(int argc, char *argv[]) {
+  rtems_pm_scrub_stats stats;
+  if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+    rtems_pm_scrub_reset_stats();
+    return 0;
+  }
+  rtems_pm_scrub_get_stats(&stats);
+  printf(
+    "running       : %s\n"
+    "regions       : %" PRIu32 "\n"
+    "slice         : %" PRIu32 " frames\n"
+    "rate limit    : %" PRIu32 " frames/sec\n"
+    "frames        : %" PRIu64 "\n"
+    "passes        : %" PRIu64 "\n"
+    "checks        : %" PRIu64 "\n"
+    "upsets        : %" PRIu64 "\n"
+    "repairs       : %" PRIu64 "\n"
+    "repair errors : %" PRIu64 "\n"
+    "read errors   : %" PRIu64 "\n",
+    stats.running ? "yes" : "no", stats.regions, stats.slice_frames,
+    stats.frames_per_sec, stats.frames, stats.passes, stats.checks,
+    stats.upsets, stats.repairs, stats.repair_errors, stats.read_errors);
+  if (stats.run_ns != 0) {
+    printf(
+      "coverage      : %" PRIu64 " frames/sec\n"
+      "cpu           : %" PRIu64 ".%02" PRIu64 "%%\n",
+      (stats.frames * UINT64_C(1000000000)) / stats.run_ns,
+      (stats.busy_ns * 100) / stats.run_ns,
+      ((stats.busy_ns * 10000) / stats.run_ns) % 100);
+  }
+  return 0;
+}
+
+static int pm_subcmd_scrub_upset(int argc, char *argv[]) {
+  uint32_t values[3];
+  if (argc != 4) {
+    printf("error: scrub: upset: invalid command line\n");
+    return 1;
+  }
+  if (pm_scrub_args(argv[0], 3, argv + 1, values, 3) < 0) {
+    return 1;
+  }
+  if (rtems_pm_sim_fpga_upset(values[0], values[1], values[2]) < 0) {
+    printf("error: scrub: upset: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static pm_shell_subcmd scrub_subcmds[] = {
+  { "start", "Start the scrubber [slice-frames [frames-per-sec [priority]]]", pm_subcmd_scrub_start, NULL },
+  { "stop", "Stop the scrubber", pm_subcmd_scrub_stop, NULL },
+  { "add", "Add a region, captures the golden digest: name frame frames [pdi|- [mask]]", pm_subcmd_scrub_add, NULL },
+  { "remove", "Remove a region: name", pm_subcmd_scrub_remove, NULL },
+  { "list", "List the regions", pm_subcmd_scrub_list, NULL },
+  { "stats", "Print the scrubber statistics [reset]", pm_subcmd_scrub_stats, NULL },
+  { "upset", "Simulator upset: frame word bit", pm_subcmd_scrub_upset, NULL },
+};
+
+static int pm_subcmd_scrub(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], scrub_subcmds, NUMOF(scrub_subcmds), argc - 1, argv + 1);
+}
+
+static void pm_stats_print_ns(uint64_t ns) {
+  if (ns < 10000) {
+    printf("%6" PRIu64 "ns", ns);
+  } else if (ns < UINT64_C(10000000)) {
+    printf("%6" PRIu64 "us", ns / 1000);
+  } else if (ns < UINT64_C(10000000000)) {
+    printf("%6" PRIu64 "ms", ns / 1000000);
+  } else {
+    printf("%6" PRIu64 "s ", ns / 1000000000);
+  }
+}
+
+static int pm_subcmd_stats(int argc, char *argv[]) {
+  rtems_pm_phase phase;
+  bool reset = false;
+  bool histogram = true;
+  int arg;
+  for (arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "reset") == 0) {
+      reset = true;
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      histogram = false;
+    } else {
+      printf("error: stats: invalid option: %s\n", argv[arg]);
+      return 1;
+    }
+  }
+  printf(" %-7s %8s %8s %8s %8s %8s\n", "phase", "count", "min", "mean", "max", "total");
+  for (phase = 0; phase < RTEMS_PM_PHASE_MAX; ++phase) {
+    rtems_pm_phase_stats stats;
+    rtems_pm_phase_stats_get(phase, &stats);
+    printf(" %-7s %8" PRIu64 " ", rtems_pm_phase_name(phase), stats.count);
+    pm_stats_print_ns(stats.min_ns);
+    printf(" ");
+    pm_stats_print_ns(stats.count == 0 ? 0 : stats.total_ns / stats.count);
+    printf(" ");
+    pm_stats_print_ns(stats.max_ns);
+    printf(" ");
+    pm_stats_print_ns(stats.total_ns);
+    printf("\n");
+  }
+  if (histogram) {
+    for (phase = 0; phase < RTEMS_PM_PHASE_MAX; ++phase) {
+      rtems_pm_phase_stats stats;
+      uint64_t max = 0;
+      int b;
+      rtems_pm_phase_stats_get(phase, &stats);
+      if (stats.count == 0) {
+        continue;
+      }
+      for (b = 0; b < RTEMS_PM_PHASE_BUCKETS; ++b) {
+        if (stats.buckets[b] > max) {
+          max = stats.buckets[b];
+        }
+      }
+      printf(" %s:\n", rtems_pm_phase_name(phase));
+      for (b = 0; b < RTEMS_PM_PHASE_BUCKETS; ++b) {
+        if (stats.buckets[b] != 0) {
+          int bar = (int) ((stats.buckets[b] * 40) / max);
+          printf("  >= ");
+          pm_stats_print_ns(UINT64_C(1) << b);
+          printf(" %8" PRIu64 " %.*s\n",
+                 stats.buckets[b], bar == 0 ? 1 : bar,
+                 "########################################");
+        }
+      }
+    }
+  }
+  if (reset) {
+    rtems_pm_phase_stats_reset();
+  }
+  return 0;
+}
+
+static const char* pm_func_id_label(uint32_t func_id) {
+  pm_api_id api_id = pm_api_from_sip_id(func_id & 0xffff);
+  if (api_id < PM_API_MAX) {
+    return api_id_labels[api_id];
+  }
+  return "UNKNOWN";
+}
+
+static void pm_trace_print(const rtems_pm_call_record* rec, void* arg) {
+  size_t* max = (size_t*) arg;
+  uint64_t ns = rtems_counter_ticks_to_nanoseconds(
+    rtems_counter_difference(rec->exit, rec->entry));
+  printf(
+    " %2" PRIu32 " %8" PRIu32 " %-*s %08" PRIx32 " %08" PRIx32 " %08" PRIx32
+    " %08" PRIx32 " %4" PRIi32 " %08" PRIx32 " %10" PRIu64 "\n",
+    rec->cpu, rec->seq, (int) *max, pm_func_id_label(rec->func_id),
+    rec->args[0], rec->args[1], rec->args[2], rec->ret, rec->res[0],
+    rec->res[1], ns);
+}
+
+static int pm_subcmd_trace_dump(int argc, char *argv[]) {
+  size_t max = 0;
+  size_t count;
+  int i;
+  for (i = 0; i < NUMOF(api_id_labels); ++i) {
+    size_t len = strlen(api_id_labels[i]);
+    if (len > max) {
+      max = len;
+    }
+  }
+  printf(
+    " cpu seq     %-*s arg0     arg1     arg2     ret  status   r1       nsecs\n",
+    (int) max, "api");
+  count = rtems_pm_call_trace_iterate(pm_trace_print, &max);
+  printf("Calls: %zu (%s)\n", count,
+         rtems_pm_call_trace_enabled() ? "tracing" : "off");
+  return 0;
+}
+
+static int pm_subcmd_trace_reset(int argc, char *argv[]) {
+  rtems_pm_call_trace_reset();
+  return 0;
+}
+
+static int pm_subcmd_trace_on(int argc, char *argv[]) {
+  rtems_pm_call_trace_enable(true);
+  return 0;
+}
+
+static int pm_subcmd_trace_off(int argc, char *argv[]) {
+  rtems_pm_call_trace_enable(false);
+  return 0;
+}
+
+/*
+ * The saved trace file header. Decoded by tools/pm-trace-decode.py.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t frequency;
+} pm_trace_file_header;
+
+typedef struct {
+  int fd;
+  int error;
+} pm_trace_file;
+
+static void pm_trace_save_record(const rtems_pm_call_record* rec, void* arg) {
+  pm_trace_file* file = (pm_trace_file*) arg;
+  if (file->error == 0) {
+    if (write(file->fd, rec, sizeof(*rec)) != sizeof(*rec)) {
+      file->error = errno == 0 ? EIO : errno;
+    }
+  }
+}
+
+static int pm_subcmd_trace_save(int argc, char *argv[]) {
+  pm_trace_file_header header = {
+    .magic = { 'P', 'M', 'C', 'T' },
+    .version = 1,
+    .record_size = sizeof(rtems_pm_call_record),
+    .frequency = rtems_counter_frequency()
+  };
+  pm_trace_file file = { -1, 0 };
+  size_t count;
+  --argc;
+  ++argv;
+  if (argc != 1) {
+    printf("error: trace: save: file missing\n");
+    return 1;
+  }
+  file.fd = open(argv[0], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+  if (file.fd < 0) {
+    printf("error: open: %s: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+  if (write(file.fd, &header, sizeof(header)) != sizeof(header)) {
+    file.error = errno == 0 ? EIO : errno;
+  }
+  count = rtems_pm_call_trace_iterate(pm_trace_save_record, &file);
+  close(file.fd);
+  if (file.error != 0) {
+    printf("error: write: %s: %s\n", argv[0], strerror(file.error));
+    return 1;
+  }
+  printf("trace: %s: %zu calls\n", argv[0], count);
+  return 0;
+}
+
+static pm_shell_subcmd trace_subcmds[] = {
+  { "dump", "Print the firmware call trace", pm_subcmd_trace_dump, NULL },
+  { "reset", "Reset the firmware call trace", pm_subcmd_trace_reset, NULL },
+  { "on", "Trace firmware calls", pm_subcmd_trace_on, NULL },
+  { "off", "Stop tracing firmware calls", pm_subcmd_trace_off, NULL },
+  { "save", "Save the trace to a file for decoding on a host",
+    pm_subcmd_trace_save, NULL },
+};
+
+static int pm_subcmd_trace(int argc, char *argv[]) {
+  return pm_shell_subcommand(
+    argv[0], trace_subcmds, NUMOF(trace_subcmds), argc - 1, argv + 1);
+}
+
+/*
+ * Benchmarks. Each benchmark runs warmup calls that are not timed and then
+ * times each call with the counter.
+ */
+typedef struct {
+  uint32_t iterations;
+  uint32_t warmup;
+  const char* path;
+  rtems_pm_image image;
+} pm_bench_context;
+
+typedef int (*pm_bench_call)(pm_bench_context* ctx, void* arg);
+
+typedef struct pm_bench {
+  const char* name;
+  const char* help;
+  bool needs_image;
+  bool sim_only;
+  pm_bench_call call;
+  int (*run)(const struct pm_bench* bench, pm_bench_context* ctx);
+} pm_bench;
+
+typedef struct {
+  uint64_t min;
+  uint64_t median;
+  uint64_t p99;
+  uint64_t max;
+  uint64_t total;
+} pm_bench_result;
+
+static int pm_bench_compare(const void* a, const void* b) {
+  const uint64_t* ua = (const uint64_t*) a;
+  const uint64_t* ub = (const uint64_t*) b;
+  return *ua < *ub ? -1 : *ua > *ub ? 1 : 0;
+}
+
+static int pm_bench_measure(
+  const char* name, pm_bench_context* ctx, pm_bench_call call, void* arg,
+  pm_bench_result* result) {
+  uint64_t* samples;
+  uint32_t i;
+  samples = calloc(ctx->iterations, sizeof(*samples));
+  if (samples == NULL) {
+    printf("error: bench: no memory for samples\n");
+    return 1;
+  }
+  for (i = 0; i < ctx->warmup; ++i) {
+    if (call(ctx, arg) < 0) {
+      printf("error: bench: %s: %s\n", name, strerror(errno));
+      free(samples);
+      return 1;
+    }
+  }
+  result->total = 0;
+  for (i = 0; i < ctx->iterations; ++i) {
+    rtems_counter_ticks start = rtems_counter_read();
+    int r = call(ctx, arg);
+    rtems_counter_ticks end = rtems_counter_read();
+    if (r < 0) {
+      printf("error: bench: %s: %s\n", name, strerror(errno));
+      free(samples);
+      return 1;
+    }
+    samples[i] =
+      rtems_counter_ticks_to_nanoseconds(rtems_counter_difference(end, start));
+    result->total += samples[i];
+  }
+  qsort(samples, ctx->iterations, sizeof(*samples), pm_bench_compare);
+  result->min = samples[0];
+  result->median = samples[ctx->iterations / 2];
+  result->p99 = samples[((uint64_t) (ctx->iterations - 1) * 99) / 100];
+  result->max = samples[ctx->iterations - 1];
+  free(samples);
+  return 0;
+}
+
+static void pm_bench_print(
+  const char* name, pm_bench_context* ctx, const pm_bench_result* result) {
+  printf(
+    " %-12s %8" PRIu32 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+    " %10" PRIu64 " %10" PRIu64 "\n",
+    name, ctx->iterations, result->min, result->median, result->p99,
+    result->max,
+    result->total == 0 ?
+      0 : ((uint64_t) ctx->iterations * UINT64_C(1000000000)) / result->total);
+}
+
+static int pm_bench_feature(pm_bench_context* ctx, void* arg) {
+  uint32_t version;
+  return rtems_pm_feature_query(PM_GET_CHIPID, &version);
+}
+
+static int pm_bench_chipid(pm_bench_context* ctx, void* arg) {
+  pm_data_chipid data;
+  return rtems_pm_chipid(&data);
+}
+
+static int pm_bench_fpga_status(pm_bench_context* ctx, void* arg) {
+  uint32_t status;
+  return rtems_pm_fpga_get_status(&status);
+}
+
+static int pm_bench_acap_load(pm_bench_context* ctx, void* arg) {
+  uint32_t status;
+  return rtems_pm_acap_load_image(&ctx->image, &status);
+}
+
+typedef struct {
+  uint32_t (*sum)(const uint32_t* words, size_t size);
+  const uint32_t* words;
+  size_t size;
+} pm_bench_checksum_arg;
+
+static int pm_bench_checksum_call(pm_bench_context* ctx, void* arg) {
+  pm_bench_checksum_arg* csum = (pm_bench_checksum_arg*) arg;
+  volatile uint32_t sum = csum->sum(csum->words, csum->size);
+  (void) sum;
+  return 0;
+}
+
+/*
+ * Compare the scalar and the selected checksum over the header sizes seen in
+ * a PDI and larger blocks.
+ */
+static int pm_bench_checksum(const pm_bench* bench, pm_bench_context* ctx) {
+  static const size_t sizes[] = {
+    XIH_IH_LEN, XIH_IHT_LEN, 0xf20, 64 * 1024, 1024 * 1024
+  };
+  const size_t max_size = sizes[NUMOF(sizes) - 1];
+  uint32_t* words;
+  size_t s;
+  int r = 0;
+  words = rtems_cache_aligned_malloc(max_size);
+  if (words == NULL) {
+    printf("error: bench: no memory for checksum buffer\n");
+    return 1;
+  }
+  for (s = 0; s < max_size / sizeof(uint32_t); ++s) {
+    words[s] = (uint32_t) (s * 2654435761U);
+  }
+  printf(
+    " %-12s %10s %12s %12s %12s %8s\n",
+    "checksum", "bytes", "scalar ns", pm_checksum_impl(), "MB/s", "speedup");
+  for (s = 0; s < NUMOF(sizes) && r == 0; ++s) {
+    pm_bench_checksum_arg scalar = {
+      pm_checksum_sum_scalar, words, sizes[s] / sizeof(uint32_t)
+    };
+    pm_bench_checksum_arg selected = {
+      pm_checksum_sum, words, sizes[s] / sizeof(uint32_t)
+    };
+    pm_bench_result scalar_result;
+    pm_bench_result selected_result;
+    r = pm_bench_measure(
+      bench->name, ctx, pm_bench_checksum_call, &scalar, &scalar_result);
+    if (r == 0) {
+      r = pm_bench_measure(
+        bench->name, ctx, pm_bench_checksum_call, &selected, &selected_result);
+    }
+    if (r == 0) {
+      uint64_t median = selected_result.median == 0 ? 1 : selected_result.median;
+      printf(
+        " %-12s %10zu %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+        " %5" PRIu64 ".%02" PRIu64 "\n",
+        "", sizes[s], scalar_result.median, selected_result.median,
+        ((uint64_t) sizes[s] * 1000) / median,
+        scalar_result.median / median,
+        ((scalar_result.median * 100) / median) % 100);
+    }
+  }
+  free(words);
+  return r;
+}
+
+/*
+ * Dirty a word in each cache line so the clean has lines to write back.
+ */
+static void pm_bench_dirty(void* image, size_t size) {
+  const size_t line = rtems_cache_get_data_line_size();
+  volatile uint32_t* words = image;
+  size_t offset;
+  for (offset = 0; offset < size; offset += line) {
+    words[offset / sizeof(uint32_t)] = words[offset / sizeof(uint32_t)];
+  }
+}
+
+static uint64_t pm_bench_clean_time(
+  pm_bench_context* ctx, rtems_pm_clean_strategy strategy,
+  const rtems_pm_pdi_index* index) {
+  uint64_t* samples;
+  uint64_t median;
+  uint32_t i;
+  samples = calloc(ctx->iterations, sizeof(*samples));
+  if (samples == NULL) {
+    return 0;
+  }
+  for (i = 0; i < ctx->iterations; ++i) {
+    rtems_counter_ticks start;
+    rtems_counter_ticks end;
+    pm_bench_dirty(ctx->image.image, ctx->image.size);
+    start = rtems_counter_read();
+    switch (strategy) {
+      case RTEMS_PM_CLEAN_FULL:
+        rtems_cache_flush_multiple_data_lines(ctx->image.image, ctx->image.size);
+        break;
+      case RTEMS_PM_CLEAN_PARTITIONS:
+        rtems_pm_pdi_clean(index);
+        break;
+      default:
+        break;
+    }
+    end = rtems_counter_read();
+    samples[i] =
+      rtems_counter_ticks_to_nanoseconds(rtems_counter_difference(end, start));
+  }
+  qsort(samples, ctx->iterations, sizeof(*samples), pm_bench_compare);
+  median = samples[ctx->iterations / 2];
+  free(samples);
+  return median;
+}
+
+typedef struct {
+  const void* image;
+  size_t size;
+} pm_bench_load_arg;
+
+static int pm_bench_load_call(pm_bench_context* ctx, void* arg) {
+  pm_bench_load_arg* load = (pm_bench_load_arg*) arg;
+  uint32_t status;
+  return rtems_pm_acap_load(load->image, load->size, &status);
+}
+
+/*
+ * Compare the cache maintenance strategies. The clean time is for dirty
+ * lines. The none strategy loads a copy of the image in coherent memory so
+ * the verify reads the image uncached.
+ */
+static int pm_bench_clean(const pm_bench* bench, pm_bench_context* ctx) {
+  const rtems_pm_clean_strategy saved = rtems_pm_clean_strategy_get();
+  rtems_pm_pdi_index index;
+  void* coherent;
+  int r = 0;
+  int s;
+  if (rtems_pm_pdi_index_build(
+        &index, ctx->image.image, ctx->image.size) != RTEMS_PM_IMAGE_SUCCESS) {
+    printf("error: bench: clean: image is not a valid PDI\n");
+    return 1;
+  }
+  coherent = rtems_cache_coherent_allocate(ctx->image.size, 0, 0);
+  if (coherent == NULL) {
+    printf("error: bench: clean: no coherent memory for the image\n");
+    return 1;
+  }
+  memcpy(coherent, ctx->image.image, ctx->image.size);
+  rtems_cache_flush_multiple_data_lines(coherent, ctx->image.size);
+  printf(
+    " %-12s %-10s %10s %12s %12s\n",
+    "clean", "strategy", "bytes", "clean ns", "load ns");
+  for (s = 0; s < RTEMS_PM_CLEAN_MAX && r == 0; ++s) {
+    pm_bench_load_arg load = {
+      s == RTEMS_PM_CLEAN_NONE ? coherent : ctx->image.image, ctx->image.size
+    };
+    pm_bench_result result;
+    uint64_t clean_ns = pm_bench_clean_time(ctx, s, &index);
+    size_t bytes = 0;
+    if (s == RTEMS_PM_CLEAN_FULL) {
+      bytes = ctx->image.size;
+    } else if (s == RTEMS_PM_CLEAN_PARTITIONS) {
+      bytes = rtems_pm_pdi_clean_size(&index);
+    }
+    rtems_pm_clean_strategy_set(s);
+    r = pm_bench_measure(bench->name, ctx, pm_bench_load_call, &load, &result);
+    if (r == 0) {
+      printf(
+        " %-12s %-10s %10zu %12" PRIu64 " %12" PRIu64 "\n",
+        "", rtems_pm_clean_strategy_name(s), bytes, clean_ns, result.median);
+    }
+  }
+  rtems_pm_clean_strategy_set(saved);
+  rtems_cache_coherent_free(coherent);
+  return r;
+}
+
+/*
+ * A register tuning sequence of writes, masked writes and reads in the
+ * simulator's secure MMIO block.
+ */
+#define PM_BENCH_MMIO_OPS 16
+
+static rtems_pm_mmio_op bench_mmio_ops[PM_BENCH_MMIO_OPS] = {
+  RTEMS_PM_MMIO_WRITE_OP(0xf6000000, 0x00000001),
+  RTEMS_PM_MMIO_WRITE_OP(0xf6000004, 0x00000002),
+  RTEMS_PM_MMIO_WRITE_OP(0xf6000008, 0x00000003),
+  RTEMS_PM_MMIO_WRITE_OP(0xf600000c, 0x00000004),
+  RTEMS_PM_MMIO_MASK_OP(0xf6000010, 0x000000ff, 0x00000055),
+  RTEMS_PM_MMIO_MASK_OP(0xf6000014, 0x0000ff00, 0x0000aa00),
+  RTEMS_PM_MMIO_MASK_OP(0xf6000018, 0x00ff0000, 0x00550000),
+  RTEMS_PM_MMIO_MASK_OP(0xf600001c, 0xff000000, 0xaa000000),
+  RTEMS_PM_MMIO_READ_OP(0xf6000000),
+  RTEMS_PM_MMIO_READ_OP(0xf6000004),
+  RTEMS_PM_MMIO_READ_OP(0xf6000008),
+  RTEMS_PM_MMIO_READ_OP(0xf600000c),
+  RTEMS_PM_MMIO_READ_OP(0xf6000010),
+  RTEMS_PM_MMIO_READ_OP(0xf6000014),
+  RTEMS_PM_MMIO_READ_OP(0xf6000018),
+  RTEMS_PM_MMIO_READ_OP(0xf600001c),
+};
+
+static int pm_bench_mmio_single_call(pm_bench_context* ctx, void* arg) {
+  size_t o;
+  for (o = 0; o < PM_BENCH_MMIO_OPS; ++o) {
+    rtems_pm_mmio_op* op = &bench_mmio_ops[o];
+    int r;
+    if (op->op == RTEMS_PM_MMIO_READ) {
+      r = rtems_pm_mmio_read(op->address, &op->value);
+    } else {
+      r = rtems_pm_mmio_write(op->address, op->mask, op->value);
+    }
+    if (r < 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+static int pm_bench_mmio_batch_call(pm_bench_context* ctx, void* arg) {
+  return RTEMS_PM_MMIO_BATCH(bench_mmio_ops, NULL);
+}
+
+/*
+ * The sequence as single operations and as a batch. The times are for all
+ * of the operations.
+ */
+static int pm_bench_mmio(const pm_bench* bench, pm_bench_context* ctx) {
+  pm_bench_result single;
+  pm_bench_result batch;
+  int r;
+  r = pm_bench_measure(
+    "mmio-single", ctx, pm_bench_mmio_single_call, NULL, &single);
+  if (r == 0) {
+    pm_bench_print("mmio-single", ctx, &single);
+    r = pm_bench_measure(
+      "mmio-batch", ctx, pm_bench_mmio_batch_call, NULL, &batch);
+  }
+  if (r == 0) {
+    pm_bench_print("mmio-batch", ctx, &batch);
+    if (batch.median != 0) {
+      printf(
+        " %-12s : %d ops, %" PRIu64 " ns/op single, %" PRIu64
+        " ns/op batch, %" PRIu64 ".%02" PRIu64 "x\n",
+        "", PM_BENCH_MMIO_OPS, single.median / PM_BENCH_MMIO_OPS,
+        batch.median / PM_BENCH_MMIO_OPS, single.median / batch.median,
+        ((single.median * 100) / batch.median) % 100);
+    }
+  }
+  return r;
+}
+
+static int pm_bench_clock_rate_call(pm_bench_context* ctx, void* arg) {
+  pm_data_control ctrl = { .write_not_read = false, .id = 0 };
+  if (arg != NULL) {
+    rtems_pm_clock_invalidate();
+  }
+  return rtems_pm_clock_rate_control(&ctrl);
+}
+
+/*
+ * A rate read from the firmware, the invalidate is included, and from the
+ * clock cache.
+ */
+static int pm_bench_clock(const pm_bench* bench, pm_bench_context* ctx) {
+  pm_bench_result result;
+  int r;
+  r = pm_bench_measure(
+    "clock-miss", ctx, pm_bench_clock_rate_call, ctx, &result);
+  if (r == 0) {
+    pm_bench_print("clock-miss", ctx, &result);
+    r = pm_bench_measure(
+      "clock-hit", ctx, pm_bench_clock_rate_call, NULL, &result);
+  }
+  if (r == 0) {
+    pm_bench_print("clock-hit", ctx, &result);
+  }
+  return r;
+}
+
+typedef struct {
+  const rtems_pm_image* packed;
+  rtems_pm_image image;
+} pm_bench_decompress_arg;
+
+static int pm_bench_decompress_call(pm_bench_context* ctx, void* arg) {
+  pm_bench_decompress_arg* decompress = (pm_bench_decompress_arg*) arg;
+  int r = rtems_pm_image_decompress(
+    decompress->packed->image, decompress->packed->size, 0, &decompress->image);
+  if (r == 0) {
+    rtems_pm_image_free(&decompress->image);
+  }
+  return r;
+}
+
+/*
+ * Decompress the image file from memory so the time is only the decoder and
+ * the output buffer allocation.
+ */
+static int pm_bench_decompress(const pm_bench* bench, pm_bench_context* ctx) {
+  rtems_pm_image packed;
+  rtems_pm_image_format format;
+  pm_bench_decompress_arg decompress = {
+    .packed = &packed
+  };
+  pm_bench_result result;
+  int r;
+  r = pm_image_load(ctx->path, RTEMS_PM_IMAGE_LOAD_RAW, &packed);
+  if (r != 0) {
+    return 1;
+  }
+  format = rtems_pm_image_format_detect(packed.image, packed.size);
+  if (format == RTEMS_PM_IMAGE_FORMAT_RAW) {
+    printf(" %-12s : image is not compressed\n", bench->name);
+    rtems_pm_image_free(&packed);
+    return 0;
+  }
+  r = pm_bench_measure(
+    bench->name, ctx, pm_bench_decompress_call, &decompress, &result);
+  if (r == 0) {
+    uint64_t median = result.median == 0 ? 1 : result.median;
+    pm_bench_print(bench->name, ctx, &result);
+    r = rtems_pm_image_decompress(packed.image, packed.size, 0, &decompress.image);
+    if (r == 0) {
+      printf(
+        " %-12s %s %zu -> %zu bytes, %" PRIu64 " MB/s\n",
+        "", rtems_pm_image_format_name(format), packed.size,
+        decompress.image.size,
+        ((uint64_t) decompress.image.size * 1000) / median);
+      rtems_pm_image_free(&decompress.image);
+    }
+  }
+  rtems_pm_image_free(&packed);
+  return r == 0 ? 0 : 1;
+}
+
+/*
+ * A simulator only bench touches registers that are only scratch in the
+ * simulator. It is not part of the default run and has to be named.
+ */
+static const pm_bench benches[] = {
+  { "feature", "rtems_pm_feature_query", false, false, pm_bench_feature, NULL },
+  { "chipid", "rtems_pm_chipid", false, false, pm_bench_chipid, NULL },
+  { "fpga-status", "rtems_pm_fpga_get_status", false, false, pm_bench_fpga_status, NULL },
+  { "acap-load", "rtems_pm_acap_load, needs an image", true, false, pm_bench_acap_load, NULL },
+  { "checksum", "PDI header checksum, scalar vs selected", false, false, NULL, pm_bench_checksum },
+  { "clean", "Cache clean strategies before a load, needs an image", true, false, NULL, pm_bench_clean },
+  { "decompress", "Decompress a compressed image from memory, needs an image", true, false, NULL, pm_bench_decompress },
+  { "clock", "Clock rate read, firmware vs cache", false, false, NULL, pm_bench_clock },
+  { "mmio", "Secure MMIO sequence, single vs batch, sim backend only", false, true, NULL, pm_bench_mmio },
+};
+
+static int pm_bench_run(const pm_bench* bench, pm_bench_context* ctx) {
+  pm_bench_result result;
+  int r;
+  if (bench->needs_image && ctx->image.image == NULL) {
+    printf(" %-12s : no image, use -i\n", bench->name);
+    return 0;
+  }
+  if (bench->sim_only && rtems_pm_backend_current() != RTEMS_PM_BACKEND_SIM) {
+    printf("error: bench: %s: sim backend only\n", bench->name);
+    return 1;
+  }
+  if (bench->run != NULL) {
+    return bench->run(bench, ctx);
+  }
+  r = pm_bench_measure(bench->name, ctx, bench->call, NULL, &result);
+  if (r == 0) {
+    pm_bench_print(bench->name, ctx, &result);
+  }
+  return r;
+}
+
+static void pm_bench_help(void) {
+  size_t b;
+  printf("pm bench [-n iterations] [-w warmup] [-i image] [bench ...]\n");
+  printf(" where bench is:\n");
+  for (b = 0; b < NUMOF(benches); ++b) {
+    printf("  %-12s : %s\n", benches[b].name, benches[b].help);
+  }
+}
+
+static uint32_t pm_bench_option(const char* arg, const char* label, bool* ok) {
+  char* end;
+  unsigned long value = strtoul(arg, &end, 0);
+  if (*end != '\0' || value > UINT32_MAX) {
+    printf("error: bench: invalid %s: %s\n", label, arg);
+    *ok = false;
+  }
+  return (uint32_t) value;
+}
+
+static int pm_subcmd_bench(int argc, char *argv[]) {
+  pm_bench_context ctx = {
+    .iterations = 1000,
+    .warmup = 10,
+    .image = { NULL, 0, 0, false }
+  };
+  const char* image = NULL;
+  bool ok = true;
+  size_t b;
+  int r = 0;
+  --argc;
+  ++argv;
+  while (argc > 0 && argv[0][0] == '-') {
+    if (strcmp(argv[0], "-h") == 0 || strcmp(argv[0], "--help") == 0) {
+      pm_bench_help();
+      return 0;
+    }
+    if (argc < 2) {
+      printf("error: bench: option needs a value: %s\n", argv[0]);
+      return 1;
+    }
+    if (strcmp(argv[0], "-n") == 0) {
+      ctx.iterations = pm_bench_option(argv[1], "iterations", &ok);
+    } else if (strcmp(argv[0], "-w") == 0) {
+      ctx.warmup = pm_bench_option(argv[1], "warmup", &ok);
+    } else if (strcmp(argv[0], "-i") == 0) {
+      image = argv[1];
+      ctx.path = image;
+    } else {
+      printf("error: invalid option: %s\n", argv[0]);
+      return 1;
+    }
+    if (!ok) {
+      return 1;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  if (ctx.iterations == 0) {
+    printf("error: bench: iterations cannot be 0\n");
+    return 1;
+  }
+  for (r = 0; r < argc; ++r) {
+    for (b = 0; b < NUMOF(benches); ++b) {
+      if (strcmp(argv[r], benches[b].name) == 0) {
+        break;
+      }
+    }
+    if (b == NUMOF(benches)) {
+      printf("error: bench: not found: %s\n", argv[r]);
+      return 1;
+    }
+  }
+  if (image != NULL) {
+    r = pm_image_load(image, RTEMS_PM_IMAGE_LOAD_CLEAN, &ctx.image);
+    if (r != 0) {
+      return 1;
+    }
+  }
+  printf(
+    "Backend: %s\n", rtems_pm_backend_name(rtems_pm_backend_current()));
+  printf(
+    " %-12s %8s %10s %10s %10s %10s %10s\n",
+    "bench", "iters", "min ns", "median ns", "p99 ns", "max ns", "calls/s");
+  r = 0;
+  for (b = 0; b < NUMOF(benches) && r == 0; ++b) {
+    if (argc == 0) {
+      if (!benches[b].sim_only) {
+        r = pm_bench_run(&benches[b], &ctx);
+      }
+    } else {
+      int a;
+      for (a = 0; a < argc; ++a) {
+        if (strcmp(argv[a], benches[b].name) == 0) {
+          r = pm_bench_run(&benches[b], &ctx);
+          break;
+        }
+      }
+    }
+  }
+  if (ctx.image.image != NULL) {
+    rtems_pm_image_free(&ctx.image);
+  }
+  return r;
+}
+
 /*
  * Top level.
  */
 static pm_shell_subcmd top_subcmds[] = {
   { "version", "Print SMCCC version", pm_subcmd_version, NULL },
   { "chipid", "Print chip Id and version", pm_subcmd_chipid, NULL },
-  { "features", "List the API fewtures available", pm_subcmd_features, NULL },
+  { "features", "List the API fewtures available [probe]", pm_subcmd_features, NULL },
   { "fpga", "FPGA commands", pm_subcmd_fpga, NULL },
   { "acap", "ACAP commands", pm_subcmd_acap, NULL },
+  { "backend", "Print or select the firmware call backend", pm_subcmd_backend, NULL },
+  { "trace", "Firmware call trace commands", pm_subcmd_trace, NULL },
+  { "bench", "Benchmark the firmware calls", pm_subcmd_bench, NULL },
+  { "cache", "Image cache commands", pm_subcmd_cache, NULL },
+  { "stats", "Print the load phase times [-s] [reset]", pm_subcmd_stats, NULL },
+  { "clean", "Print or set the cache clean strategy [full|partitions|none]", pm_subcmd_clean, NULL },
+  { "readahead", "Print or set the image read ahead [depth [priority]]", pm_subcmd_readahead, NULL },
+  { "arena", "Print or create the image arena [create SIZE [-u]]", pm_subcmd_arena, NULL },
+  { "sha3", "SHA3-384 digest of a file [-e auto|pmc|software] [file]", pm_subcmd_sha3, NULL },
+  { "notify", "Firmware notifier commands", pm_subcmd_notify, NULL },
+  { "clock", "Clock commands", pm_subcmd_clock, NULL },
+  { "node", "Node manager commands", pm_subcmd_node, NULL },
+  { "scrub", "Configuration scrubber commands", pm_subcmd_scrub, NULL },
+  { "reset", "Print or set a reset [release|assert|pulse]", pm_subcmd_reset, NULL },
+  { "mmio", "Secure MMIO commands", pm_subcmd_mmio, NULL },
 };
 
 static int pm_shell_command (int argc, char* argv[]) {
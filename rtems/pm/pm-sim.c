@@ -0,0 +1,1128 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * PLM and TF-A simulator.
+ *
+ * The simulator answers the SIP calls the PM layer makes as the firmware
+ * does. Each call holds the calling core for its configured latency so the
+ * timing of the PM layer and the load path can be measured without a board's
+ * firmware. Images passed to the load calls are checked as the PLM would
+ * before it starts a load.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/counter.h>
+#include <rtems/thread.h>
+
+#include <smc/smccc.h>
+#include <rtems/pm/pm.h>
+#include <rtems/pm/pm-image.h>
+
+#include "pm-private.h"
+#include "pm-trace.h"
+
+#include "xilpdi.h"
+
+/*
+ * A VC1902 silicon id and version.
+ */
+#define PM_SIM_IDCODE  0x14ca8093
+#define PM_SIM_VERSION 0x00000002
+
+#define PM_SIM_API_VERSION ((1 << 16) | 0)
+
+#define PM_SIM_PDI_SRC_DDR 0xf
+
+/*
+ * The status the PLM reports for an image it cannot parse.
+ */
+#define PM_SIM_LOAD_INVALID PM_STATUS_INTERNAL
+
+typedef int (*pm_sim_handler)(const uint32_t* args, pm_ret_payload* payload);
+
+typedef struct {
+  pm_sim_handler handler;
+  uint32_t latency_usecs;
+} pm_sim_api;
+
+static uint32_t sim_fpga_status;
+static uint32_t sim_load_rate_kib_per_msec = 400;
+
+static void pm_sim_delay_usecs(uint32_t usecs) {
+  /*
+   * The counter delay is in nanoseconds and limited to 32bits.
+   */
+  while (usecs > 0) {
+    uint32_t delay = usecs > 1000 ? 1000 : usecs;
+    rtems_counter_delay_nanoseconds(delay * 1000);
+    usecs -= delay;
+  }
+}
+
+static void pm_sim_load_delay(size_t size) {
+  if (sim_load_rate_kib_per_msec != 0) {
+    uint64_t usecs = ((uint64_t) size * 1000) /
+      ((uint64_t) sim_load_rate_kib_per_msec * 1024);
+    pm_sim_delay_usecs(usecs > UINT32_MAX ? UINT32_MAX : (uint32_t) usecs);
+  }
+}
+
+static const void* pm_sim_address(uint32_t lower, uint32_t upper) {
+  return (const void*) (uintptr_t) (((uint64_t) upper << 32) | lower);
+}
+
+static int pm_sim_api_version(const uint32_t* args, pm_ret_payload* payload) {
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = PM_SIM_API_VERSION;
+  return 0;
+}
+
+static int pm_sim_chipid(const uint32_t* args, pm_ret_payload* payload) {
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = PM_SIM_IDCODE;
+  payload->r2 = PM_SIM_VERSION;
+  return 0;
+}
+
+/*
+ * Configuration frames. The frames are generated from the frame address
+ * and word so no memory holds them. An upset flips a bit of a word and a
+ * load repairs all upsets.
+ */
+#define PM_SIM_FPGA_FRAMES 4096
+#define PM_SIM_FPGA_UPSETS 16
+#define PM_SIM_FPGA_CONFIG_STATUS 0x7
+
+typedef struct {
+  uint32_t frame;
+  uint32_t word;
+  uint32_t mask;
+} pm_sim_upset;
+
+static pm_sim_upset sim_upsets[PM_SIM_FPGA_UPSETS];
+static size_t sim_upset_count;
+
+static int pm_sim_fpga_load(const uint32_t* args, pm_ret_payload* payload) {
+  const void* image = pm_sim_address(args[0], args[1]);
+  size_t size = args[2];
+  if (image == NULL || size == 0) {
+    payload->r0 = PM_SIM_LOAD_INVALID;
+    return 0;
+  }
+  pm_sim_load_delay(size);
+  sim_fpga_status = 0;
+  sim_upset_count = 0;
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+static int pm_sim_fpga_get_status(const uint32_t* args, pm_ret_payload* payload) {
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = sim_fpga_status;
+  return 0;
+}
+
+static uint32_t pm_sim_fpga_word(uint32_t frame, uint32_t word) {
+  uint32_t value = (frame * RTEMS_PM_FPGA_FRAME_WORDS + word) * 0x9e3779b1;
+  size_t u;
+  value ^= value >> 15;
+  for (u = 0; u < sim_upset_count; ++u) {
+    if (sim_upsets[u].frame == frame && sim_upsets[u].word == word) {
+      value ^= sim_upsets[u].mask;
+    }
+  }
+  return value;
+}
+
+static int pm_sim_fpga_read(const uint32_t* args, pm_ret_payload* payload) {
+  uint32_t* buffer = (uint32_t*) pm_sim_address(args[1], args[2]);
+  const uint32_t frames = args[0];
+  const uint32_t frame = args[4];
+  uint32_t f;
+  if (args[3] == RTEMS_PM_FPGA_READ_REGISTER) {
+    payload->r0 = PM_STATUS_SUCCESS;
+    payload->r1 = PM_SIM_FPGA_CONFIG_STATUS;
+    return 0;
+  }
+  if (buffer == NULL || frames == 0 || frame >= PM_SIM_FPGA_FRAMES ||
+      frames > PM_SIM_FPGA_FRAMES - frame) {
+    payload->r0 = PM_STATUS_INTERNAL;
+    return 0;
+  }
+  for (f = 0; f < frames; ++f) {
+    uint32_t w;
+    for (w = 0; w < RTEMS_PM_FPGA_FRAME_WORDS; ++w) {
+      *buffer++ = pm_sim_fpga_word(frame + f, w);
+    }
+  }
+  pm_sim_load_delay(frames * RTEMS_PM_FPGA_FRAME_SIZE);
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+/*
+ * The resident images. A loaded image replaces a resident image with the
+ * same UID or parent UID as a partition holds one reconfigurable module.
+ */
+#define PM_SIM_RESIDENT 16
+
+static rtems_pm_image_info sim_resident[PM_SIM_RESIDENT];
+static uint32_t sim_resident_count;
+
+static void pm_sim_resident_add(const XilPdi_ImgHdr* ihdr) {
+  uint32_t i = 0;
+  if (ihdr->UID == 0) {
+    return;
+  }
+  while (i < sim_resident_count) {
+    if (sim_resident[i].uid == ihdr->UID ||
+        (ihdr->PUID != 0 && sim_resident[i].puid == ihdr->PUID)) {
+      sim_resident[i] = sim_resident[--sim_resident_count];
+    } else {
+      ++i;
+    }
+  }
+  if (sim_resident_count < PM_SIM_RESIDENT) {
+    sim_resident[sim_resident_count++] = (rtems_pm_image_info) {
+      ihdr->ImgID, ihdr->UID, ihdr->PUID, ihdr->FuncID
+    };
+  }
+}
+
+static int pm_sim_uid_info_list(const uint32_t* args, pm_ret_payload* payload) {
+  rtems_pm_image_info* infos =
+    (rtems_pm_image_info*) pm_sim_address(args[1], args[0]);
+  const uint32_t max = args[2] / sizeof(rtems_pm_image_info);
+  uint32_t i;
+  if (infos == NULL) {
+    payload->r0 = PM_STATUS_INTERNAL;
+    return 0;
+  }
+  for (i = 0; i < sim_resident_count && i < max; ++i) {
+    infos[i] = sim_resident[i];
+  }
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = i;
+  return 0;
+}
+
+static int pm_sim_load_pdi(const uint32_t* args, pm_ret_payload* payload) {
+  const uint8_t* image = pm_sim_address(args[1], args[2]);
+  const XilPdi_ImgHdrTbl* ihdrtab;
+  const XilPdi_ImgHdr* ihdr;
+  const XilPdi_PrtnHdr* phdr;
+  size_t size = 0;
+  uint32_t p;
+  if (args[0] != PM_SIM_PDI_SRC_DDR || image == NULL) {
+    payload->r0 = PM_SIM_LOAD_INVALID;
+    return 0;
+  }
+  /*
+   * The PLM only loads partial PDI images and the image header table
+   * follows the SMAP bus width header.
+   */
+  ihdrtab = (const XilPdi_ImgHdrTbl*) (image + SMAP_BUS_WIDTH_LENGTH);
+  if (rtems_pm_acap_verify_image_header(ihdrtab) != RTEMS_PM_IMAGE_SUCCESS ||
+      ihdrtab->NoOfPrtns > XIH_MAX_PRTNS) {
+    payload->r0 = PM_SIM_LOAD_INVALID;
+    return 0;
+  }
+  phdr = (const XilPdi_PrtnHdr*) (image + ihdrtab->PrtnHdrAddr * XIH_PRTN_WORD_LEN);
+  for (p = 0; p < ihdrtab->NoOfPrtns; ++p) {
+    size += (size_t) phdr[p].TotalDataWordLen * XIH_PRTN_WORD_LEN;
+  }
+  pm_sim_load_delay(size);
+  ihdr = (const XilPdi_ImgHdr*) (image + ihdrtab->ImgHdrAddr * XIH_PRTN_WORD_LEN);
+  for (p = 0; p < ihdrtab->NoOfImgs && p < XIH_MAX_IMGS; ++p) {
+    pm_sim_resident_add(&ihdr[p]);
+  }
+  sim_fpga_status = 0;
+  sim_upset_count = 0;
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+/*
+ * The PMC SHA3 engine. The caller passes the upper address word first. The
+ * digest is computed in software on the calling core.
+ */
+#define PM_SIM_SHA3_INIT   1
+#define PM_SIM_SHA3_UPDATE 2
+#define PM_SIM_SHA3_FINAL  4
+
+static pm_sha3_context sim_sha3;
+static bool sim_sha3_active;
+
+static int pm_sim_secure_sha(const uint32_t* args, pm_ret_payload* payload) {
+  const void* address = pm_sim_address(args[1], args[0]);
+  const size_t size = args[2];
+  payload->r0 = PM_STATUS_SUCCESS;
+  switch (args[3]) {
+    case PM_SIM_SHA3_INIT:
+      pm_sha3_init(&sim_sha3);
+      sim_sha3_active = true;
+      break;
+    case PM_SIM_SHA3_UPDATE:
+      if (!sim_sha3_active || address == NULL) {
+        payload->r0 = PM_STATUS_INTERNAL;
+        break;
+      }
+      pm_sha3_update(&sim_sha3, address, size);
+      break;
+    case PM_SIM_SHA3_FINAL:
+      if (!sim_sha3_active || address == NULL ||
+          size < RTEMS_PM_SHA3_384_SIZE) {
+        payload->r0 = PM_STATUS_INTERNAL;
+        break;
+      }
+      pm_sha3_final(&sim_sha3, (uint8_t*) address);
+      sim_sha3_active = false;
+      break;
+    default:
+      payload->r0 = PM_STATUS_INTERNAL;
+      break;
+  }
+  return 0;
+}
+
+/*
+ * Notifier registrations and queued callbacks. The SGI is raised by calling
+ * the notification interrupt handler.
+ */
+#define PM_SIM_NOTIFIERS 16
+#define PM_SIM_CALLBACKS 16
+
+typedef struct {
+  uint32_t node;
+  uint32_t events;
+} pm_sim_notifier;
+
+typedef struct {
+  uint32_t node;
+  uint32_t event;
+  uint32_t data;
+} pm_sim_callback;
+
+static rtems_mutex sim_notify_lock = RTEMS_MUTEX_INITIALIZER("PM Sim Notify");
+static pm_sim_notifier sim_notifiers[PM_SIM_NOTIFIERS];
+static pm_sim_callback sim_callbacks[PM_SIM_CALLBACKS];
+static uint32_t sim_callback_head;
+static uint32_t sim_callback_count;
+static bool sim_sgi_registered;
+
+static int pm_sim_register_notifier(
+  const uint32_t* args, pm_ret_payload* payload) {
+  const uint32_t node = args[0];
+  const uint32_t event = args[1];
+  const bool enable = args[3] != 0;
+  pm_sim_notifier* free_slot = NULL;
+  size_t n;
+  payload->r0 = PM_STATUS_SUCCESS;
+  rtems_mutex_lock(&sim_notify_lock);
+  for (n = 0; n < PM_SIM_NOTIFIERS; ++n) {
+    pm_sim_notifier* notifier = &sim_notifiers[n];
+    if (notifier->events != 0 && notifier->node == node) {
+      if (enable) {
+        notifier->events |= event;
+      } else {
+        notifier->events &= ~event;
+      }
+      rtems_mutex_unlock(&sim_notify_lock);
+      return 0;
+    }
+    if (notifier->events == 0 && free_slot == NULL) {
+      free_slot = notifier;
+    }
+  }
+  if (enable) {
+    if (free_slot == NULL) {
+      payload->r0 = PM_STATUS_INTERNAL;
+    } else {
+      free_slot->node = node;
+      free_slot->events = event;
+    }
+  }
+  rtems_mutex_unlock(&sim_notify_lock);
+  return 0;
+}
+
+static int pm_sim_register_sgi(const uint32_t* args, pm_ret_payload* payload) {
+  sim_sgi_registered = args[1] == 0;
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+/*
+ * An empty queue returns a callback type of 0.
+ */
+static int pm_sim_get_callback_data(
+  const uint32_t* args, pm_ret_payload* payload) {
+  memset(payload, 0, sizeof(*payload));
+  rtems_mutex_lock(&sim_notify_lock);
+  if (sim_callback_count != 0) {
+    const pm_sim_callback* cb = &sim_callbacks[sim_callback_head];
+    payload->r0 = PM_NOTIFY_CB;
+    payload->r1 = cb->node;
+    payload->r2 = cb->event;
+    payload->r3 = cb->data;
+    sim_callback_head = (sim_callback_head + 1) % PM_SIM_CALLBACKS;
+    --sim_callback_count;
+  }
+  rtems_mutex_unlock(&sim_notify_lock);
+  return 0;
+}
+
+/*
+ * A clock tree with the reference clock, two PLLs and the PL reference
+ * clocks. A PLL multiplies its parent's rate by the feedback divider and
+ * the fraction over 2^16 in fractional mode and the PL clocks select a PLL
+ * and divide it.
+ */
+#define PM_SIM_CLK_MUX  1
+#define PM_SIM_CLK_PLL  2
+#define PM_SIM_CLK_DIV  4
+#define PM_SIM_CLK_GATE 6
+
+#define PM_SIM_CLK_REF_RATE 33333333
+#define PM_SIM_CLK_DIV_MAX  1023
+#define PM_SIM_CLK_NA       0xffffffff
+
+/*
+ * The clock and PLL calls take the node id, the class, subclass and type
+ * in the attributes and the index. The node classes are the firmware's.
+ */
+#define PM_SIM_CLK_NODE(_subclass, _type) \
+  ((2U << 26) | ((_subclass) << 20) | ((_type) << 14))
+#define PM_SIM_CLK_NODE_PLL PM_SIM_CLK_NODE(1, 4)
+#define PM_SIM_CLK_NODE_OUT PM_SIM_CLK_NODE(2, 8)
+#define PM_SIM_CLK_NODE_REF PM_SIM_CLK_NODE(3, 12)
+#define PM_SIM_CLK_INDEX    0x3fff
+
+#define PM_SIM_PLL_PARAM_FBDIV 1
+#define PM_SIM_PLL_PARAM_DATA  2
+#define PM_SIM_PLL_MODE_FRAC   1
+#define PM_SIM_PLL_MODE_RESET  2
+
+typedef struct {
+  const char* name;
+  uint32_t node;
+  uint32_t topology[3];
+  uint32_t parents[2];
+  uint32_t num_parents;
+  uint32_t mult;
+  uint32_t frac;
+  uint32_t mode;
+  uint32_t divider;
+  uint32_t parent;
+  bool enabled;
+} pm_sim_clock;
+
+static pm_sim_clock sim_clocks[] = {
+  { "ref_clk", PM_SIM_CLK_NODE_REF, { 0 }, { 0 }, 0, 0, 0, 0, 1, 0, true },
+  { "pmc_pll", PM_SIM_CLK_NODE_PLL, { PM_SIM_CLK_PLL }, { 0 }, 1, 72, 0, 0,
+    1, 0, true },
+  { "nocpll", PM_SIM_CLK_NODE_PLL, { PM_SIM_CLK_PLL }, { 0 }, 1, 90, 0, 0,
+    1, 0, true },
+  { "pl0_ref", PM_SIM_CLK_NODE_OUT,
+    { PM_SIM_CLK_MUX, PM_SIM_CLK_DIV, PM_SIM_CLK_GATE },
+    { 1, 2 }, 2, 0, 0, 0, 24, 0, true },
+  { "pl1_ref", PM_SIM_CLK_NODE_OUT,
+    { PM_SIM_CLK_MUX, PM_SIM_CLK_DIV, PM_SIM_CLK_GATE },
+    { 1, 2 }, 2, 0, 0, 0, 10, 1, false },
+  { "pl2_ref", PM_SIM_CLK_NODE_OUT,
+    { PM_SIM_CLK_MUX, PM_SIM_CLK_DIV, PM_SIM_CLK_GATE },
+    { 1, 2 }, 2, 0, 0, 0, 8, 1, false },
+  { "pl3_ref", PM_SIM_CLK_NODE_OUT,
+    { PM_SIM_CLK_MUX, PM_SIM_CLK_DIV, PM_SIM_CLK_GATE },
+    { 1, 2 }, 2, 0, 0, 0, 4, 1, false },
+};
+
+#define PM_SIM_CLOCKS (sizeof(sim_clocks) / sizeof(sim_clocks[0]))
+
+static uint64_t pm_sim_clock_rate(uint32_t id) {
+  const pm_sim_clock* clk = &sim_clocks[id];
+  if (clk->num_parents == 0) {
+    return PM_SIM_CLK_REF_RATE;
+  }
+  if (clk->mult != 0) {
+    const uint64_t ref = pm_sim_clock_rate(clk->parents[0]);
+    if (clk->mode == PM_SIM_PLL_MODE_RESET) {
+      return 0;
+    }
+    if (clk->mode == PM_SIM_PLL_MODE_FRAC) {
+      return (ref * clk->mult) + ((ref * clk->frac) >> 16);
+    }
+    return ref * clk->mult;
+  }
+  return pm_sim_clock_rate(clk->parents[clk->parent]) / clk->divider;
+}
+
+static void pm_sim_clock_words(
+  const uint32_t* words, size_t count, uint32_t index, uint32_t end,
+  pm_ret_payload* payload) {
+  payload->r1 = index < count ? words[index] : end;
+  payload->r2 = index + 1 < count ? words[index + 1] : end;
+  payload->r3 = index + 2 < count ? words[index + 2] : end;
+}
+
+/*
+ * Find a clock from its node id, an index alone is not a node id.
+ */
+static pm_sim_clock* pm_sim_clock_node(uint32_t node_id) {
+  const uint32_t index = node_id & PM_SIM_CLK_INDEX;
+  if (index >= PM_SIM_CLOCKS ||
+      (node_id & ~PM_SIM_CLK_INDEX) != sim_clocks[index].node) {
+    return NULL;
+  }
+  return &sim_clocks[index];
+}
+
+static int pm_sim_query_data(const uint32_t* args, pm_ret_payload* payload) {
+  const uint32_t id = args[1];
+  const pm_sim_clock* clk = id < PM_SIM_CLOCKS ? &sim_clocks[id] : NULL;
+  size_t nodes = 0;
+  payload->r0 = PM_STATUS_SUCCESS;
+  /*
+   * The max divisor query is for a node id, the others for an index.
+   */
+  if (args[0] == PM_QID_CLOCK_GET_MAX_DIVISOR) {
+    clk = pm_sim_clock_node(id);
+  }
+  if (args[0] == PM_QID_CLOCK_GET_NUM_CLOCKS) {
+    payload->r1 = PM_SIM_CLOCKS;
+    return 0;
+  }
+  if (clk == NULL) {
+    payload->r0 = PM_STATUS_INVALID_NODE;
+    return 0;
+  }
+  switch (args[0]) {
+    case PM_QID_CLOCK_GET_NAME:
+      /*
+       * The name is the whole payload, there is no status.
+       */
+      memset(payload, 0, sizeof(*payload));
+      strncpy((char*) payload, clk->name, sizeof(*payload) - 1);
+      break;
+    case PM_QID_CLOCK_GET_ATTRIBUTES:
+      payload->r1 = clk->node | 1;
+      break;
+    case PM_QID_CLOCK_GET_TOPOLOGY:
+      while (nodes < 3 && clk->topology[nodes] != 0) {
+        ++nodes;
+      }
+      pm_sim_clock_words(clk->topology, nodes, args[2], 0, payload);
+      break;
+    case PM_QID_CLOCK_GET_PARENTS:
+      pm_sim_clock_words(
+        clk->parents, clk->num_parents, args[2], PM_SIM_CLK_NA, payload);
+      break;
+    case PM_QID_CLOCK_GET_MAX_DIVISOR:
+      if (clk->num_parents < 2) {
+        payload->r0 = PM_STATUS_INVALID_NODE;
+      } else {
+        payload->r1 = PM_SIM_CLK_DIV_MAX;
+      }
+      break;
+    default:
+      payload->r0 = PM_STATUS_NO_FEATURE;
+      break;
+  }
+  return 0;
+}
+
+static pm_sim_clock* pm_sim_clock_get(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_node(args[0]);
+  payload->r0 = clk != NULL ? PM_STATUS_SUCCESS : PM_STATUS_INVALID_NODE;
+  return clk;
+}
+
+static int pm_sim_clock_enable(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    clk->enabled = true;
+  }
+  return 0;
+}
+
+static int pm_sim_clock_disable(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    clk->enabled = false;
+  }
+  return 0;
+}
+
+static int pm_sim_clock_getstate(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    payload->r1 = clk->enabled ? 1 : 0;
+  }
+  return 0;
+}
+
+/*
+ * Only the PL clocks have a divider and a mux.
+ */
+static int pm_sim_clock_setdivider(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    if (clk->num_parents < 2 || args[1] == 0 ||
+        args[1] > PM_SIM_CLK_DIV_MAX) {
+      payload->r0 = PM_STATUS_INTERNAL;
+    } else {
+      clk->divider = args[1];
+    }
+  }
+  return 0;
+}
+
+static int pm_sim_clock_getdivider(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    payload->r1 = clk->divider;
+  }
+  return 0;
+}
+
+static int pm_sim_clock_setrate(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  const uint64_t rate = ((uint64_t) args[2] << 32) | args[1];
+  if (clk != NULL) {
+    uint64_t divider;
+    if (clk->num_parents < 2 || rate == 0) {
+      payload->r0 = PM_STATUS_INTERNAL;
+      return 0;
+    }
+    divider =
+      (pm_sim_clock_rate(clk->parents[clk->parent]) + rate / 2) / rate;
+    if (divider == 0) {
+      divider = 1;
+    } else if (divider > PM_SIM_CLK_DIV_MAX) {
+      divider = PM_SIM_CLK_DIV_MAX;
+    }
+    clk->divider = divider;
+  }
+  return 0;
+}
+
+static int pm_sim_clock_getrate(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    const uint64_t rate = pm_sim_clock_rate(clk - sim_clocks);
+    payload->r1 = pm_lower_32(rate);
+    payload->r2 = pm_upper_32(rate);
+  }
+  return 0;
+}
+
+static int pm_sim_clock_setparent(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    if (clk->num_parents < 2 || args[1] >= clk->num_parents) {
+      payload->r0 = PM_STATUS_INTERNAL;
+    } else {
+      clk->parent = args[1];
+    }
+  }
+  return 0;
+}
+
+static int pm_sim_clock_getparent(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL) {
+    payload->r1 = clk->parent;
+  }
+  return 0;
+}
+
+static pm_sim_clock* pm_sim_pll_get(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_clock_get(args, payload);
+  if (clk != NULL && clk->mult == 0) {
+    payload->r0 = PM_STATUS_INVALID_NODE;
+    return NULL;
+  }
+  return clk;
+}
+
+static int pm_sim_pll_set_parameter(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_pll_get(args, payload);
+  if (clk != NULL) {
+    switch (args[1]) {
+      case PM_SIM_PLL_PARAM_FBDIV:
+        if (args[2] == 0) {
+          payload->r0 = PM_STATUS_INTERNAL;
+        } else {
+          clk->mult = args[2];
+        }
+        break;
+      case PM_SIM_PLL_PARAM_DATA:
+        clk->frac = args[2] & 0xffff;
+        break;
+      default:
+        payload->r0 = PM_STATUS_INTERNAL;
+        break;
+    }
+  }
+  return 0;
+}
+
+static int pm_sim_pll_get_parameter(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_pll_get(args, payload);
+  if (clk != NULL) {
+    switch (args[1]) {
+      case PM_SIM_PLL_PARAM_FBDIV:
+        payload->r1 = clk->mult;
+        break;
+      case PM_SIM_PLL_PARAM_DATA:
+        payload->r1 = clk->frac;
+        break;
+      default:
+        payload->r0 = PM_STATUS_INTERNAL;
+        break;
+    }
+  }
+  return 0;
+}
+
+static int pm_sim_pll_set_mode(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_pll_get(args, payload);
+  if (clk != NULL) {
+    if (args[1] > PM_SIM_PLL_MODE_RESET) {
+      payload->r0 = PM_STATUS_INTERNAL;
+    } else {
+      clk->mode = args[1];
+    }
+  }
+  return 0;
+}
+
+static int pm_sim_pll_get_mode(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_clock* clk = pm_sim_pll_get(args, payload);
+  if (clk != NULL) {
+    payload->r1 = clk->mode;
+  }
+  return 0;
+}
+
+/*
+ * Node requests. A request that powers a node up holds the caller for the
+ * wake time.
+ */
+#define PM_SIM_NODES            16
+#define PM_SIM_NODE_WAKE_USECS 250
+
+typedef struct {
+  uint32_t node;
+  uint32_t capabilities;
+  uint32_t max_latency;
+  bool used;
+  bool requested;
+} pm_sim_node;
+
+static pm_sim_node sim_nodes[PM_SIM_NODES];
+
+static pm_sim_node* pm_sim_node_get(uint32_t id, bool add) {
+  pm_sim_node* free_node = NULL;
+  size_t n;
+  for (n = 0; n < PM_SIM_NODES; ++n) {
+    pm_sim_node* node = &sim_nodes[n];
+    if (node->used && node->node == id) {
+      return node;
+    }
+    if (!node->used && free_node == NULL) {
+      free_node = node;
+    }
+  }
+  if (add && free_node != NULL) {
+    memset(free_node, 0, sizeof(*free_node));
+    free_node->node = id;
+    free_node->used = true;
+    return free_node;
+  }
+  return NULL;
+}
+
+static int pm_sim_request_node(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_node* node = pm_sim_node_get(args[0], true);
+  if (node == NULL) {
+    payload->r0 = PM_STATUS_INTERNAL;
+    return 0;
+  }
+  if (node->requested) {
+    payload->r0 = PM_STATUS_DOUBLE_REQ;
+    return 0;
+  }
+  pm_sim_delay_usecs(PM_SIM_NODE_WAKE_USECS);
+  node->capabilities = args[1];
+  node->requested = true;
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+static int pm_sim_release_node(const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_node* node = pm_sim_node_get(args[0], false);
+  if (node == NULL || !node->requested) {
+    payload->r0 = PM_STATUS_NO_ACCESS;
+    return 0;
+  }
+  node->requested = false;
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+static int pm_sim_set_requirement(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_node* node = pm_sim_node_get(args[0], false);
+  if (node == NULL || !node->requested) {
+    payload->r0 = PM_STATUS_NO_ACCESS;
+    return 0;
+  }
+  node->capabilities = args[1];
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+static int pm_sim_set_max_latency(
+  const uint32_t* args, pm_ret_payload* payload) {
+  pm_sim_node* node = pm_sim_node_get(args[0], true);
+  if (node == NULL) {
+    payload->r0 = PM_STATUS_INTERNAL;
+    return 0;
+  }
+  node->max_latency = args[1];
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+/*
+ * Resets. The asserted resets are held in a table, a pulse holds the
+ * caller for the pulse time.
+ */
+#define PM_SIM_RESETS            16
+#define PM_SIM_RESET_PULSE_USECS 10
+
+static uint32_t sim_resets[PM_SIM_RESETS];
+
+static int pm_sim_reset_find(uint32_t reset) {
+  int r;
+  for (r = 0; r < PM_SIM_RESETS; ++r) {
+    if (sim_resets[r] == reset) {
+      return r;
+    }
+  }
+  return -1;
+}
+
+static int pm_sim_reset_assert(const uint32_t* args, pm_ret_payload* payload) {
+  const int slot = pm_sim_reset_find(args[0]);
+  payload->r0 = PM_STATUS_SUCCESS;
+  switch (args[1]) {
+    case RTEMS_PM_RESET_RELEASE:
+      if (slot >= 0) {
+        sim_resets[slot] = 0;
+      }
+      break;
+    case RTEMS_PM_RESET_ASSERT:
+      if (slot < 0) {
+        const int free_slot = pm_sim_reset_find(0);
+        if (free_slot < 0) {
+          payload->r0 = PM_STATUS_INTERNAL;
+        } else {
+          sim_resets[free_slot] = args[0];
+        }
+      }
+      break;
+    case RTEMS_PM_RESET_PULSE:
+      pm_sim_delay_usecs(PM_SIM_RESET_PULSE_USECS);
+      if (slot >= 0) {
+        sim_resets[slot] = 0;
+      }
+      break;
+    default:
+      payload->r0 = PM_STATUS_INTERNAL;
+      break;
+  }
+  return 0;
+}
+
+static int pm_sim_reset_get_status(
+  const uint32_t* args, pm_ret_payload* payload) {
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = pm_sim_reset_find(args[0]) >= 0 ? 1 : 0;
+  return 0;
+}
+
+/*
+ * Secure MMIO. A block of registers the firmware allows access to, other
+ * addresses are refused.
+ */
+#define PM_SIM_MMIO_BASE 0xf6000000
+#define PM_SIM_MMIO_REGS 256
+
+static uint32_t sim_mmio[PM_SIM_MMIO_REGS];
+
+static uint32_t* pm_sim_mmio_reg(uint32_t address) {
+  const uint32_t reg = (address - PM_SIM_MMIO_BASE) / sizeof(uint32_t);
+  if (address < PM_SIM_MMIO_BASE || (address & 3) != 0 ||
+      reg >= PM_SIM_MMIO_REGS) {
+    return NULL;
+  }
+  return &sim_mmio[reg];
+}
+
+static int pm_sim_mmio_write(const uint32_t* args, pm_ret_payload* payload) {
+  uint32_t* reg = pm_sim_mmio_reg(args[0]);
+  if (reg == NULL) {
+    payload->r0 = PM_STATUS_NO_ACCESS;
+    return 0;
+  }
+  *reg = (*reg & ~args[1]) | (args[2] & args[1]);
+  payload->r0 = PM_STATUS_SUCCESS;
+  return 0;
+}
+
+static int pm_sim_mmio_read(const uint32_t* args, pm_ret_payload* payload) {
+  const uint32_t* reg = pm_sim_mmio_reg(args[0]);
+  if (reg == NULL) {
+    payload->r0 = PM_STATUS_NO_ACCESS;
+    return 0;
+  }
+  payload->r0 = PM_STATUS_SUCCESS;
+  payload->r1 = *reg;
+  return 0;
+}
+
+static int pm_sim_feature_check(const uint32_t* args, pm_ret_payload* payload);
+
+static pm_sim_api sim_apis[PM_API_MAX] = {
+  [PM_GET_API_VERSION] = { pm_sim_api_version, 2 },
+  [PM_FPGA_LOAD] = { pm_sim_fpga_load, 5000 },
+  [PM_FPGA_GET_STATUS] = { pm_sim_fpga_get_status, 2 },
+  [PM_FPGA_READ] = { pm_sim_fpga_read, 20 },
+  [PM_MMIO_WRITE] = { pm_sim_mmio_write, 2 },
+  [PM_MMIO_READ] = { pm_sim_mmio_read, 2 },
+  [PM_GET_CHIPID] = { pm_sim_chipid, 2 },
+  [PM_FEATURE_CHECK] = { pm_sim_feature_check, 2 },
+  [PM_LOAD_PDI] = { pm_sim_load_pdi, 5000 },
+  [PM_GET_UID_INFO_LIST] = { pm_sim_uid_info_list, 20 },
+  [PM_SECURE_SHA] = { pm_sim_secure_sha, 2 },
+  [PM_REGISTER_NOTIFIER] = { pm_sim_register_notifier, 2 },
+  [GET_CALLBACK_DATA] = { pm_sim_get_callback_data, 2 },
+  [TF_A_PM_REGISTER_SGI] = { pm_sim_register_sgi, 2 },
+  [PM_RESET_ASSERT] = { pm_sim_reset_assert, 2 },
+  [PM_RESET_GET_STATUS] = { pm_sim_reset_get_status, 2 },
+  [PM_REQUEST_NODE] = { pm_sim_request_node, 2 },
+  [PM_RELEASE_NODE] = { pm_sim_release_node, 2 },
+  [PM_SET_REQUIREMENT] = { pm_sim_set_requirement, 2 },
+  [PM_SET_MAX_LATENCY] = { pm_sim_set_max_latency, 2 },
+  [PM_QUERY_DATA] = { pm_sim_query_data, 2 },
+  [PM_CLOCK_ENABLE] = { pm_sim_clock_enable, 2 },
+  [PM_CLOCK_DISABLE] = { pm_sim_clock_disable, 2 },
+  [PM_CLOCK_GETSTATE] = { pm_sim_clock_getstate, 2 },
+  [PM_CLOCK_SETDIVIDER] = { pm_sim_clock_setdivider, 2 },
+  [PM_CLOCK_GETDIVIDER] = { pm_sim_clock_getdivider, 2 },
+  [PM_CLOCK_SETRATE] = { pm_sim_clock_setrate, 2 },
+  [PM_CLOCK_GETRATE] = { pm_sim_clock_getrate, 2 },
+  [PM_CLOCK_SETPARENT] = { pm_sim_clock_setparent, 2 },
+  [PM_CLOCK_GETPARENT] = { pm_sim_clock_getparent, 2 },
+  [PM_PLL_SET_PARAMETER] = { pm_sim_pll_set_parameter, 20 },
+  [PM_PLL_GET_PARAMETER] = { pm_sim_pll_get_parameter, 2 },
+  [PM_PLL_SET_MODE] = { pm_sim_pll_set_mode, 20 },
+  [PM_PLL_GET_MODE] = { pm_sim_pll_get_mode, 2 },
+};
+
+static int pm_sim_feature_check(const uint32_t* args, pm_ret_payload* payload) {
+  pm_api_id api_id = pm_api_from_sip_id(args[0]);
+  if (api_id < PM_API_MAX && sim_apis[api_id].handler != NULL) {
+    payload->r0 = PM_STATUS_SUCCESS;
+    payload->r1 = api_id == PM_QUERY_DATA ? PM_QUERY_DATA_EXT_VERSION : 1;
+  } else {
+    payload->r0 = PM_STATUS_NO_FEATURE;
+  }
+  return 0;
+}
+
+static int pm_sim_call(
+  uint32_t func_id, uint64_t a64_0, uint64_t a64_1, uint64_t a64_2,
+  struct arm_smccc_res* res) {
+  const uint32_t args[5] = {
+    pm_lower_32(a64_0), pm_upper_32(a64_0),
+    pm_lower_32(a64_1), pm_upper_32(a64_1),
+    pm_lower_32(a64_2)
+  };
+  pm_ret_payload payload = { PM_STATUS_NO_FEATURE, 0, 0, 0 };
+  pm_api_id api_id = PM_API_MAX;
+  if (((func_id >> 24) & 0x3f) == SMCCC_SIP_SERVICE_CALLS) {
+    api_id = pm_api_from_sip_id(func_id & 0xffff);
+  }
+  if (api_id < PM_API_MAX && sim_apis[api_id].handler != NULL) {
+    pm_sim_delay_usecs(sim_apis[api_id].latency_usecs);
+    sim_apis[api_id].handler(args, &payload);
+  } else if (api_id == PM_API_MAX) {
+    /*
+     * Not a call TF-A knows about.
+     */
+    res->a0 = SMCCC_RET_NOT_SUPPORTED;
+    res->a1 = res->a2 = res->a3 = 0;
+    return SMCCC_RET_NOT_SUPPORTED;
+  }
+  /*
+   * TF-A packs the payload words two to a register.
+   */
+  res->a0 = ((uint64_t) payload.r1 << 32) | payload.r0;
+  res->a1 = ((uint64_t) payload.r3 << 32) | payload.r2;
+  res->a2 = res->a3 = 0;
+  return (int) payload.r0;
+}
+
+/*
+ * An SMCCC 1.2 call. A paged clock query returns the pages that follow
+ * the first in x4 to x15 for one call's latency.
+ */
+static int pm_sim_call_ext(
+  const struct arm_smccc_1_2_regs* args, struct arm_smccc_1_2_regs* res) {
+  struct arm_smccc_res res_;
+  uint32_t qargs[5];
+  uint32_t w;
+  int ret;
+  memset(res, 0, sizeof(*res));
+  ret = pm_sim_call(args->a[0], args->a[1], args->a[2], args->a[3], &res_);
+  res->a[0] = pm_lower_32(res_.a0);
+  res->a[1] = pm_upper_32(res_.a0);
+  res->a[2] = pm_lower_32(res_.a1);
+  res->a[3] = pm_upper_32(res_.a1);
+  if (ret != 0 ||
+      pm_api_from_sip_id(args->a[0] & 0xffff) != PM_QUERY_DATA ||
+      (pm_lower_32(args->a[1]) != PM_QID_CLOCK_GET_TOPOLOGY &&
+       pm_lower_32(args->a[1]) != PM_QID_CLOCK_GET_PARENTS)) {
+    return ret;
+  }
+  qargs[0] = pm_lower_32(args->a[1]);
+  qargs[1] = pm_upper_32(args->a[1]);
+  qargs[2] = pm_lower_32(args->a[2]);
+  qargs[3] = pm_upper_32(args->a[2]);
+  qargs[4] = 0;
+  for (w = 3; w < PM_QUERY_EXT_WORDS; w += 3) {
+    pm_ret_payload payload = { PM_STATUS_SUCCESS, 0, 0, 0 };
+    qargs[2] += 3;
+    pm_sim_query_data(qargs, &payload);
+    res->a[w + 1] = payload.r1;
+    res->a[w + 2] = payload.r2;
+    res->a[w + 3] = payload.r3;
+  }
+  return ret;
+}
+
+static int pm_sim_init(void) {
+  sim_fpga_status = 0;
+  sim_upset_count = 0;
+  sim_resident_count = 0;
+  memset(sim_mmio, 0, sizeof(sim_mmio));
+  return 0;
+}
+
+const pm_backend_ops pm_backend_sim = {
+  .name = "sim",
+  .flags = PM_BACKEND_FPGA_READ_FRAME | PM_BACKEND_QUERY_EXT,
+  .init = pm_sim_init,
+  .call = pm_sim_call,
+  .call_ext = pm_sim_call_ext
+};
+
+int rtems_pm_sim_set_latency(pm_api_id api_id, uint32_t usecs) {
+  if (api_id >= PM_API_MAX || sim_apis[api_id].handler == NULL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  sim_apis[api_id].latency_usecs = usecs;
+  return 0;
+}
+
+uint32_t rtems_pm_sim_get_latency(pm_api_id api_id) {
+  if (api_id >= PM_API_MAX) {
+    return 0;
+  }
+  return sim_apis[api_id].latency_usecs;
+}
+
+void rtems_pm_sim_set_load_rate(uint32_t kib_per_msec) {
+  sim_load_rate_kib_per_msec = kib_per_msec;
+}
+
+int rtems_pm_sim_notify(uint32_t node, uint32_t event, uint32_t data) {
+  size_t n;
+  rtems_mutex_lock(&sim_notify_lock);
+  for (n = 0; n < PM_SIM_NOTIFIERS; ++n) {
+    if ((sim_notifiers[n].events & event) != 0 && sim_notifiers[n].node == node) {
+      break;
+    }
+  }
+  if (n == PM_SIM_NOTIFIERS || !sim_sgi_registered) {
+    rtems_mutex_unlock(&sim_notify_lock);
+    errno = ENOENT;
+    return -1;
+  }
+  if (sim_callback_count == PM_SIM_CALLBACKS) {
+    rtems_mutex_unlock(&sim_notify_lock);
+    errno = EAGAIN;
+    return -1;
+  }
+  sim_callbacks[(sim_callback_head + sim_callback_count) % PM_SIM_CALLBACKS] =
+    (pm_sim_callback) { node, event & sim_notifiers[n].events, data };
+  ++sim_callback_count;
+  rtems_mutex_unlock(&sim_notify_lock);
+  pm_notify_raise();
+  return 0;
+}
+
+int rtems_pm_sim_fpga_upset(uint32_t frame, uint32_t word, uint32_t bit) {
+  if (frame >= PM_SIM_FPGA_FRAMES || word >= RTEMS_PM_FPGA_FRAME_WORDS ||
+      bit >= 32) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (sim_upset_count == PM_SIM_FPGA_UPSETS) {
+    errno = ENOSPC;
+    return -1;
+  }
+  sim_upsets[sim_upset_count++] = (pm_sim_upset) { frame, word, 1U << bit };
+  return 0;
+}
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ *  COPYRIGHT (c) 2022 Contemporary Software
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Load path phase statistics.
+ *
+ * The phases are timed with the 64-bit uptime in nanoseconds and the times
+ * are added to a histogram per phase. A phase is recorded once per load so
+ * a lock is fine.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <rtems.h>
+#include <rtems/thread.h>
+
+#include <rtems/pm/pm.h>
+
+#include "pm-private.h"
+
+static const char* phase_names[RTEMS_PM_PHASE_MAX] = {
+  "read",
+  "verify",
+  "clean",
+  "digest",
+  "plm",
+  "load",
+};
+
+static rtems_mutex phase_lock = RTEMS_MUTEX_INITIALIZER("PM Phase Stats");
+static rtems_pm_phase_stats phase_stats[RTEMS_PM_PHASE_MAX];
+
+static uint32_t pm_phase_bucket(uint64_t ns) {
+  uint32_t bucket = 0;
+  while (ns > 1 && bucket < RTEMS_PM_PHASE_BUCKETS - 1) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+uint64_t pm_phase_start(void) {
+  return rtems_clock_get_uptime_nanoseconds();
+}
+
+void pm_phase_record_ns(rtems_pm_phase phase, uint64_t ns) {
+  rtems_pm_phase_stats* stats = &phase_stats[phase];
+  rtems_mutex_lock(&phase_lock);
+  if (stats->count == 0 || ns < stats->min_ns) {
+    stats->min_ns = ns;
+  }
+  if (ns > stats->max_ns) {
+    stats->max_ns = ns;
+  }
+  ++stats->count;
+  stats->total_ns += ns;
+  ++stats->buckets[pm_phase_bucket(ns)];
+  rtems_mutex_unlock(&phase_lock);
+}
+
+void pm_phase_record(rtems_pm_phase phase, uint64_t start) {
+  pm_phase_record_ns(phase, rtems_clock_get_uptime_nanoseconds() - start);
+}
+
+const char* rtems_pm_phase_name(rtems_pm_phase phase) {
+  if (phase >= RTEMS_PM_PHASE_MAX) {
+    return "invalid";
+  }
+  return phase_names[phase];
+}
+
+int rtems_pm_phase_stats_get(rtems_pm_phase phase, rtems_pm_phase_stats* stats) {
+  if (phase >= RTEMS_PM_PHASE_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  rtems_mutex_lock(&phase_lock);
+  *stats = phase_stats[phase];
+  rtems_mutex_unlock(&phase_lock);
+  return 0;
+}
+
+void rtems_pm_phase_stats_reset(void) {
+  rtems_mutex_lock(&phase_lock);
+  memset(phase_stats, 0, sizeof(phase_stats));
+  rtems_mutex_unlock(&phase_lock);
+}
@@ -25,12 +25,14 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <rtems.h>
+#include <rtems/counter.h>
 #include <rtems/pm/pm.h>
 #include <rtems/sysinit.h>
 #include <rtems/thread.h>
@@ -40,14 +42,9 @@
 #include <smc/smccc.h>
 #include <rtems/pm/pm.h>
 
+#include "pm-private.h"
 #include "pm-trace.h"
-
-typedef struct {
-  uint32_t r0;
-  uint32_t r1;
-  uint32_t r2;
-  uint32_t r3;
-} pm_ret_payload;
+#include "xilpdi.h"
 
 RTEMS_SYSINIT_ITEM(
   rtems_smccc_init,
@@ -57,13 +54,6 @@ RTEMS_SYSINIT_ITEM(
 
 int rtems_pm_trace = PM_TRACE_DEBUG | PM_TRACE_IOCTL;
 static rtems_mutex fpga_lock = RTEMS_MUTEX_INITIALIZER("pm/fpga");
-static uint32_t api_feature_status[PM_API_MAX];
-
-#ifdef BSP_RESET_SMC
-#define ARM_SMCCC_CALL arm_smccc_smc
-#else
-#define ARM_SMCCC_CALL arm_smccc_hvc
-#endif /* BSP_RESET_SMC */
 
 #define SMCCC_ARM_ID(_id) SMCCC_FUNC_ID(SMCCC_FAST_CALL, SMCCC_32BIT_CALL, 0, _id)
 #define SMCCC_STD_ID(_id) SMCCC_FUNC_ID(SMCCC_FAST_CALL, SMCCC_32BIT_CALL, 4, _id)
@@ -153,22 +143,21 @@ static uint32_t sip_api_id[PM_API_MAX] = {
 /*
  * Translate the enum to the actual value.
  */
-static uint32_t pm_sip_api_id(const pm_api_id api_id) {
+uint32_t pm_sip_api_id(const pm_api_id api_id) {
   if (api_id < PM_API_MAX) {
     return sip_api_id[api_id];
   }
   return 0;
 }
 
-static uint32_t pm_lower_32(uint64_t u64) {
-  return (uint32_t) (u64 & 0xffffffff);
-}
-
-static uint32_t pm_upper_32(uint64_t u64) {
-  /*
-   * Shift as 2 x 16 to supress a shift by 32 warning
-   */
-  return (uint32_t) ((u64 >> 16) >> 16);
+pm_api_id pm_api_from_sip_id(uint32_t sip_id) {
+  pm_api_id api_id;
+  for (api_id = 0; api_id < PM_API_MAX; ++api_id) {
+    if (sip_api_id[api_id] == sip_id) {
+      return api_id;
+    }
+  }
+  return PM_API_MAX;
 }
 
 static int pm_result(int result, uint32_t res_a0) {
@@ -213,6 +202,10 @@ static int pm_result(int result, uint32_t res_a0) {
   return -1;
 }
 
+/*
+ * TF-A returns the payload words two to a register, x0 is the status and
+ * word 1 and x1 is words 2 and 3.
+ */
 static int pm_invoke(
   uint32_t api_id, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3,
   uint32_t arg4, pm_ret_payload* res)
@@ -221,11 +214,19 @@ static int pm_invoke(
   uint64_t a64_0 = ((uint64_t) arg1 << 32) | ((uint64_t) arg0);
   uint64_t a64_1 = ((uint64_t) arg3 << 32) | ((uint64_t) arg2);
   uint64_t a64_2 = (uint64_t) arg4;
-  int ret = ARM_SMCCC_CALL(api_id, a64_0, a64_1, a64_2, 0, 0, 0, 0, &res_);
+  int ret;
+  if (pm_call_trace_on) {
+    rtems_counter_ticks entry = rtems_counter_read();
+    ret = pm_backend_get()->call(api_id, a64_0, a64_1, a64_2, &res_);
+    pm_call_trace_record(
+      api_id, a64_0, a64_1, a64_2, ret, &res_, entry, rtems_counter_read());
+  } else {
+    ret = pm_backend_get()->call(api_id, a64_0, a64_1, a64_2, &res_);
+  }
   res->r0 = pm_lower_32(res_.a0);
-  res->r1 = pm_lower_32(res_.a1);
-  res->r2 = pm_lower_32(res_.a2);
-  res->r3 = pm_lower_32(res_.a3);
+  res->r1 = pm_upper_32(res_.a0);
+  res->r2 = pm_lower_32(res_.a1);
+  res->r3 = pm_upper_32(res_.a1);
   return ret;
 }
 
@@ -247,29 +248,117 @@ static int pm_invoke_sip(
   return pm_result(ret, res->r0);
 }
 
-static RTEMS_UNUSED int pm_feature(uint32_t api_id) {
+int rtems_pm_feature_query(pm_api_id api_id, uint32_t* version) {
   pm_ret_payload res;
-  int r =
-    pm_invoke_sip(PM_FEATURE_CHECK, api_id, 0, 0, 0, 0, &res);
+  int r;
+  if (api_id >= PM_API_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  r = pm_invoke_sip(
+    PM_FEATURE_CHECK, pm_sip_api_id(api_id), 0, 0, 0, 0, &res);
+  if (r == 0) {
+    *version = res.r1;
+  }
   return r;
 }
 
+/*
+ * The capabilities are probed into the table not published and then that
+ * table is published, the two tables alternate. A reader holds a table for
+ * a call and a probe reuses the table published two probes earlier. Probes
+ * are rare, at start up and when the backend changes.
+ */
+static rtems_pm_caps caps_tables[2];
+static _Atomic(const rtems_pm_caps*) caps_current;
+static uint32_t caps_generation;
+static rtems_mutex caps_lock = RTEMS_MUTEX_INITIALIZER("pm/caps");
+
+/*
+ * Probe all the APIs and publish the table. The probe is not locked when
+ * called from system initialisation.
+ */
+static int pm_caps_build(void) {
+  rtems_pm_caps* caps = &caps_tables[0];
+  rtems_counter_ticks start = rtems_counter_read();
+  pm_api_id api_id;
+  if (atomic_load_explicit(&caps_current, memory_order_relaxed) == caps) {
+    caps = &caps_tables[1];
+  }
+  memset(caps, 0, sizeof(*caps));
+  caps->generation = ++caps_generation;
+  caps->backend = rtems_pm_backend_current();
+  for (api_id = 0; api_id < PM_API_MAX; ++api_id) {
+    pm_ret_payload res;
+    int r = pm_invoke_sip(
+      PM_FEATURE_CHECK, pm_sip_api_id(api_id), 0, 0, 0, 0, &res);
+    if (r == 0) {
+      caps->present[api_id / 64] |= UINT64_C(1) << (api_id % 64);
+      caps->version[api_id] = res.r1;
+    } else {
+      caps->error[api_id] = res.r0 == PM_STATUS_NO_FEATURE ? ENOTSUP : errno;
+    }
+  }
+  caps->probe_ns = rtems_counter_ticks_to_nanoseconds(
+    rtems_counter_difference(rtems_counter_read(), start));
+  atomic_store_explicit(&caps_current, caps, memory_order_release);
+  return 0;
+}
+
+static void pm_caps_sysinit(void) {
+  pm_caps_build();
+}
+
+RTEMS_SYSINIT_ITEM(
+  pm_caps_sysinit,
+  RTEMS_SYSINIT_DRVMGR,
+  RTEMS_SYSINIT_ORDER_SECOND
+);
+
+static const rtems_pm_caps* pm_caps_get(void) {
+  const rtems_pm_caps* caps =
+    atomic_load_explicit(&caps_current, memory_order_acquire);
+  if (caps == NULL) {
+    rtems_pm_caps_probe();
+    caps = atomic_load_explicit(&caps_current, memory_order_acquire);
+  }
+  return caps;
+}
+
+int rtems_pm_caps_probe(void) {
+  int r;
+  rtems_mutex_lock(&caps_lock);
+  r = pm_caps_build();
+  rtems_mutex_unlock(&caps_lock);
+  return r;
+}
+
+bool rtems_pm_caps_present(pm_api_id api_id) {
+  const rtems_pm_caps* caps;
+  if (api_id >= PM_API_MAX) {
+    return false;
+  }
+  caps = pm_caps_get();
+  return (caps->present[api_id / 64] & (UINT64_C(1) << (api_id % 64))) != 0;
+}
+
+int rtems_pm_caps_snapshot(rtems_pm_caps* caps) {
+  memcpy(caps, pm_caps_get(), sizeof(*caps));
+  return 0;
+}
+
 int rtems_pm_feature_check(pm_api_id api_id) {
-  int r = 0;
+  const rtems_pm_caps* caps;
   if (api_id >= PM_API_MAX) {
     errno = EINVAL;
     return -1;
   }
-  if (api_feature_status[api_id] == 0) {
-    pm_ret_payload res;
-    r = pm_invoke_sip(PM_FEATURE_CHECK, pm_sip_api_id(api_id), 0, 0, 0, 0, &res);
-    api_feature_status[api_id] = res.r0;
-  }
-  if (api_feature_status[api_id] == PM_STATUS_NO_FEATURE) {
-    errno = ENOTSUP;
-    r = -1;
+  caps = pm_caps_get();
+  if ((caps->present[api_id / 64] & (UINT64_C(1) << (api_id % 64))) == 0) {
+    errno = caps->error[api_id];
+    return -1;
   }
-  return r;
+  return 0;
 }
 
 uint32_t rtems_pm_get_api_id(pm_api_id api_id) {
@@ -304,14 +393,71 @@ int rtems_pm_chipid(pm_data_chipid* chipid) {
   return r;
 }
 
+static rtems_pm_clean_strategy clean_strategy = RTEMS_PM_CLEAN_FULL;
+
+static const char* clean_strategy_names[RTEMS_PM_CLEAN_MAX] = {
+  "full",
+  "partitions",
+  "none",
+};
+
+void rtems_pm_clean_strategy_set(rtems_pm_clean_strategy strategy) {
+  if (strategy < RTEMS_PM_CLEAN_MAX) {
+    clean_strategy = strategy;
+  }
+}
+
+rtems_pm_clean_strategy rtems_pm_clean_strategy_get(void) {
+  return clean_strategy;
+}
+
+const char* rtems_pm_clean_strategy_name(rtems_pm_clean_strategy strategy) {
+  if (strategy >= RTEMS_PM_CLEAN_MAX) {
+    return "invalid";
+  }
+  return clean_strategy_names[strategy];
+}
+
+/*
+ * Clean the data cache for an image before the PLM reads it. An image that
+ * is not a PDI is cleaned in full with the partition strategy.
+ */
+static void pm_image_clean(
+  const void* image, size_t size, const rtems_pm_pdi_index* index) {
+  const uint64_t start = pm_phase_start();
+  switch (clean_strategy) {
+    case RTEMS_PM_CLEAN_PARTITIONS:
+      if (index != NULL) {
+        rtems_pm_pdi_clean(index);
+        break;
+      }
+      rtems_cache_flush_multiple_data_lines(image, size);
+      break;
+    case RTEMS_PM_CLEAN_NONE:
+      return;
+    case RTEMS_PM_CLEAN_FULL:
+    default:
+      rtems_cache_flush_multiple_data_lines(image, size);
+      break;
+  }
+  pm_phase_record(RTEMS_PM_PHASE_CLEAN, start);
+}
+
 int rtems_pm_fpga_load(
   const void* image, size_t size, uint32_t flags, uint32_t* status) {
   pm_ret_payload res;
+  rtems_pm_pdi_index index;
   const uint64_t addr = (intptr_t) image;
   int r;
-  rtems_cache_flush_multiple_data_lines(image, size);
+  if (clean_strategy == RTEMS_PM_CLEAN_PARTITIONS &&
+      rtems_pm_pdi_index_build(&index, image, size) == RTEMS_PM_IMAGE_SUCCESS) {
+    pm_image_clean(image, size, &index);
+  } else {
+    pm_image_clean(image, size, NULL);
+  }
   r = pm_invoke_sip(
     PM_FPGA_LOAD, pm_lower_32(addr), pm_upper_32(addr), size, flags, 0, &res);
+  rtems_pm_clock_invalidate();
   *status = res.r0;
   return r;
 }
@@ -328,65 +474,631 @@ int rtems_pm_fpga_get_status(uint32_t* status) {
   return r;
 }
 
-int rtems_pm_acap_load(const void* image, size_t size, uint32_t* status) {
+int rtems_pm_fpga_read(uint32_t frame, uint32_t frames, void* buffer) {
+  pm_ret_payload res;
+  const uint64_t addr = (intptr_t) buffer;
+  const size_t size = frames * RTEMS_PM_FPGA_FRAME_SIZE;
+  int r;
+  if (frames == 0 || buffer == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (frame != 0 &&
+      (pm_backend_get()->flags & PM_BACKEND_FPGA_READ_FRAME) == 0) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  /*
+   * The PMC writes the frames to memory, invalidate before the read so no
+   * dirty line is written over them and after to drop lines read early.
+   */
+  rtems_cache_invalidate_multiple_data_lines(buffer, size);
+  r = pm_invoke_sip(
+    PM_FPGA_READ, frames, pm_lower_32(addr), pm_upper_32(addr),
+    RTEMS_PM_FPGA_READ_CONFIG, frame, &res);
+  rtems_cache_invalidate_multiple_data_lines(buffer, size);
+  return r;
+}
+
+int rtems_pm_fpga_read_register(uint32_t reg, uint32_t* value) {
+  pm_ret_payload res;
+  int r = pm_invoke_sip(
+    PM_FPGA_READ, reg, 0, 0, RTEMS_PM_FPGA_READ_REGISTER, 0, &res);
+  if (r == 0) {
+    *value = res.r1;
+  }
+  return r;
+}
+
+int rtems_pm_reset(uint32_t reset, rtems_pm_reset_action action) {
+  pm_ret_payload res;
+  if (action >= RTEMS_PM_RESET_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  return pm_invoke_sip(PM_RESET_ASSERT, reset, action, 0, 0, 0, &res);
+}
+
+int rtems_pm_reset_get_status(uint32_t reset, bool* asserted) {
+  pm_ret_payload res;
+  int r = pm_invoke_sip(PM_RESET_GET_STATUS, reset, 0, 0, 0, 0, &res);
+  if (r == 0) {
+    *asserted = res.r1 != 0;
+  }
+  return r;
+}
+
+static rtems_mutex mmio_lock = RTEMS_MUTEX_INITIALIZER("pm/mmio");
+
+/*
+ * Check only the calls used, a firmware can allow reads and not writes.
+ */
+static int pm_mmio_feature_check(bool read, bool write) {
+  if (read && rtems_pm_feature_check(PM_MMIO_READ) < 0) {
+    return -1;
+  }
+  if (write && rtems_pm_feature_check(PM_MMIO_WRITE) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Call with the MMIO lock held.
+ */
+static int pm_mmio_op(rtems_pm_mmio_op* op) {
   pm_ret_payload res;
-  const void* ihdrtab;
-  const uint64_t addr = (intptr_t) image;
   int r;
-  ihdrtab = rtems_pm_acap_image_header(image);
-  if (ihdrtab == NULL) {
-    rtems_pm_image_status status;
-    status = rtems_pm_acap_verify_boot_header(image);
-    if (status == RTEMS_PM_IMAGE_SUCCESS) {
-      printf("error: ACAP image: boot PDI images cannot be loaded\n");
+  switch (op->op) {
+    case RTEMS_PM_MMIO_READ:
+      r = pm_invoke_sip(PM_MMIO_READ, op->address, 0, 0, 0, 0, &res);
+      if (r == 0) {
+        op->value = res.r1;
+      }
+      break;
+    case RTEMS_PM_MMIO_WRITE:
+    case RTEMS_PM_MMIO_MASK:
+      r = pm_invoke_sip(
+        PM_MMIO_WRITE, op->address, op->mask, op->value, 0, 0, &res);
+      break;
+    default:
+      errno = EINVAL;
+      r = -1;
+      break;
+  }
+  return r;
+}
+
+int rtems_pm_mmio_read(uint32_t address, uint32_t* value) {
+  rtems_pm_mmio_op op = RTEMS_PM_MMIO_READ_OP(address);
+  int r = pm_mmio_feature_check(true, false);
+  if (r == 0) {
+    rtems_mutex_lock(&mmio_lock);
+    r = pm_mmio_op(&op);
+    rtems_mutex_unlock(&mmio_lock);
+    *value = op.value;
+  }
+  return r;
+}
+
+int rtems_pm_mmio_write(uint32_t address, uint32_t mask, uint32_t value) {
+  rtems_pm_mmio_op op = RTEMS_PM_MMIO_MASK_OP(address, mask, value);
+  int r = pm_mmio_feature_check(false, true);
+  if (r == 0) {
+    rtems_mutex_lock(&mmio_lock);
+    r = pm_mmio_op(&op);
+    rtems_mutex_unlock(&mmio_lock);
+  }
+  return r;
+}
+
+int rtems_pm_mmio_batch(rtems_pm_mmio_op* ops, size_t count, size_t* done) {
+  bool read = false;
+  bool write = false;
+  size_t o;
+  int r;
+  if (done != NULL) {
+    *done = 0;
+  }
+  for (o = 0; o < count; ++o) {
+    if (ops[o].op == RTEMS_PM_MMIO_READ) {
+      read = true;
     } else {
-      printf("error: ACAP image: corrupt image\n");
+      write = true;
     }
+  }
+  r = pm_mmio_feature_check(read, write);
+  if (r < 0) {
+    return r;
+  }
+  rtems_mutex_lock(&mmio_lock);
+  for (o = 0; o < count; ++o) {
+    r = pm_mmio_op(&ops[o]);
+    if (r < 0) {
+      break;
+    }
+  }
+  rtems_mutex_unlock(&mmio_lock);
+  if (done != NULL) {
+    *done = o;
+  }
+  return r;
+}
+
+static rtems_pm_sha3_engine sha3_engine = RTEMS_PM_SHA3_AUTO;
+static rtems_mutex sha3_lock = RTEMS_MUTEX_INITIALIZER("pm/sha3");
+
+static const char* sha3_engine_names[RTEMS_PM_SHA3_MAX] = {
+  "auto",
+  "pmc",
+  "software",
+};
+
+void rtems_pm_sha3_engine_set(rtems_pm_sha3_engine engine) {
+  if (engine < RTEMS_PM_SHA3_MAX) {
+    sha3_engine = engine;
+  }
+}
+
+rtems_pm_sha3_engine rtems_pm_sha3_engine_get(void) {
+  return sha3_engine;
+}
+
+const char* rtems_pm_sha3_engine_name(rtems_pm_sha3_engine engine) {
+  if (engine >= RTEMS_PM_SHA3_MAX) {
+    return "invalid";
+  }
+  return sha3_engine_names[engine];
+}
+
+/*
+ * The PM_SECURE_SHA operations. The update and final calls pass an address
+ * and a 32bit size so large buffers are passed in parts.
+ */
+#define PM_SHA3_INIT   1
+#define PM_SHA3_UPDATE 2
+#define PM_SHA3_FINAL  4
+#define PM_SHA3_PMC_CHUNK (64 * 1024 * 1024)
+
+static int pm_sha3_pmc(const void* data, size_t size, uint8_t* digest) {
+  const size_t line = rtems_cache_get_data_line_size();
+  const size_t out_size =
+    (RTEMS_PM_SHA3_384_SIZE + line - 1) & ~(line - 1);
+  const uint8_t* in = data;
+  pm_ret_payload res;
+  uint8_t* out;
+  uint64_t addr;
+  int r;
+  out = rtems_cache_aligned_malloc(out_size);
+  if (out == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  rtems_mutex_lock(&sha3_lock);
+  r = pm_invoke_sip(PM_SECURE_SHA, 0, 0, 0, PM_SHA3_INIT, 0, &res);
+  while (r == 0 && size > 0) {
+    const size_t chunk = size > PM_SHA3_PMC_CHUNK ? PM_SHA3_PMC_CHUNK : size;
+    addr = (intptr_t) in;
+    r = pm_invoke_sip(
+      PM_SECURE_SHA, pm_upper_32(addr), pm_lower_32(addr), chunk,
+      PM_SHA3_UPDATE, 0, &res);
+    in += chunk;
+    size -= chunk;
+  }
+  if (r == 0) {
+    /*
+     * No dirty line can be written over the digest the PMC writes.
+     */
+    rtems_cache_invalidate_multiple_data_lines(out, out_size);
+    addr = (intptr_t) out;
+    r = pm_invoke_sip(
+      PM_SECURE_SHA, pm_upper_32(addr), pm_lower_32(addr),
+      RTEMS_PM_SHA3_384_SIZE, PM_SHA3_FINAL, 0, &res);
+    rtems_cache_invalidate_multiple_data_lines(out, out_size);
+  }
+  rtems_mutex_unlock(&sha3_lock);
+  if (r == 0) {
+    memcpy(digest, out, RTEMS_PM_SHA3_384_SIZE);
+  }
+  free(out);
+  return r;
+}
+
+/*
+ * The data only needs cleaning if the PMC reads it.
+ */
+static int pm_sha3_digest(
+  const void* data, size_t size, bool clean, uint8_t* digest) {
+  rtems_pm_sha3_engine engine = sha3_engine;
+  if (engine == RTEMS_PM_SHA3_AUTO) {
+    engine = rtems_pm_feature_check(PM_SECURE_SHA) == 0 ?
+      RTEMS_PM_SHA3_PMC : RTEMS_PM_SHA3_SOFTWARE;
+  }
+  if (engine == RTEMS_PM_SHA3_PMC) {
+    if (!clean) {
+      rtems_cache_flush_multiple_data_lines(data, size);
+    }
+    return pm_sha3_pmc(data, size, digest);
+  }
+  pm_sha3_software(data, size, digest);
+  return 0;
+}
+
+int rtems_pm_sha3_digest(const void* data, size_t size, uint8_t* digest) {
+  return pm_sha3_digest(data, size, false, digest);
+}
+
+/*
+ * The PLM writes the image info list to memory. The list address is passed
+ * upper word first.
+ */
+static bool resident_check;
+static rtems_pm_resident_stats resident_stats;
+
+void rtems_pm_acap_resident_check_set(bool check) {
+  resident_check = check;
+}
+
+bool rtems_pm_acap_resident_check_get(void) {
+  return resident_check;
+}
+
+void rtems_pm_acap_resident_get_stats(rtems_pm_resident_stats* stats) {
+  rtems_mutex_lock(&fpga_lock);
+  *stats = resident_stats;
+  stats->check = resident_check;
+  rtems_mutex_unlock(&fpga_lock);
+}
+
+/*
+ * Call with the FPGA lock held.
+ */
+static int pm_image_info_query(
+  rtems_pm_image_info* infos, uint32_t max, uint32_t* count) {
+  const size_t line = rtems_cache_get_data_line_size();
+  const size_t size = RTEMS_PM_IMAGE_INFO_MAX * sizeof(rtems_pm_image_info);
+  const size_t out_size = (size + line - 1) & ~(line - 1);
+  pm_ret_payload res;
+  rtems_pm_image_info* out;
+  uint64_t addr;
+  int r;
+  out = rtems_cache_aligned_malloc(out_size);
+  if (out == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  addr = (intptr_t) out;
+  rtems_cache_invalidate_multiple_data_lines(out, out_size);
+  r = pm_invoke_sip(
+    PM_GET_UID_INFO_LIST, pm_upper_32(addr), pm_lower_32(addr), size, 0, 0,
+    &res);
+  rtems_cache_invalidate_multiple_data_lines(out, out_size);
+  if (r == 0) {
+    *count = res.r1 > RTEMS_PM_IMAGE_INFO_MAX ? RTEMS_PM_IMAGE_INFO_MAX : res.r1;
+    if (*count > max) {
+      *count = max;
+    }
+    memcpy(infos, out, *count * sizeof(rtems_pm_image_info));
+  }
+  free(out);
+  return r;
+}
+
+int rtems_pm_image_info_list(
+  rtems_pm_image_info* infos, uint32_t max, uint32_t* count) {
+  int r;
+  rtems_mutex_lock(&fpga_lock);
+  r = pm_image_info_query(infos, max, count);
+  rtems_mutex_unlock(&fpga_lock);
+  return r;
+}
+
+/*
+ * A PDI is resident if all its images have a UID and are resident with the
+ * same parent. An image without a UID cannot be matched.
+ */
+static bool pm_acap_is_resident(
+  const rtems_pm_pdi_index* index, const rtems_pm_image_info* infos,
+  uint32_t count) {
+  uint32_t u;
+  if (rtems_pm_pdi_images(index) == 0) {
+    return false;
+  }
+  for (u = 0; u < rtems_pm_pdi_images(index); ++u) {
+    const XilPdi_ImgHdr* ihdr = rtems_pm_pdi_image(index, u);
+    uint32_t i;
+    if (ihdr->UID == 0) {
+      return false;
+    }
+    for (i = 0; i < count; ++i) {
+      if (infos[i].uid == ihdr->UID && infos[i].puid == ihdr->PUID) {
+        break;
+      }
+    }
+    if (i == count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Call with the FPGA lock held. Returns 1 if resident, 0 if not and -1 if
+ * the inventory cannot be read.
+ */
+static int pm_acap_resident(const rtems_pm_pdi_index* index) {
+  rtems_pm_image_info infos[RTEMS_PM_IMAGE_INFO_MAX];
+  uint32_t count = 0;
+  ++resident_stats.checks;
+  if (pm_image_info_query(infos, RTEMS_PM_IMAGE_INFO_MAX, &count) < 0) {
+    ++resident_stats.errors;
+    return -1;
+  }
+  return pm_acap_is_resident(index, infos, count) ? 1 : 0;
+}
+
+int rtems_pm_acap_resident(const void* image, size_t size) {
+  rtems_pm_pdi_index index;
+  int r;
+  if (rtems_pm_pdi_index_build(&index, image, size) != RTEMS_PM_IMAGE_SUCCESS) {
+    errno = EIO;
+    return -1;
+  }
+  rtems_mutex_lock(&fpga_lock);
+  r = pm_acap_resident(&index);
+  rtems_mutex_unlock(&fpga_lock);
+  return r;
+}
+
+/*
+ * Return true if the images are resident and the load can be skipped. If the
+ * inventory cannot be read the image is loaded.
+ */
+static bool pm_acap_skip_resident(const rtems_pm_pdi_index* index) {
+  int r;
+  rtems_mutex_lock(&fpga_lock);
+  r = pm_acap_resident(index);
+  if (r > 0) {
+    ++resident_stats.skips;
+  }
+  rtems_mutex_unlock(&fpga_lock);
+  return r > 0;
+}
+
+static int pm_acap_load(
+  const void* image, size_t size, bool clean, const uint8_t* digest,
+  bool reload, uint32_t* status) {
+  pm_ret_payload res;
+  rtems_pm_pdi_index index;
+  rtems_pm_image_status verify;
+  const uint64_t addr = (intptr_t) image;
+  const uint64_t load_start = pm_phase_start();
+  uint64_t start;
+  int r;
+  /*
+   * Verify all the headers before the PLM sees the image. A corrupt
+   * partition header otherwise fails part way through a load.
+   */
+  start = pm_phase_start();
+  verify = rtems_pm_pdi_index_build(&index, image, size);
+  pm_phase_record(RTEMS_PM_PHASE_VERIFY, start);
+  if (verify != RTEMS_PM_IMAGE_SUCCESS) {
+    printf("error: ACAP image: corrupt image: %s\n",
+           rtems_pm_image_error_text(index.report.status));
+    errno = EIO;
+    return -1;
+  }
+  if (index.boot_header != NULL) {
+    printf("error: ACAP image: boot PDI images cannot be loaded\n");
     errno = EIO;
     return -1;
   }
-  rtems_cache_flush_multiple_data_lines(image, size);
+  /*
+   * Skip the load if the images are resident. The check is made before
+   * the clean as it costs as much as a small load. A verified load checks
+   * the digest first so a tampered image with resident UIDs is not passed.
+   */
+  if (resident_check && !reload && digest == NULL &&
+      pm_acap_skip_resident(&index)) {
+    *status = PM_STATUS_SUCCESS;
+    pm_phase_record(RTEMS_PM_PHASE_LOAD, load_start);
+    return 0;
+  }
+  if (!clean) {
+    pm_image_clean(image, size, &index);
+  }
+  if (digest != NULL) {
+    uint8_t actual[RTEMS_PM_SHA3_384_SIZE];
+    /*
+     * The partitions strategy leaves the padding between partitions in the
+     * cache and the PMC reads all of the image.
+     */
+    start = pm_phase_start();
+    r = pm_sha3_digest(
+      image, size, clean || clean_strategy != RTEMS_PM_CLEAN_PARTITIONS, actual);
+    pm_phase_record(RTEMS_PM_PHASE_DIGEST, start);
+    if (r < 0) {
+      return -1;
+    }
+    if (memcmp(actual, digest, sizeof(actual)) != 0) {
+      printf("error: ACAP image: SHA3 digest does not match\n");
+      errno = EBADMSG;
+      return -1;
+    }
+    if (resident_check && !reload && pm_acap_skip_resident(&index)) {
+      *status = PM_STATUS_SUCCESS;
+      pm_phase_record(RTEMS_PM_PHASE_LOAD, load_start);
+      return 0;
+    }
+  }
   /*
    * Only support DDR. The modes are set here:
    *  https://github.com/Xilinx/embeddedsw/blob/master/lib/sw_services/xilloader/src/xloader.h#L229
    */
   #define PDI_SRC_DDR 0xf
   rtems_mutex_lock(&fpga_lock);
+  start = pm_phase_start();
   r = pm_invoke_sip(
     PM_LOAD_PDI, PDI_SRC_DDR, pm_lower_32(addr), pm_upper_32(addr), 0, 0, &res);
+  pm_phase_record(RTEMS_PM_PHASE_PLM, start);
   rtems_mutex_unlock(&fpga_lock);
+  /*
+   * A PDI can program the PL clocks.
+   */
+  rtems_pm_clock_invalidate();
   *status = res.r0;
+  pm_phase_record(RTEMS_PM_PHASE_LOAD, load_start);
   return r;
 }
 
-int rtems_pm_ioctl(pm_data_ioctl* ioctl) {
-  return -1;
+int rtems_pm_acap_load(const void* image, size_t size, uint32_t* status) {
+  return pm_acap_load(image, size, false, NULL, false, status);
 }
 
-int rtems_pm_query_data(pm_data_query* query) {
-  return -1;
+int rtems_pm_acap_reload(const void* image, size_t size, uint32_t* status) {
+  return pm_acap_load(image, size, false, NULL, true, status);
 }
 
-int rtems_pm_clock_control(pm_data_control* ctrl) {
-  return -1;
+int rtems_pm_acap_load_image(const rtems_pm_image* image, uint32_t* status) {
+  return pm_acap_load(
+    image->image, image->size, image->clean, NULL, false, status);
 }
 
-int rtems_pm_clock_div_control(pm_data_control* ctrl) {
-  return -1;
+int rtems_pm_acap_load_verified(
+  const rtems_pm_image* image, const uint8_t* digest, uint32_t* status) {
+  if (digest == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return pm_acap_load(
+    image->image, image->size, image->clean, digest, false, status);
 }
 
-int rtems_pm_clock_rate_control(pm_data_control* ctrl) {
-  return -1;
+int pm_register_notifier(uint32_t node, uint32_t event, bool wake, bool enable) {
+  pm_ret_payload res;
+  return pm_invoke_sip(
+    PM_REGISTER_NOTIFIER, node, event, wake ? 1 : 0, enable ? 1 : 0, 0, &res);
 }
 
-int rtems_pm_clock_parent_control(pm_data_control* ctrl) {
-  return -1;
+int pm_register_sgi(uint32_t sgi, bool reset) {
+  pm_ret_payload res;
+  return pm_invoke_sip(TF_A_PM_REGISTER_SGI, sgi, reset ? 1 : 0, 0, 0, 0, &res);
 }
 
-int rtems_pm_pll_mode(pm_data_control* ctrl) {
-  return -1;
+int pm_get_callback_data(pm_ret_payload* payload) {
+  int ret = pm_invoke(
+    SMCCC_SIP_ID(pm_sip_api_id(GET_CALLBACK_DATA)), 0, 0, 0, 0, 0, payload);
+  if (ret == SMCCC_RET_NOT_SUPPORTED) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  return 0;
+}
+
+int pm_query(
+  uint32_t qid, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+  pm_ret_payload* res) {
+  if (qid == PM_QID_CLOCK_GET_NAME) {
+    int ret = pm_invoke(
+      SMCCC_SIP_ID(pm_sip_api_id(PM_QUERY_DATA)), qid, arg1, arg2, arg3, 0,
+      res);
+    if (ret == SMCCC_RET_NOT_SUPPORTED) {
+      errno = ENOTSUP;
+      return -1;
+    }
+    return 0;
+  }
+  return pm_invoke_sip(PM_QUERY_DATA, qid, arg1, arg2, arg3, 0, res);
+}
+
+/*
+ * The extended query is available if the backend declares it and can make
+ * an SMCCC 1.2 call and the PM_QUERY_DATA version has the extended results.
+ * The version alone is not enough as the firmware's version 2 does not
+ * return the extended results. It is -1 until checked.
+ */
+static int query_ext = -1;
+
+void pm_query_ext_reset(void) {
+  query_ext = -1;
+}
+
+static bool pm_query_ext_available(void) {
+  if (query_ext < 0) {
+    const pm_backend_ops* ops = pm_backend_get();
+    query_ext = 0;
+    if ((ops->flags & PM_BACKEND_QUERY_EXT) != 0 && ops->call_ext != NULL &&
+        rtems_pm_caps_present(PM_QUERY_DATA) &&
+        pm_caps_get()->version[PM_QUERY_DATA] >= PM_QUERY_DATA_EXT_VERSION) {
+      query_ext = 1;
+    }
+  }
+  return query_ext > 0;
 }
 
-int rtems_pm_pll_fraction_data(pm_data_control* ctrl) {
+static int pm_invoke_ext(
+  const struct arm_smccc_1_2_regs* args, struct arm_smccc_1_2_regs* regs) {
+  const pm_backend_ops* ops = pm_backend_get();
+  int ret;
+  if (pm_call_trace_on) {
+    rtems_counter_ticks entry = rtems_counter_read();
+    struct arm_smccc_res res_;
+    ret = ops->call_ext(args, regs);
+    res_.a0 = ((uint64_t) pm_lower_32(regs->a[1]) << 32) |
+      pm_lower_32(regs->a[0]);
+    res_.a1 = ((uint64_t) pm_lower_32(regs->a[3]) << 32) |
+      pm_lower_32(regs->a[2]);
+    res_.a2 = 0;
+    res_.a3 = 0;
+    pm_call_trace_record(
+      args->a[0], args->a[1], args->a[2], args->a[3], ret, &res_, entry,
+      rtems_counter_read());
+  } else {
+    ret = ops->call_ext(args, regs);
+  }
+  return ret;
+}
+
+int pm_query_ext(
+  uint32_t qid, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+  pm_ret_ext_payload* res) {
+  struct arm_smccc_1_2_regs args;
+  struct arm_smccc_1_2_regs regs;
+  uint32_t w;
+  int ret;
+  if (!pm_query_ext_available()) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  memset(&args, 0, sizeof(args));
+  args.a[0] = SMCCC_SIP_ID(pm_sip_api_id(PM_QUERY_DATA));
+  args.a[1] = ((uint64_t) arg1 << 32) | qid;
+  args.a[2] = ((uint64_t) arg3 << 32) | arg2;
+  ret = pm_invoke_ext(&args, &regs);
+  if (ret == SMCCC_RET_NOT_SUPPORTED) {
+    query_ext = 0;
+    errno = ENOTSUP;
+    return -1;
+  }
+  res->r0 = pm_lower_32(regs.a[0]);
+  for (w = 0; w < PM_QUERY_EXT_WORDS; ++w) {
+    res->words[w] = pm_lower_32(regs.a[w + 1]);
+  }
+  return pm_result(ret, res->r0);
+}
+
+int pm_clock_call(
+  pm_api_id api_id, uint32_t clock, uint32_t arg1, uint32_t arg2,
+  pm_ret_payload* res) {
+  return pm_invoke_sip(api_id, clock, arg1, arg2, 0, 0, res);
+}
+
+int pm_node_call(
+  pm_api_id api_id, uint32_t node, uint32_t arg1, uint32_t arg2,
+  uint32_t arg3, pm_ret_payload* res) {
+  return pm_invoke_sip(api_id, node, arg1, arg2, arg3, 0, res);
+}
+
+int rtems_pm_ioctl(pm_data_ioctl* ioctl) {
   return -1;
 }
@@ -544,13 +544,22 @@ typedef struct {
   uint32_t arg2;
 } pm_data_ioctl;
 
+/*
+ * The query's response is returned in data. The firmware's status is in
+ * data[0] except for a clock name which is the 16 bytes of data.
+ */
 typedef struct {
   uint32_t qid;
   uint32_t arg1;
   uint32_t arg2;
   uint32_t arg3;
+  uint32_t data[4];
 } pm_data_query;
 
+/*
+ * A read returns the value in arg1. A clock rate is 64 bits and the upper
+ * 32 bits are in arg2.
+ */
 typedef struct {
   bool write_not_read;
   uint32_t id;
@@ -564,6 +573,442 @@ typedef struct {
   void* address;
 } pm_data_fpga;
 
+/*
+ * Firmware call backends. The SMC and HVC backends call the EL3 firmware
+ * (TF-A). The simulator models TF-A and the PLM in software so the PM layer
+ * can be exercised and timed without a board's firmware.
+ */
+typedef enum {
+  RTEMS_PM_BACKEND_SMC,
+  RTEMS_PM_BACKEND_HVC,
+  RTEMS_PM_BACKEND_SIM,
+  RTEMS_PM_BACKEND_MAX
+} rtems_pm_backend_id;
+
+/*
+ * Firmware call trace record. The entry and exit times are counter ticks
+ * (rtems_counter_read) and the sequence number is per CPU. The layout is
+ * saved to file by the shell and read by tools/pm-trace-decode.py.
+ */
+typedef struct {
+  uint32_t seq;
+  uint32_t cpu;
+  uint32_t func_id;
+  int32_t ret;
+  uint32_t args[5];
+  uint32_t res[4];
+  uint32_t entry;
+  uint32_t exit;
+} rtems_pm_call_record;
+
+typedef void (*rtems_pm_call_visitor)(
+  const rtems_pm_call_record* record, void* arg);
+
+/*
+ * Asynchronous ACAP load request. The caller owns the request and it and the
+ * image must be valid until the request completes. Requests are loaded in
+ * priority order, lower values first, and in submission order for the same
+ * priority. On completion the done handler is called from the loader task
+ * and then the events are sent to the task if the task is not 0. The request
+ * is not accessed by the loader after that. Times are uptime nanoseconds. If
+ * the digest is not NULL the image's SHA3-384 digest is checked before the
+ * load.
+ */
+typedef enum {
+  RTEMS_PM_ACAP_REQ_IDLE,
+  RTEMS_PM_ACAP_REQ_QUEUED,
+  RTEMS_PM_ACAP_REQ_LOADING,
+  RTEMS_PM_ACAP_REQ_DONE,
+  RTEMS_PM_ACAP_REQ_CANCELLED
+} rtems_pm_acap_req_state;
+
+typedef struct rtems_pm_acap_request rtems_pm_acap_request;
+
+typedef void (*rtems_pm_acap_done)(rtems_pm_acap_request* req, void* arg);
+
+struct rtems_pm_acap_request {
+  const rtems_pm_image* image;
+  const uint8_t* digest;
+  uint32_t priority;
+  rtems_pm_acap_done done;
+  void* arg;
+  uint32_t task;
+  uint32_t events;
+  rtems_pm_acap_req_state state;
+  int result;
+  int error;
+  uint32_t status;
+  uint64_t queued;
+  uint64_t started;
+  uint64_t finished;
+  rtems_pm_acap_request* next;
+};
+
+/*
+ * Firmware notifier. A notifier receives the firmware's callbacks for a node
+ * and any of the events in its event mask. The firmware raises an SGI and a
+ * dispatcher task reads the callback data and passes it to each matching
+ * notifier. The handler is called from the dispatcher task, the events are
+ * sent to the task if the task is not 0 and the notification is sent to the
+ * message queue if the queue is not 0. The caller owns the notifier and it
+ * must be valid until it is unregistered. The count and last notification
+ * are updated by the dispatcher.
+ */
+typedef struct {
+  uint32_t type;
+  uint32_t node;
+  uint32_t event;
+  uint32_t data;
+} rtems_pm_notification;
+
+typedef struct rtems_pm_notifier rtems_pm_notifier;
+
+typedef void (*rtems_pm_notify_handler)(
+  rtems_pm_notifier* notifier, const rtems_pm_notification* notification,
+  void* arg);
+
+struct rtems_pm_notifier {
+  uint32_t node;
+  uint32_t event;
+  bool wake;
+  rtems_pm_notify_handler handler;
+  void* arg;
+  uint32_t task;
+  uint32_t events;
+  uint32_t queue;
+  uint32_t count;
+  rtems_pm_notification last;
+  rtems_pm_notifier* next;
+};
+
+typedef struct {
+  bool running;
+  uint32_t sgi;
+  uint32_t notifiers;
+  uint64_t interrupts;
+  uint64_t callbacks;
+  uint64_t delivered;
+  uint64_t unhandled;
+} rtems_pm_notify_stats;
+
+/*
+ * Clock tree. The clocks are read from the firmware with PM_QUERY_DATA on
+ * first use and held in a table indexed by the clock id with the name,
+ * attributes, topology and parents. The clock state, divider, parent and
+ * rate read from the firmware are cached. Setting a clock invalidates the
+ * clock's cached values and all cached rates as the rates of the clocks
+ * below it change. Invalidate the cache if the clocks are changed outside
+ * the PM layer.
+ */
+#define RTEMS_PM_CLOCK_NAME_SIZE 16
+
+typedef struct {
+  uint32_t id;
+  char name[RTEMS_PM_CLOCK_NAME_SIZE];
+  uint32_t attributes;
+  uint32_t nodes;
+  uint32_t parents;
+} rtems_pm_clock_info;
+
+/*
+ * Clock scaling. The parent, divider and the parent PLL's settings are
+ * picked for the rate closest to the requested rate. The PLL is only
+ * changed with the PLL flag as the PLL's other clocks change with it. The
+ * plan flag returns the configuration without setting it. The rate is the
+ * rate read back after the configuration is set or the planned rate.
+ */
+#define RTEMS_PM_CLOCK_NONE       UINT32_MAX
+#define RTEMS_PM_CLOCK_SCALE_PLL  (1 << 0)
+#define RTEMS_PM_CLOCK_SCALE_PLAN (1 << 1)
+
+typedef struct {
+  uint64_t requested;
+  uint64_t rate;
+  uint32_t parent;
+  uint32_t divider;
+  uint32_t pll;
+  uint32_t pll_mode;
+  uint32_t pll_fbdiv;
+  uint32_t pll_frac;
+} rtems_pm_clock_config;
+
+typedef struct {
+  uint32_t clocks;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t invalidations;
+} rtems_pm_clock_stats;
+
+/*
+ * Reset actions. A pulse asserts and releases the reset in the firmware.
+ */
+typedef enum {
+  RTEMS_PM_RESET_RELEASE,
+  RTEMS_PM_RESET_ASSERT,
+  RTEMS_PM_RESET_PULSE,
+  RTEMS_PM_RESET_MAX
+} rtems_pm_reset_action;
+
+/*
+ * Secure MMIO operations. A read returns the register's value in the
+ * operation's value. A write writes the bits in the mask and a mask
+ * operation is a write of the masked bits. The initialisers let a fixed
+ * sequence be built at compile time, for example:
+ *
+ *  static rtems_pm_mmio_op noc_init[] = {
+ *    RTEMS_PM_MMIO_WRITE_OP(0xf6000000, 0xf9e8d7c6),
+ *    RTEMS_PM_MMIO_MASK_OP(0xf6000004, 0x00000003, 0x00000001),
+ *    RTEMS_PM_MMIO_READ_OP(0xf6000008)
+ *  };
+ *  r = RTEMS_PM_MMIO_BATCH(noc_init, NULL);
+ */
+typedef enum {
+  RTEMS_PM_MMIO_READ,
+  RTEMS_PM_MMIO_WRITE,
+  RTEMS_PM_MMIO_MASK,
+  RTEMS_PM_MMIO_MAX
+} rtems_pm_mmio_opcode;
+
+typedef struct {
+  rtems_pm_mmio_opcode op;
+  uint32_t address;
+  uint32_t mask;
+  uint32_t value;
+} rtems_pm_mmio_op;
+
+#define RTEMS_PM_MMIO_READ_OP(_address) \
+  { RTEMS_PM_MMIO_READ, (_address), 0, 0 }
+#define RTEMS_PM_MMIO_WRITE_OP(_address, _value) \
+  { RTEMS_PM_MMIO_WRITE, (_address), 0xffffffff, (_value) }
+#define RTEMS_PM_MMIO_MASK_OP(_address, _mask, _value) \
+  { RTEMS_PM_MMIO_MASK, (_address), (_mask), (_value) }
+
+#define RTEMS_PM_MMIO_BATCH(_ops, _done) \
+  rtems_pm_mmio_batch((_ops), sizeof(_ops) / sizeof((_ops)[0]), (_done))
+
+/*
+ * Node manager. A node is requested from the firmware on its first acquire
+ * and released to the firmware when it has had no users for the hysteresis
+ * time. The wake time is the time of a request that powers the node up.
+ * A node with a maximum latency passes it to the firmware and counts the
+ * wakes that are late. The requests, releases and reuses count the
+ * firmware requests, the firmware releases and the acquires of an idle
+ * node that made no firmware call.
+ */
+#define RTEMS_PM_NODE_CAP_ACCESS  (1 << 0)
+#define RTEMS_PM_NODE_CAP_CONTEXT (1 << 1)
+#define RTEMS_PM_NODE_CAP_WAKEUP  (1 << 2)
+#define RTEMS_PM_NODE_QOS_MAX     100
+
+#define RTEMS_PM_NODE_HYSTERESIS_MS 100
+
+typedef enum {
+  RTEMS_PM_NODE_OFF,
+  RTEMS_PM_NODE_ON,
+  RTEMS_PM_NODE_IDLE
+} rtems_pm_node_state;
+
+typedef struct {
+  uint32_t node;
+  rtems_pm_node_state state;
+  uint32_t refs;
+  uint32_t capabilities;
+  uint32_t hysteresis_ms;
+  uint32_t max_latency_us;
+  uint64_t requests;
+  uint64_t releases;
+  uint64_t reuses;
+  uint64_t late;
+  uint64_t wake_last_ns;
+  uint64_t wake_min_ns;
+  uint64_t wake_max_ns;
+  uint64_t wake_total_ns;
+} rtems_pm_node_info;
+
+typedef void (*rtems_pm_node_visitor)(const rtems_pm_node_info* info, void* arg);
+
+/*
+ * Load path phases. The times of each phase are kept in a histogram with
+ * log2 nanosecond buckets, bucket n counts times from 2^n to 2^(n+1) - 1
+ * nanoseconds. The last bucket counts all longer times.
+ *
+ *  READ  : Reading an image file
+ *  VERIFY: Verifying the image headers before a load
+ *  CLEAN : Cleaning the data cache of an image
+ *  DIGEST: Checking an image's SHA3 digest
+ *  PLM   : The PLM's load call
+ *  LOAD  : A complete ACAP load
+ */
+typedef enum {
+  RTEMS_PM_PHASE_READ,
+  RTEMS_PM_PHASE_VERIFY,
+  RTEMS_PM_PHASE_CLEAN,
+  RTEMS_PM_PHASE_DIGEST,
+  RTEMS_PM_PHASE_PLM,
+  RTEMS_PM_PHASE_LOAD,
+  RTEMS_PM_PHASE_MAX
+} rtems_pm_phase;
+
+#define RTEMS_PM_PHASE_BUCKETS 40
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t buckets[RTEMS_PM_PHASE_BUCKETS];
+} rtems_pm_phase_stats;
+
+/*
+ * The data cache maintenance before a load.
+ *
+ *  FULL      : Clean the whole image, the default
+ *  PARTITIONS: Clean the headers, certificates and partition data the PLM
+ *              reads
+ *  NONE      : No cleaning, the images are in non-cacheable memory
+ */
+typedef enum {
+  RTEMS_PM_CLEAN_FULL,
+  RTEMS_PM_CLEAN_PARTITIONS,
+  RTEMS_PM_CLEAN_NONE,
+  RTEMS_PM_CLEAN_MAX
+} rtems_pm_clean_strategy;
+
+/*
+ * SHA3-384 engines.
+ *
+ *  AUTO    : The PMC if the firmware has PM_SECURE_SHA else software
+ *  PMC     : The PMC SHA3 engine using PM_SECURE_SHA
+ *  SOFTWARE: The software SHA3 on the calling core
+ */
+typedef enum {
+  RTEMS_PM_SHA3_AUTO,
+  RTEMS_PM_SHA3_PMC,
+  RTEMS_PM_SHA3_SOFTWARE,
+  RTEMS_PM_SHA3_MAX
+} rtems_pm_sha3_engine;
+
+#define RTEMS_PM_SHA3_384_SIZE 48
+
+/*
+ * Resident images. The PLM keeps the image id, UID, parent UID and function
+ * id of each image it has loaded and PM_GET_UID_INFO_LIST returns them. With
+ * the resident check a load is skipped if each image in the PDI has a UID
+ * and is resident with the same parent UID, for example a reconfigurable
+ * module already in its partition. The checks count the inventory reads,
+ * the skips the loads not made.
+ */
+#define RTEMS_PM_IMAGE_INFO_MAX 32
+
+typedef struct {
+  uint32_t img_id;
+  uint32_t uid;
+  uint32_t puid;
+  uint32_t func_id;
+} rtems_pm_image_info;
+
+typedef struct {
+  bool check;
+  uint64_t checks;
+  uint64_t skips;
+  uint64_t errors;
+} rtems_pm_resident_stats;
+
+/*
+ * Configuration readback. A configuration read returns whole frames from
+ * the frame address. The firmware reads from the first frame and only the
+ * simulator reads from another frame address, a read from a frame other
+ * than 0 is ENOTSUP on the firmware. A register read returns the
+ * configuration register's value.
+ */
+#ifndef RTEMS_PM_FPGA_FRAME_WORDS
+#define RTEMS_PM_FPGA_FRAME_WORDS 100
+#endif
+#define RTEMS_PM_FPGA_FRAME_SIZE (RTEMS_PM_FPGA_FRAME_WORDS * sizeof(uint32_t))
+
+#define RTEMS_PM_FPGA_READ_REGISTER 0
+#define RTEMS_PM_FPGA_READ_CONFIG   1
+
+/*
+ * Configuration scrubbing. The scrubber task reads the frames of each
+ * region back a slice at a time and compares the region's SHA3-384 digest
+ * with the golden digest when the region has been read. A region that does
+ * not match has an upset and is repaired by loading the region's partial
+ * image, a PDI if the region is on an ACAP or a partial bitstream loaded
+ * with the flags. A region with no image only counts the upsets. The frame rate
+ * limits the frames read a second so the scrubber's share of the
+ * configuration port and CPU is bounded. The caller owns the region and it
+ * must be valid until it is removed.
+ *
+ * The firmware reads from the first frame so a region must start at frame 0
+ * and fit in a slice unless the backend reads from a frame address. A region
+ * that cannot be read is not added.
+ *
+ * The mask is the design's readback mask with a word for each word of the
+ * region's frames. A set bit is a bit that changes as the design runs, such
+ * as BRAM and LUTRAM contents, and it is not checked. A region with no mask
+ * checks all bits and must not hold dynamic frames.
+ *
+ * The busy time is the CPU time reading and checking the frames, the
+ * coverage is the frames read a second of run time.
+ */
+#define RTEMS_PM_SCRUB_PRIORITY       200
+#define RTEMS_PM_SCRUB_SLICE_FRAMES   16
+#define RTEMS_PM_SCRUB_FRAMES_PER_SEC 4096
+
+typedef struct rtems_pm_scrub_region rtems_pm_scrub_region;
+
+struct rtems_pm_scrub_region {
+  const char* name;
+  uint32_t frame;
+  uint32_t frames;
+  uint8_t digest[RTEMS_PM_SHA3_384_SIZE];
+  const void* image;
+  size_t size;
+  const uint32_t* mask;
+  uint32_t flags;
+  bool acap;
+  uint64_t checks;
+  uint64_t upsets;
+  uint64_t repairs;
+  rtems_pm_scrub_region* next;
+};
+
+typedef struct {
+  bool running;
+  uint32_t regions;
+  uint32_t slice_frames;
+  uint32_t frames_per_sec;
+  uint64_t frames;
+  uint64_t passes;
+  uint64_t checks;
+  uint64_t upsets;
+  uint64_t repairs;
+  uint64_t repair_errors;
+  uint64_t read_errors;
+  uint64_t busy_ns;
+  uint64_t run_ns;
+} rtems_pm_scrub_stats;
+
+/*
+ * Firmware capabilities. Every API is probed with PM_FEATURE_CHECK once at
+ * system initialisation and when the backend changes. The table is published
+ * atomically and is not changed once published so a present check is a bit
+ * test with no firmware call. The version is the API version the firmware
+ * reported and the error is the errno of the probe, 0 if the API is present.
+ * The generation changes each time a table is published.
+ */
+#define RTEMS_PM_CAPS_WORDS ((PM_API_MAX + 63) / 64)
+
+typedef struct {
+  uint32_t generation;
+  rtems_pm_backend_id backend;
+  uint64_t present[RTEMS_PM_CAPS_WORDS];
+  uint32_t version[PM_API_MAX];
+  int error[PM_API_MAX];
+  uint64_t probe_ns;
+} rtems_pm_caps;
+
 extern uint32_t smccc_version;
 
 int rtems_pm_cmd_register(void);
@@ -571,9 +1016,54 @@ int rtems_pm_cmd_register(void);
 int rtems_pm_api_version(pm_data_api_version* version);
 int rtems_pm_chipid(pm_data_chipid* chipid);
 
+/*
+ * The feature check reads the capabilities and the query makes the
+ * PM_FEATURE_CHECK firmware call.
+ */
 int rtems_pm_feature_check(pm_api_id api_id);
+int rtems_pm_feature_query(pm_api_id api_id, uint32_t* version);
+bool rtems_pm_caps_present(pm_api_id api_id);
+int rtems_pm_caps_snapshot(rtems_pm_caps* caps);
+int rtems_pm_caps_probe(void);
 uint32_t rtems_pm_get_api_id(pm_api_id api_id);
 
+/*
+ * Select the backend used to make firmware calls. The default is set at
+ * build time and is the SMC or HVC conduit the BSP uses.
+ */
+int rtems_pm_backend_select(rtems_pm_backend_id id);
+rtems_pm_backend_id rtems_pm_backend_current(void);
+const char* rtems_pm_backend_name(rtems_pm_backend_id id);
+int rtems_pm_backend_find(const char* name, rtems_pm_backend_id* id);
+
+/*
+ * Firmware call trace. Each CPU records calls into its own ring without
+ * locking. The oldest records are overwritten when a ring is full. The trace
+ * is off until it is enabled.
+ */
+void rtems_pm_call_trace_enable(bool enable);
+bool rtems_pm_call_trace_enabled(void);
+void rtems_pm_call_trace_reset(void);
+size_t rtems_pm_call_trace_iterate(rtems_pm_call_visitor visitor, void* arg);
+uint32_t rtems_pm_call_trace_cpus(void);
+uint32_t rtems_pm_call_trace_size(void);
+
+/*
+ * Load path phase statistics.
+ */
+const char* rtems_pm_phase_name(rtems_pm_phase phase);
+int rtems_pm_phase_stats_get(rtems_pm_phase phase, rtems_pm_phase_stats* stats);
+void rtems_pm_phase_stats_reset(void);
+
+/*
+ * Simulator controls. The latency is the time an API call holds the calling
+ * core, as a call into EL3 does. Loads add the image size divided by the load
+ * rate.
+ */
+int rtems_pm_sim_set_latency(pm_api_id api_id, uint32_t usecs);
+uint32_t rtems_pm_sim_get_latency(pm_api_id api_id);
+void rtems_pm_sim_set_load_rate(uint32_t kib_per_msec);
+
 /*
  * Direct calls for use by other drivers. You need to query the driver to get
  * the device handle.
@@ -585,10 +1075,147 @@ int rtems_pm_fpga_load(
   const void* image, size_t size, uint32_t flags, uint32_t* status);
 int rtems_pm_fpga_get_status(uint32_t* status);
 
+/*
+ * Read configuration frames back with PM_FPGA_READ. The buffer is cache
+ * line aligned and holds the frames.
+ */
+int rtems_pm_fpga_read(uint32_t frame, uint32_t frames, void* buffer);
+int rtems_pm_fpga_read_register(uint32_t reg, uint32_t* value);
+
+/*
+ * Reset a block. The reset ids are the PM_RESET_* ids and the Versal reset
+ * node ids, for example the PL resets the PL kernels use. A pulse resets
+ * the PL logic in milliseconds where a reload takes seconds.
+ */
+int rtems_pm_reset(uint32_t reset, rtems_pm_reset_action action);
+int rtems_pm_reset_get_status(uint32_t reset, bool* asserted);
+
+/*
+ * Secure MMIO access with PM_MMIO_READ and PM_MMIO_WRITE. A batch runs the
+ * operations in order under one lock and feature check and stops at the
+ * first error. The done count is the operations completed and can be NULL.
+ */
+int rtems_pm_mmio_read(uint32_t address, uint32_t* value);
+int rtems_pm_mmio_write(uint32_t address, uint32_t mask, uint32_t value);
+int rtems_pm_mmio_batch(rtems_pm_mmio_op* ops, size_t count, size_t* done);
+
 /*
  * Veral ACAP Image loading
  */
 int rtems_pm_acap_load(const void* image, size_t size, uint32_t* status);
+void rtems_pm_clean_strategy_set(rtems_pm_clean_strategy strategy);
+rtems_pm_clean_strategy rtems_pm_clean_strategy_get(void);
+const char* rtems_pm_clean_strategy_name(rtems_pm_clean_strategy strategy);
+int rtems_pm_acap_load_image(const rtems_pm_image* image, uint32_t* status);
+
+/*
+ * Resident image inventory. Resident returns 1 if the PDI's images are
+ * resident, 0 if not and -1 on an error. Reload loads an image if it is
+ * resident, use it to repair an upset image.
+ */
+int rtems_pm_image_info_list(
+  rtems_pm_image_info* infos, uint32_t max, uint32_t* count);
+int rtems_pm_acap_resident(const void* image, size_t size);
+void rtems_pm_acap_resident_check_set(bool check);
+bool rtems_pm_acap_resident_check_get(void);
+void rtems_pm_acap_resident_get_stats(rtems_pm_resident_stats* stats);
+int rtems_pm_acap_reload(const void* image, size_t size, uint32_t* status);
+
+/*
+ * Load an image if its SHA3-384 digest matches the digest. The digest is
+ * checked after the cache is cleaned so the PMC engine reads the same data
+ * the PLM loads. A mismatch fails with EBADMSG and the PLM is not called.
+ */
+int rtems_pm_acap_load_verified(
+  const rtems_pm_image* image, const uint8_t* digest, uint32_t* status);
+
+/*
+ * SHA3-384 digest of a buffer. The PMC engine reads the buffer from memory
+ * so the buffer's data cache lines are cleaned first.
+ */
+int rtems_pm_sha3_digest(const void* data, size_t size, uint8_t* digest);
+void rtems_pm_sha3_engine_set(rtems_pm_sha3_engine engine);
+rtems_pm_sha3_engine rtems_pm_sha3_engine_get(void);
+const char* rtems_pm_sha3_engine_name(rtems_pm_sha3_engine engine);
+
+/*
+ * Queue an ACAP load for the loader task. The loader task is started on the
+ * first request at the default priority if it has not been started. Only a
+ * queued request can be cancelled.
+ */
+int rtems_pm_acap_loader_start(uint32_t priority);
+int rtems_pm_acap_load_async(rtems_pm_acap_request* req);
+int rtems_pm_acap_load_cancel(rtems_pm_acap_request* req);
+uint32_t rtems_pm_acap_load_queued(void);
+
+/*
+ * Start the notification dispatcher on an SGI. The dispatcher is started on
+ * the first registration with the default SGI and priority if it has not
+ * been started.
+ */
+#define RTEMS_PM_NOTIFY_SGI      15
+#define RTEMS_PM_NOTIFY_PRIORITY 110
+
+int rtems_pm_notifier_start(uint32_t sgi, uint32_t priority);
+int rtems_pm_notifier_register(rtems_pm_notifier* notifier);
+int rtems_pm_notifier_unregister(rtems_pm_notifier* notifier);
+void rtems_pm_notify_get_stats(rtems_pm_notify_stats* stats);
+
+/*
+ * Queue a simulated firmware callback and raise the notification
+ * interrupt. The node and event must be registered as the firmware only
+ * sends registered events.
+ */
+int rtems_pm_sim_notify(uint32_t node, uint32_t event, uint32_t data);
+
+/*
+ * Clock tree cache. Lookup finds a clock id by name.
+ */
+int rtems_pm_clock_lookup(const char* name, uint32_t* id);
+int rtems_pm_clock_info_get(uint32_t id, rtems_pm_clock_info* info);
+void rtems_pm_clock_invalidate(void);
+int rtems_pm_clock_scale(
+  uint32_t id, uint64_t rate, uint32_t flags, rtems_pm_clock_config* config);
+void rtems_pm_clock_get_stats(rtems_pm_clock_stats* stats);
+void rtems_pm_clock_reset_stats(void);
+
+/*
+ * Node manager. Configure sets a node's capabilities, hysteresis and
+ * maximum wake latency in microseconds, 0 is no limit. The capabilities of
+ * a requested node are changed with PM_SET_REQUIREMENT. Flush releases the
+ * idle nodes.
+ */
+int rtems_pm_node_configure(
+  uint32_t node, uint32_t capabilities, uint32_t hysteresis_ms,
+  uint32_t max_latency_us);
+int rtems_pm_node_acquire(uint32_t node);
+int rtems_pm_node_release(uint32_t node);
+void rtems_pm_node_flush(void);
+int rtems_pm_node_info_get(uint32_t node, rtems_pm_node_info* info);
+void rtems_pm_node_iterate(rtems_pm_node_visitor visitor, void* arg);
+const char* rtems_pm_node_state_name(rtems_pm_node_state state);
+
+/*
+ * Configuration scrubber. Capture reads a region and sets its golden digest
+ * from the configuration, do this after the region is loaded. A region can
+ * be added or removed while the scrubber runs.
+ */
+int rtems_pm_scrub_region_add(rtems_pm_scrub_region* region);
+int rtems_pm_scrub_region_remove(rtems_pm_scrub_region* region);
+int rtems_pm_scrub_region_capture(rtems_pm_scrub_region* region);
+int rtems_pm_scrub_start(
+  uint32_t priority, uint32_t slice_frames, uint32_t frames_per_sec);
+int rtems_pm_scrub_stop(void);
+void rtems_pm_scrub_iterate(
+  void (*visitor)(const rtems_pm_scrub_region* region, void* arg), void* arg);
+void rtems_pm_scrub_get_stats(rtems_pm_scrub_stats* stats);
+void rtems_pm_scrub_reset_stats(void);
+
+/*
+ * Flip a bit in the simulated configuration frames. A load repairs the
+ * upsets.
+ */
+int rtems_pm_sim_fpga_upset(uint32_t frame, uint32_t word, uint32_t bit);
 
 /*
  * Refer to Embedded Energy Management Interface [EEMI API Reference
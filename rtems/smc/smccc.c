@@ -42,9 +42,7 @@ typedef struct {
 
 #define SMCCC_STD_FIND_FEATURES SMCCC_FUNC_ID(SMCCC_FAST_CALL, SMCCC_32BIT_CALL, 4, 10)
 
-#define SMCCC_VERSION_1_0 0x10000
-
-static uint32_t smccc_version = SMCCC_VERSION_1_0;
+uint32_t smccc_version = SMCCC_VERSION_1_0;
 
 #ifdef BSP_RESET_SMC
 #define ARM_SMCCC_CALL arm_smccc_smc
@@ -77,28 +75,34 @@ int32_t smccc_arch_features(uint32_t smccc_func_id){
 int
 smccc_arch_workaround_1(void)
 {
-  if (smccc_version != SMCCC_VERSION_1_0) {
+  if (smccc_version == SMCCC_VERSION_1_0) {
     rtems_panic("SMCCC arch workaround 1 called with an invalid SMCCC interface");
   }
   return smccc_call(SMCCC_ARCH_WORKAROUND_1, 0, 0, 0);
 }
 
 int smccc_arch_workaround_2(int enable) {
-  if (smccc_version != SMCCC_VERSION_1_0) {
+  if (smccc_version == SMCCC_VERSION_1_0) {
     rtems_panic("SMCCC arch workaround 2 called with an invalid SMCCC interface");
   }
   return smccc_call(SMCCC_ARCH_WORKAROUND_2, enable, 0, 0);
 }
 
+/*
+ * Discover the SMCCC version. SMCCC_VERSION is only called if PSCI reports
+ * it as a feature as a 1.0 firmware may not handle it. A firmware that does
+ * not report a version is 1.0.
+ */
 void rtems_smccc_init(void) {
-  smccc_version = 1;
-  /* int32_t features = smccc_call(SMCCC_STD_FIND_FEATURES, SMCCC_VERSION, 0, 0); */
-  /* if (features != SMCCC_RET_NOT_SUPPORTED) { */
-  /*   uint32_t ret = smccc_call(SMCCC_VERSION, 0, 0, 0); */
-  /*   if (ret > 0) { */
-  /*     smccc_version = ret; */
-  /*   } */
-    printf("SMCCC version %u.%u\n",
-           SMCCC_VERSION_MAJOR(smccc_version), SMCCC_VERSION_MINOR(smccc_version));
-    //}
+  int32_t features = smccc_call(SMCCC_STD_FIND_FEATURES, SMCCC_VERSION, 0, 0);
+  smccc_version = SMCCC_VERSION_1_0;
+  if (features != SMCCC_RET_NOT_SUPPORTED) {
+    int32_t ret = smccc_call(SMCCC_VERSION, 0, 0, 0);
+    if (ret > 0) {
+      smccc_version = ret;
+    }
+  }
+  printf("SMCCC version %u.%u%s\n",
+         SMCCC_VERSION_MAJOR(smccc_version), SMCCC_VERSION_MINOR(smccc_version),
+         smccc_version >= SMCCC_VERSION_1_2 ? " (x0-x17)" : "");
 }
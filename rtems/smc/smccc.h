@@ -63,6 +63,20 @@ struct arm_smccc_res {
 	register_t a3;
 };
 
+/*
+ * SMCCC 1.2 calls pass the arguments and return the results in x0 to x17.
+ */
+#define	SMCCC_1_2_REGS	18
+
+struct arm_smccc_1_2_regs {
+	register_t a[SMCCC_1_2_REGS];
+};
+
+#define	SMCCC_MAKE_VERSION(major, minor)	(((major) << 16) | (minor))
+#define	SMCCC_VERSION_1_0	SMCCC_MAKE_VERSION(1, 0)
+#define	SMCCC_VERSION_1_1	SMCCC_MAKE_VERSION(1, 1)
+#define	SMCCC_VERSION_1_2	SMCCC_MAKE_VERSION(1, 2)
+
 /*
  * Arm Architecture Calls.
  * These are documented in the document ARM DEN 0070A.
@@ -90,6 +104,16 @@ int arm_smccc_smc(register_t, register_t, register_t, register_t, register_t,
 int arm_smccc_hvc(register_t, register_t, register_t, register_t, register_t,
     register_t, register_t, register_t, struct arm_smccc_res *res);
 
+void arm_smccc_1_2_smc(const struct arm_smccc_1_2_regs *args,
+    struct arm_smccc_1_2_regs *res);
+void arm_smccc_1_2_hvc(const struct arm_smccc_1_2_regs *args,
+    struct arm_smccc_1_2_regs *res);
+
+/*
+ * The version the firmware reports, 1.0 if it cannot report a version.
+ */
+extern uint32_t smccc_version;
+
 void rtems_smccc_init(void);
 
 #endif /* _PSCI_SMCCC_H_ */
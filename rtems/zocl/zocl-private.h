@@ -49,6 +49,31 @@ extern "C" {
 #define ZOCL_MAX_SLOTS 4
 #endif
 
+/*
+ * The clock the AIE frequency scaling requests read and set and the AIE
+ * partition it clocks. The firmware does not export the AIE array clock so
+ * there is no default and the requests are not supported. Define both for a
+ * firmware that exports the clock. Another clock such as a PL clock must not
+ * be used, a rate above the design's timing closure breaks the design.
+ */
+#if defined(ZOCL_AIE_CLOCK) && !defined(ZOCL_AIE_CLOCK_PARTITION)
+#error "ZOCL_AIE_CLOCK_PARTITION is not defined"
+#endif
+
+/*
+ * The CUs of slot n are reset with the PL reset ZOCL_CU_RESET + n. The
+ * default is the Versal PL0 reset (PM_RST_PL0) and the PL0 to PL3 resets
+ * cover the slots. A CU is given the drain time to finish its run before
+ * the reset.
+ */
+#ifndef ZOCL_CU_RESET
+#define ZOCL_CU_RESET 0xc410012
+#endif
+
+#ifndef ZOCL_CU_DRAIN_MSECS
+#define ZOCL_CU_DRAIN_MSECS 10
+#endif
+
 #define MAX_CU_NUM  128
 #define MAX_APT_NUM (2 * MAX_CU_NUM)
 
@@ -90,6 +115,15 @@ typedef struct {
   zocl_slot_sections sections;
 } zocl_slot;
 
+typedef struct {
+  uint32_t reset;
+  int cus;
+  int drained;
+  int idle;
+  uint64_t drain_ns;
+  uint64_t reset_ns;
+} zocl_cu_reset;
+
 typedef struct {
   rtems_mutex lock;
   int num_pr_slot;
@@ -106,6 +140,7 @@ void zocl_xclbin_report(const struct axlf *axlf);
 int zocl_request(zocl_dev* zocl, struct drm_zocl_request* req);
 
 int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj);
+int zocl_reset_cus(zocl_dev* zocl, int slot_id, zocl_cu_reset* result);
 
 int zocl_get_sect(
   enum axlf_section_kind kind, const struct axlf *axlf, void* base,
@@ -29,6 +29,7 @@
 #include <stddef.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -38,9 +39,11 @@
 #include "zocl-trace.h"
 
 /*
- * Request handler.
+ * Request handler. A request can have an argument after a ':', the
+ * argument is NULL if there is none.
  */
-typedef int (*zocl_req_handler)(zocl_dev* zocl, struct drm_zocl_request* req);
+typedef int (*zocl_req_handler)(
+  zocl_dev* zocl, struct drm_zocl_request* req, const char* arg);
 typedef struct {
   const char* req;
   zocl_req_handler handler;
@@ -76,7 +79,8 @@ static int zocl_req_print(struct drm_zocl_request* req, const char* format, ...)
   return len;
 }
 
-static int zocl_xclbinid(zocl_dev* zocl, struct drm_zocl_request* req) {
+static int zocl_xclbinid(
+  zocl_dev* zocl, struct drm_zocl_request* req, const char* arg) {
   int s;
   for (s = 0; s < zocl->num_pr_slot; ++s) {
     zocl_slot* slot = &zocl->slots[s];
@@ -93,23 +97,68 @@ static int zocl_xclbinid(zocl_dev* zocl, struct drm_zocl_request* req) {
   return 0;
 }
 
-static int zocl_kds_custat_raw(zocl_dev* zocl, struct drm_zocl_request* req) {
+static int zocl_kds_custat_raw(
+  zocl_dev* zocl, struct drm_zocl_request* req, const char* arg) {
+  return 0;
+}
+
+/*
+ * Reset the CUs of a slot, or all loaded slots with no argument.
+ */
+static int zocl_reset_cus_req(
+  zocl_dev* zocl, struct drm_zocl_request* req, const char* arg) {
+  int first = 0;
+  int last = zocl->num_pr_slot - 1;
+  int s;
+  if (arg != NULL) {
+    char* end;
+    first = last = strtol(arg, &end, 10);
+    if (*end != '\0') {
+      return EINVAL;
+    }
+  }
+  for (s = first; s <= last; ++s) {
+    zocl_cu_reset result;
+    int r;
+    if (arg == NULL && zocl->slots[s].slot_idx < 0) {
+      continue;
+    }
+    r = zocl_reset_cus(zocl, s, &result);
+    if (r != 0) {
+      return r;
+    }
+    if (zocl_req_print(
+          req,
+          "%d %08" PRIx32 " %d %d %d %" PRIu64 " %" PRIu64 "\n",
+          s, result.reset, result.cus, result.drained, result.idle,
+          result.drain_ns / 1000, result.reset_ns / 1000) == 0) {
+      return EFBIG;
+    }
+  }
   return 0;
 }
 
 static zocl_req_handlers req_handlers[] = {
   { "xclbinid", zocl_xclbinid },
   { "kds_custat_raw", zocl_kds_custat_raw },
+  { "reset_cus", zocl_reset_cus_req },
 };
 
 #define ZOCL_REQ_NUMOF (sizeof(req_handlers) / sizeof(req_handlers[0]))
 
 int zocl_request(zocl_dev* zocl, struct drm_zocl_request* req) {
+  const char* arg = strchr(req->req_type, ':');
+  const size_t len =
+    arg == NULL ? strlen(req->req_type) : (size_t) (arg - req->req_type);
   int h;
   memset(req->data, 0, req->data_size);
+  if (arg != NULL) {
+    ++arg;
+  }
   for (h = 0; h < ZOCL_REQ_NUMOF; ++h) {
-    if (strcmp(req_handlers[h].req, req->req_type) == 0) {
-      return req_handlers[h].handler(zocl, req);
+    if (strlen(req_handlers[h].req) == len &&
+        strncmp(req_handlers[h].req, req->req_type, len) == 0) {
+      return req_handlers[h].handler(zocl, req, arg);
     }
   }
   zocl_info("zocl: request: invalid request: %s\n", req->req_type);
@@ -25,6 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <inttypes.h>
@@ -32,6 +33,7 @@
 #include <string.h>
 #include <time.h>
 
+#include <rtems/pm/pm.h>
 #include <rtems/zocl/zocl.h>
 
 #include "zocl-private.h"
@@ -179,6 +181,7 @@ int zocl_slot_sections_alloc(
 
 void zocl_slot_sections_free(zocl_slot_sections* sections) {
   free(sections->ip);
+  memset(sections, 0, sizeof(*sections));
 }
 
 static struct addr_aperture* zocl_next_free_apt_index(zocl_dev* zocl) {
@@ -191,6 +194,16 @@ static struct addr_aperture* zocl_next_free_apt_index(zocl_dev* zocl) {
   return NULL;
 }
 
+static void zocl_reset_apertures(zocl_dev* zocl, zocl_slot* slot) {
+  int a;
+  for (a = 0; a < MAX_CU_NUM; ++a) {
+    struct addr_aperture* apt = &zocl->cu_subdevs.apertures[a];
+    if (apt->addr != NULL && apt->slot_idx == slot->slot_idx) {
+      memset(apt, 0, sizeof(*apt));
+    }
+  }
+}
+
 static int zocl_update_apertures(zocl_dev* zocl, zocl_slot* slot) {
   int total = 0;
   int i;
@@ -247,7 +260,129 @@ static int zocl_update_apertures(zocl_dev* zocl, zocl_slot* slot) {
   return 0;
 }
 
-int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
+/*
+ * Load the PDI section through the PM image cache. Swapping between the same
+ * xclbins finds the PDI in the cache and it is loaded from there. The cached
+ * copy is already clean in the data cache.
+ */
+static int zocl_load_pdi(const struct axlf* axlf) {
+  rtems_pm_image* image;
+  void* pdi = NULL;
+  uint64_t size = 0;
+  uint32_t status = 0;
+  int r;
+  r = zocl_get_sect(PDI, axlf, &pdi, &size);
+  if (r != 0 || pdi == NULL) {
+    r = zocl_get_sect(BITSTREAM_PARTIAL_PDI, axlf, &pdi, &size);
+    if (r != 0 || pdi == NULL) {
+      return 0;
+    }
+  }
+  /*
+   * The section can be an LZ4 or gzip compressed PDI. The cache decompresses
+   * it once and holds the PDI.
+   */
+  r = rtems_pm_cache_load_memory(pdi, size, &image);
+  if (r < 0) {
+    zocl_info("zocl: load-pdi: cache: %s\n", strerror(errno));
+    return errno;
+  }
+  r = rtems_pm_acap_load_image(image, &status);
+  rtems_pm_cache_release(image);
+  if (r < 0) {
+    zocl_info(
+      "zocl: load-pdi: load: %s (status: %" PRIu32 ")\n", strerror(errno), status);
+    return errno;
+  }
+  return 0;
+}
+
+/*
+ * HLS kernel control register bits.
+ */
+#define ZOCL_CU_CTRL_IDLE (1 << 2)
+
+static volatile uint32_t* zocl_cu_ctrl(const struct ip_data* ip) {
+  return (volatile uint32_t*) (uintptr_t) ip->m_base_address;
+}
+
+static int zocl_cu_count_idle(const struct ip_layout* ip) {
+  int idle = 0;
+  int i;
+  for (i = 0; i < ip->m_count; ++i) {
+    if (ip->m_ip_data[i].m_type == IP_KERNEL &&
+        (*zocl_cu_ctrl(&ip->m_ip_data[i]) & ZOCL_CU_CTRL_IDLE) != 0) {
+      ++idle;
+    }
+  }
+  return idle;
+}
+
+/*
+ * Reset the CUs of a slot without reloading the PDI. The CUs are quiesced
+ * by clearing auto restart so no new run starts, drained by waiting for
+ * them to be idle and then the slot's PL reset is pulsed. A CU that does
+ * not drain is hung and the reset recovers it. The CU control registers are
+ * accessed at the IP base addresses and the BSP must map them. The slot is
+ * read with the device lock held so a load cannot change it.
+ */
+int zocl_reset_cus(zocl_dev* zocl, int slot_id, zocl_cu_reset* result) {
+  const struct ip_layout* ip;
+  zocl_slot* slot;
+  uint64_t start;
+  uint64_t deadline;
+  int i;
+  int r;
+  memset(result, 0, sizeof(*result));
+  if (slot_id < 0 || slot_id >= zocl->num_pr_slot) {
+    zocl_info("zocl: reset-cus: slot out of range: %d\n", slot_id);
+    return EINVAL;
+  }
+  slot = &zocl->slots[slot_id];
+  rtems_mutex_lock(&zocl->lock);
+  if (slot->slot_idx < 0 || slot->sections.ip == NULL) {
+    rtems_mutex_unlock(&zocl->lock);
+    return ENOENT;
+  }
+  ip = slot->sections.ip;
+  result->reset = ZOCL_CU_RESET + slot_id;
+  start = rtems_clock_get_uptime_nanoseconds();
+  for (i = 0; i < ip->m_count; ++i) {
+    if (ip->m_ip_data[i].m_type == IP_KERNEL) {
+      *zocl_cu_ctrl(&ip->m_ip_data[i]) = 0;
+      ++result->cus;
+    }
+  }
+  deadline = start + ((uint64_t) ZOCL_CU_DRAIN_MSECS * 1000000);
+  while (true) {
+    result->drained = zocl_cu_count_idle(ip);
+    if (result->drained == result->cus ||
+        rtems_clock_get_uptime_nanoseconds() >= deadline) {
+      break;
+    }
+    rtems_task_wake_after(RTEMS_YIELD_PROCESSOR);
+  }
+  result->drain_ns = rtems_clock_get_uptime_nanoseconds() - start;
+  start = rtems_clock_get_uptime_nanoseconds();
+  r = rtems_pm_reset(result->reset, RTEMS_PM_RESET_PULSE);
+  result->reset_ns = rtems_clock_get_uptime_nanoseconds() - start;
+  if (r < 0) {
+    r = errno;
+    rtems_mutex_unlock(&zocl->lock);
+    zocl_info(
+      "zocl: reset-cus: reset %08" PRIx32 ": %s\n", result->reset, strerror(r));
+    return r;
+  }
+  result->idle = zocl_cu_count_idle(ip);
+  rtems_mutex_unlock(&zocl->lock);
+  zocl_debug(
+    "zocl: reset-cus: slot=%d cus=%d drained=%d idle=%d\n",
+    slot_id, result->cus, result->drained, result->idle);
+  return 0;
+}
+
+static int zocl_load_axlf_locked(
+  zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
   struct axlf* axlf;
   int slot_id = axlf_obj->za_slot_id;
   zocl_slot* slot = NULL;
@@ -285,8 +420,6 @@ int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
     return EINVAL;
   }
 
-  uuid_copy(slot->uuid, axlf->m_header.uuid);
-
   sections = axlf->m_header.m_numSections - 1;
 
   /*
@@ -297,6 +430,14 @@ int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
     return r;
   }
 
+  /*
+   * The slot is loaded again so drop what the previous xclbin had. The uuid
+   * is set when the load succeeds so a failed load can be retried.
+   */
+  uuid_clear(slot->uuid);
+  zocl_reset_apertures(zocl, slot);
+  zocl_slot_sections_free(&slot->sections);
+
   /*
    * @todo If the same AXLF see if not forced and then if only AIE and
    *       load that.
@@ -308,6 +449,14 @@ int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
 
   r = zocl_update_apertures(zocl, slot);
   if (r != 0) {
+    zocl_reset_apertures(zocl, slot);
+    zocl_slot_sections_free(&slot->sections);
+    return r;
+  }
+
+  r = zocl_load_pdi(axlf);
+  if (r != 0) {
+    zocl_reset_apertures(zocl, slot);
     zocl_slot_sections_free(&slot->sections);
     return r;
   }
@@ -315,5 +464,15 @@ int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
   if (axlf_obj->za_ksize > 0) {
   }
 
-  return EIO;
+  uuid_copy(slot->uuid, axlf->m_header.uuid);
+
+  return 0;
+}
+
+int zocl_load_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
+  int r;
+  rtems_mutex_lock(&zocl->lock);
+  r = zocl_load_axlf_locked(zocl, axlf_obj);
+  rtems_mutex_unlock(&zocl->lock);
+  return r;
 }
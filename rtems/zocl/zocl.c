@@ -25,9 +25,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stddef.h>
 #include <string.h>
 
+#include <rtems/pm/pm.h>
 #include <rtems/zocl/zocl.h>
 
 #include "zocl-private.h"
@@ -76,6 +78,57 @@ static int zocl_aie_fd(zocl_dev* zocl, struct drm_zocl_aie_fd* aie_fd) {
   return 0;
 }
 
+/*
+ * Read or set the clock rate in Hz. A set returns the rate achieved. The
+ * clock's PLL is not changed as it clocks other parts of the device.
+ */
+static int zocl_aie_freqscale(
+  zocl_dev* zocl, struct drm_zocl_aie_freq_scale* freq) {
+#ifdef ZOCL_AIE_CLOCK
+  pm_data_control ctrl;
+  uint32_t id;
+#endif
+  zocl_debug(
+    "zocl: aie-freqscale: partition=%" PRIu32 " dir=%d freq=%" PRIu64 "\n",
+    freq->partition_id, freq->dir, freq->freq);
+#ifndef ZOCL_AIE_CLOCK
+  zocl_info("zocl: aie-freqscale: no AIE clock\n");
+  return ENOTSUP;
+#else
+  if (freq->partition_id != ZOCL_AIE_CLOCK_PARTITION) {
+    zocl_info(
+      "zocl: aie-freqscale: no clock for partition: %" PRIu32 "\n",
+      freq->partition_id);
+    return EINVAL;
+  }
+  if (rtems_pm_clock_lookup(ZOCL_AIE_CLOCK, &id) < 0) {
+    zocl_info(
+      "zocl: aie-freqscale: clock: %s: %s\n", ZOCL_AIE_CLOCK, strerror(errno));
+    return errno;
+  }
+  if (freq->dir != 0) {
+    rtems_pm_clock_config config;
+    if (rtems_pm_clock_scale(id, freq->freq, 0, &config) < 0) {
+      zocl_info("zocl: aie-freqscale: set: %s\n", strerror(errno));
+      return errno;
+    }
+    zocl_debug(
+      "zocl: aie-freqscale: requested=%" PRIu64 " rate=%" PRIu64
+      " divider=%" PRIu32 "\n", config.requested, config.rate, config.divider);
+    freq->freq = config.rate;
+    return 0;
+  }
+  memset(&ctrl, 0, sizeof(ctrl));
+  ctrl.id = id;
+  if (rtems_pm_clock_rate_control(&ctrl) < 0) {
+    zocl_info("zocl: aie-freqscale: get: %s\n", strerror(errno));
+    return errno;
+  }
+  freq->freq = ((uint64_t) ctrl.arg2 << 32) | ctrl.arg1;
+  return 0;
+#endif
+}
+
 static int zocl_read_axlf(zocl_dev* zocl, struct drm_zocl_axlf* axlf_obj) {
   return zocl_load_axlf(zocl, axlf_obj);
 }
@@ -185,7 +238,7 @@ static int zocl_ioctl(
       break;
     case DRM_IOCTL_ZOCL_AIE_FREQSCALE:
       zocl_debug("zocl: cmd: ZOCL_AIE_FREQSCALE\n");
-      err = EIO;
+      err = zocl_aie_freqscale(zocl, arg);
       break;
     case DRM_IOCTL_ZOCL_REQUEST:
       zocl_debug("zocl: cmd: ZOCL_REQUEST\n");
@@ -55,8 +55,22 @@ data = {
         'cflags': ['-Wall'],
         'sources': [
             'pm/pm.c',
+            'pm/pm-arena.c',
+            'pm/pm-async.c',
+            'pm/pm-backend.c',
+            'pm/pm-cache.c',
+            'pm/pm-call-trace.c',
+            'pm/pm-clock.c',
+            'pm/pm-decompress.c',
             'pm/pm-image.c',
+            'pm/pm-loader.c',
+            'pm/pm-node.c',
+            'pm/pm-notify.c',
+            'pm/pm-scrub.c',
+            'pm/pm-sha3.c',
             'pm/pm-shell.c',
+            'pm/pm-sim.c',
+            'pm/pm-stats.c',
         ],
         'install': {
             'rtems/pm': [
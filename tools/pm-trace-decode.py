@@ -0,0 +1,176 @@
+#! /usr/bin/env python3
+#
+# Copyright 2022 Chris Johns (chrisj@rtems.org)
+#
+# This file's license is 2-clause BSD as in this distribution's LICENSE.2 file.
+#
+
+#
+# Decode a PM firmware call trace saved on the target with:
+#
+#  pm trace save /net/trace.bin
+#
+# The records are printed in time order with a per API summary.
+#
+
+from __future__ import print_function
+
+import argparse
+import struct
+import sys
+
+header_format = '<4sIII'
+record_format = '<IIIi5I4III'
+
+sip_api_ids = {
+    0x1: 'PM_GET_API_VERSION',
+    0x2: 'PM_SET_CONFIGURATION',
+    0x3: 'PM_GET_NODE_STATUS',
+    0x4: 'PM_GET_OP_CHARACTERISTIC',
+    0x5: 'PM_REGISTER_NOTIFIER',
+    0x6: 'PM_REQUEST_SUSPEND',
+    0x7: 'PM_SELF_SUSPEND',
+    0x8: 'PM_FORCE_POWERDOWN',
+    0x9: 'PM_ABORT_SUSPEND',
+    0xA: 'PM_REQUEST_WAKEUP',
+    0xB: 'PM_SET_WAKEUP_SOURCE',
+    0xC: 'PM_SYSTEM_SHUTDOWN',
+    0xD: 'PM_REQUEST_NODE',
+    0xE: 'PM_RELEASE_NODE',
+    0xF: 'PM_SET_REQUIREMENT',
+    0x10: 'PM_SET_MAX_LATENCY',
+    0x11: 'PM_RESET_ASSERT',
+    0x12: 'PM_RESET_GET_STATUS',
+    0x13: 'PM_MMIO_WRITE',
+    0x14: 'PM_MMIO_READ',
+    0x15: 'PM_INIT_FINALIZE',
+    0x16: 'PM_FPGA_LOAD',
+    0x17: 'PM_FPGA_GET_STATUS',
+    0x18: 'PM_GET_CHIPID',
+    0x19: 'PM_SECURE_RSA_AES',
+    0x1A: 'PM_SECURE_SHA',
+    0x1B: 'PM_SECURE_RSA',
+    0x1C: 'PM_PINCTRL_REQUEST',
+    0x1D: 'PM_PINCTRL_RELEASE',
+    0x1E: 'PM_PINCTRL_GET_FUNCTION',
+    0x1F: 'PM_PINCTRL_SET_FUNCTION',
+    0x20: 'PM_PINCTRL_CONFIG_PARAM_GET',
+    0x21: 'PM_PINCTRL_CONFIG_PARAM_SET',
+    0x22: 'PM_IOCTL',
+    0x23: 'PM_QUERY_DATA',
+    0x24: 'PM_CLOCK_ENABLE',
+    0x25: 'PM_CLOCK_DISABLE',
+    0x26: 'PM_CLOCK_GETSTATE',
+    0x27: 'PM_CLOCK_SETDIVIDER',
+    0x28: 'PM_CLOCK_GETDIVIDER',
+    0x29: 'PM_CLOCK_SETRATE',
+    0x2A: 'PM_CLOCK_GETRATE',
+    0x2B: 'PM_CLOCK_SETPARENT',
+    0x2C: 'PM_CLOCK_GETPARENT',
+    0x2D: 'PM_SECURE_IMAGE',
+    0x2E: 'PM_FPGA_READ',
+    0x2F: 'PM_API_RESERVED_1',
+    0x30: 'PM_PLL_SET_PARAMETER',
+    0x31: 'PM_PLL_GET_PARAMETER',
+    0x32: 'PM_PLL_SET_MODE',
+    0x33: 'PM_PLL_GET_MODE',
+    0x34: 'PM_REGISTER_ACCESS',
+    0x35: 'PM_EFUSE_ACCESS',
+    0x36: 'PM_ADD_SUBSYSTEM',
+    0x37: 'PM_DESTROY_SUBSYSTEM',
+    0x38: 'PM_DESCRIBE_NODES',
+    0x39: 'PM_ADD_NODE',
+    0x3A: 'PM_ADD_NODE_PARENT',
+    0x3B: 'PM_ADD_NODE_NAME',
+    0x3C: 'PM_ADD_REQUIREMENT',
+    0x3D: 'PM_SET_CURRENT_SUBSYSTEM',
+    0x3E: 'PM_INIT_NODE',
+    0x3F: 'PM_FEATURE_CHECK',
+    0x40: 'PM_ISO_CONTROL',
+    0x41: 'PM_ACTIVATE_SUBSYSTEM',
+    0x568: 'PM_WRITE_AES_KEY',
+    0x701: 'PM_LOAD_PDI',
+    0x705: 'PM_GET_UID_INFO_LIST',
+    0x706: 'PM_GET_META_HEADER_INFO_LIST',
+    0xA01: 'GET_CALLBACK_DATA',
+    0xA02: 'PM_SET_SUSPEND_MODE',
+    0xA03: 'PM_GET_TRUSTZONE_VERSION',
+    0xA04: 'TF_A_PM_REGISTER_SGI',
+    0xB01: 'PM_BBRAM_WRITE_KEY',
+    0xB02: 'PM_BBRAM_ZEROIZE',
+    0xB03: 'PM_BBRAM_WRITE_USERDATA',
+    0xB04: 'PM_BBRAM_READ_USERDATA',
+    0xB05: 'PM_BBRAM_LOCK_USERDATA',
+}
+
+class record(object):
+    def __init__(self, fields, frequency):
+        self.seq = fields[0]
+        self.cpu = fields[1]
+        self.func_id = fields[2]
+        self.ret = fields[3]
+        self.args = fields[4:9]
+        self.res = fields[9:13]
+        self.entry = fields[13]
+        self.exit = fields[14]
+        self.ticks = (self.exit - self.entry) & 0xffffffff
+        self.nsecs = (self.ticks * 1000000000) // frequency
+
+    def api(self):
+        return sip_api_ids.get(self.func_id & 0xffff,
+                               'UNKNOWN(%08x)' % (self.func_id))
+
+def load(name):
+    try:
+        data = open(name, 'rb').read()
+    except IOError as ioe:
+        raise SystemExit('error: %s: %s' % (name, ioe.strerror))
+    hsize = struct.calcsize(header_format)
+    if len(data) < hsize:
+        raise SystemExit('error: %s: file too short' % (name))
+    magic, version, rsize, frequency = \
+        struct.unpack_from(header_format, data, 0)
+    if magic != b'PMCT':
+        raise SystemExit('error: %s: not a PM call trace' % (name))
+    if version != 1 or rsize != struct.calcsize(record_format):
+        raise SystemExit('error: %s: unsupported trace version' % (name))
+    if frequency == 0:
+        raise SystemExit('error: %s: invalid counter frequency' % (name))
+    records = []
+    for offset in range(hsize, len(data) - rsize + 1, rsize):
+        records += [record(struct.unpack_from(record_format, data, offset),
+                           frequency)]
+    return frequency, records
+
+def summary(records):
+    apis = {}
+    for r in records:
+        apis.setdefault(r.api(), []).append(r.nsecs)
+    print('Summary:')
+    print(' %-30s %8s %10s %10s %10s %10s' % \
+          ('api', 'calls', 'min ns', 'median ns', 'max ns', 'total us'))
+    for api in sorted(apis):
+        nsecs = sorted(apis[api])
+        print(' %-30s %8d %10d %10d %10d %10d' % \
+              (api, len(nsecs), nsecs[0], nsecs[len(nsecs) // 2], nsecs[-1],
+               sum(nsecs) // 1000))
+
+def run(args):
+    argsp = argparse.ArgumentParser(description='PM firmware call trace decoder')
+    argsp.add_argument('-s', '--summary', action='store_true',
+                       help='only print the summary')
+    argsp.add_argument('trace', help='trace file saved on the target')
+    opts = argsp.parse_args(args[1:])
+    frequency, records = load(opts.trace)
+    records.sort(key=lambda r: (r.entry, r.cpu))
+    print('Counter: %d Hz, calls: %d' % (frequency, len(records)))
+    if not opts.summary:
+        for r in records:
+            print(' %2d %8d %-30s %08x %08x %08x %4d %08x %08x %10d' % \
+                  (r.cpu, r.seq, r.api(), r.args[0], r.args[1], r.args[2],
+                   r.ret, r.res[0], r.res[1], r.nsecs))
+    if len(records) > 0:
+        summary(records)
+
+if __name__ == "__main__":
+    run(sys.argv)